@@ -0,0 +1,240 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "NPX2AcquisitionExecutor.h"
+
+struct AcquisitionExecutor::DrainTask
+{
+	Probe* probe;
+};
+
+class AcquisitionExecutor::Worker : public Thread
+{
+public:
+	Worker(AcquisitionExecutor* executor_, int index_)
+		: Thread("npx2_acq_" + String(index_)), executor(executor_), index(index_), random(index_ + 1),
+		  tasksRun(0), packets(0), steals(0), idleWaits(0) {}
+
+	~Worker()
+	{
+		stopThread(1000);
+	}
+
+	void push(DrainTask* task)
+	{
+		const ScopedLock lock(queueLock);
+		queue.push_back(task);
+	}
+
+	DrainTask* popFront()
+	{
+		const ScopedLock lock(queueLock);
+
+		if (queue.empty())
+			return nullptr;
+
+		DrainTask* task = queue.front();
+		queue.pop_front();
+		return task;
+	}
+
+	/** Called by other workers; takes from the opposite end to the owner. */
+	DrainTask* popBack()
+	{
+		const ScopedLock lock(queueLock);
+
+		if (queue.empty())
+			return nullptr;
+
+		DrainTask* task = queue.back();
+		queue.pop_back();
+		return task;
+	}
+
+	int getQueueSize() const
+	{
+		const ScopedLock lock(queueLock);
+		return int(queue.size());
+	}
+
+	void run() override
+	{
+		//Consecutive reads of this worker's own tasks that came back empty
+		int emptyReads = 0;
+
+		while (!threadShouldExit())
+		{
+			DrainTask* task = nullptr;
+			bool stolen = false;
+
+			if (emptyReads <= getQueueSize())
+				task = popFront();
+
+			if (task == nullptr)
+			{
+				task = executor->steal(this);
+				stolen = task != nullptr;
+			}
+
+			if (task != nullptr)
+			{
+				int count = task->probe->readNext();
+
+				tasksRun++;
+				packets += count;
+
+				if (stolen)
+					steals++;
+
+				push(task);
+
+				if (count > 0)
+				{
+					emptyReads = 0;
+					continue;
+				}
+
+				if (!stolen)
+				{
+					emptyReads++;
+					continue;
+				}
+			}
+
+			//Neither our own tasks nor a stolen one had anything to read
+			idleWaits++;
+			emptyReads = 0;
+			wait(ACQUISITION_IDLE_WAIT_MS);
+		}
+	}
+
+	AcquisitionExecutor* executor;
+	int index;
+	Random random; //Only used by this worker, to pick victims
+
+	std::atomic<int64> tasksRun;
+	std::atomic<int64> packets;
+	std::atomic<int64> steals;
+	std::atomic<int64> idleWaits;
+
+private:
+	CriticalSection queueLock;
+	std::deque<DrainTask*> queue;
+};
+
+AcquisitionExecutor::AcquisitionExecutor(int coreBudget_) : coreBudget(coreBudget_)
+{
+}
+
+AcquisitionExecutor::~AcquisitionExecutor()
+{
+	stop();
+}
+
+int AcquisitionExecutor::getWorkerCount(int coreBudget, int numProbes)
+{
+	int budget = coreBudget > 0 ? coreBudget : SystemStats::getNumCpus() - 1;
+
+	return jmax(1, jmin(budget, numProbes, MAX_ACQUISITION_WORKERS));
+}
+
+void AcquisitionExecutor::start(const Array<Probe*>& probes)
+{
+	stop();
+
+	if (probes.size() == 0)
+		return;
+
+	int numWorkers = getWorkerCount(coreBudget, probes.size());
+
+	for (int i = 0; i < numWorkers; i++)
+		workers.add(new Worker(this, i));
+
+	for (int i = 0; i < probes.size(); i++)
+	{
+		DrainTask* task = tasks.add(new DrainTask());
+		task->probe = probes[i];
+		workers[i % numWorkers]->push(task);
+	}
+
+	std::cout << "Starting " << numWorkers << " acquisition workers for " << probes.size() << " probes." << std::endl;
+
+	for (auto worker : workers)
+		worker->startThread();
+
+	for (auto probe : probes)
+		probe->armed = true;
+}
+
+void AcquisitionExecutor::stop()
+{
+	for (auto worker : workers)
+		worker->signalThreadShouldExit();
+
+	for (auto worker : workers)
+		worker->stopThread(1000);
+
+	workers.clear();
+	tasks.clear();
+}
+
+AcquisitionExecutor::DrainTask* AcquisitionExecutor::steal(Worker* thief)
+{
+	int numWorkers = workers.size();
+
+	if (numWorkers < 2)
+		return nullptr;
+
+	//Start at a random victim so that idle workers do not all hit the same queue
+	int first = thief->random.nextInt(numWorkers);
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		Worker* victim = workers[(first + i) % numWorkers];
+
+		if (victim == thief)
+			continue;
+
+		DrainTask* task = victim->popBack();
+
+		if (task != nullptr)
+			return task;
+	}
+
+	return nullptr;
+}
+
+ExecutorStatistics AcquisitionExecutor::getStatistics() const
+{
+	ExecutorStatistics stats = { workers.size(), 0, 0, 0, 0 };
+
+	for (auto worker : workers)
+	{
+		stats.tasksRun += worker->tasksRun;
+		stats.packets += worker->packets;
+		stats.steals += worker->steals;
+		stats.idleWaits += worker->idleWaits;
+	}
+
+	return stats;
+}
@@ -0,0 +1,95 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NPX2ACQUISITIONEXECUTOR_H__
+#define __NPX2ACQUISITIONEXECUTOR_H__
+
+#include <DataThreadHeaders.h>
+#include <atomic>
+#include <deque>
+
+#include "NPX2Components.h"
+
+#define MAX_ACQUISITION_WORKERS 	32
+#define ACQUISITION_IDLE_WAIT_MS 	1
+
+struct ExecutorStatistics
+{
+	int workers;
+	int64 tasksRun;  //readNext calls across all workers
+	int64 packets;   //AP packets those calls returned
+	int64 steals;    //Tasks taken from another worker's queue
+	int64 idleWaits; //Times a worker found nothing to read and backed off
+};
+
+/**
+
+	Reads the FIFOs of many probes on a fixed pool of workers.
+
+	Every probe is a drain task that lives in one worker's queue. A worker takes
+	tasks from the front of its own queue and puts them back at the end; a worker
+	whose tasks have nothing to read steals from the end of another worker's queue,
+	so the neighbours of a probe with a burst are picked up by idle workers while
+	its owner is still draining it.
+
+	A task is only ever held by one worker, so Probe::readNext never overlaps.
+
+*/
+class AcquisitionExecutor
+{
+public:
+	/** coreBudget is the number of workers; 0 uses all but one of the CPUs. */
+	AcquisitionExecutor(int coreBudget = 0);
+	~AcquisitionExecutor();
+
+	/** Spreads the probes over the workers, starts them and arms the probes. */
+	void start(const Array<Probe*>& probes);
+
+	/** Stops the workers; the probes keep whatever they already queued. */
+	void stop();
+
+	bool isRunning() const { return workers.size() > 0; }
+
+	int getNumWorkers() const { return workers.size(); }
+
+	ExecutorStatistics getStatistics() const;
+
+	/** The worker count a budget resolves to for a given number of probes. */
+	static int getWorkerCount(int coreBudget, int numProbes);
+
+private:
+
+	struct DrainTask;
+	class Worker;
+
+	DrainTask* steal(Worker* thief);
+
+	int coreBudget;
+
+	OwnedArray<DrainTask> tasks;
+	OwnedArray<Worker> workers;
+
+	JUCE_DECLARE_NON_COPYABLE(AcquisitionExecutor);
+};
+
+#endif  // __NPX2ACQUISITIONEXECUTOR_H__
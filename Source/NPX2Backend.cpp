@@ -0,0 +1,291 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "NPX2Backend.h"
+
+static ScopedPointer<NPX2Backend>& installedBackend()
+{
+	static ScopedPointer<NPX2Backend> backend(new NativeBackend());
+	return backend;
+}
+
+NPX2Backend& NPX2Backend::get()
+{
+	return *installedBackend();
+}
+
+void NPX2Backend::install(NPX2Backend* backend)
+{
+	if (backend != nullptr)
+		installedBackend() = backend;
+}
+
+void NativeBackend::getAPIVersion(uint8_t* version_major, uint8_t* version_minor)
+{
+	return np::getAPIVersion(version_major, version_minor);
+}
+
+np::NP_ErrorCode NativeBackend::getAvailableSlots(uint32_t* slotmask)
+{
+	return np::getAvailableSlots(slotmask);
+}
+
+np::NP_ErrorCode NativeBackend::setParameter(np::np_parameter_t paramid, int value)
+{
+	return np::setParameter(paramid, value);
+}
+
+np::NP_ErrorCode NativeBackend::openBS(int slotID)
+{
+	return np::openBS(slotID);
+}
+
+np::NP_ErrorCode NativeBackend::closeBS(int slotID)
+{
+	return np::closeBS(slotID);
+}
+
+np::NP_ErrorCode NativeBackend::arm(int slotID)
+{
+	return np::arm(slotID);
+}
+
+np::NP_ErrorCode NativeBackend::setSWTrigger(int slotID)
+{
+	return np::setSWTrigger(slotID);
+}
+
+np::NP_ErrorCode NativeBackend::setTriggerEdge(int slotID, bool rising)
+{
+	return np::setTriggerEdge(slotID, rising);
+}
+
+np::NP_ErrorCode NativeBackend::setTriggerBinding(int slotID, np::signalline_t outputlines, np::signalline_t inputlines)
+{
+	return np::setTriggerBinding(slotID, outputlines, inputlines);
+}
+
+np::NP_ErrorCode NativeBackend::enableFileStream(int slotID, bool enable)
+{
+	return np::enableFileStream(slotID, enable);
+}
+
+np::NP_ErrorCode NativeBackend::setFileStream(int slotID, const char* filename)
+{
+	return np::setFileStream(slotID, filename);
+}
+
+np::NP_ErrorCode NativeBackend::getBSBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build)
+{
+	return np::getBSBootVersion(slotID, version_major, version_minor, version_build);
+}
+
+np::NP_ErrorCode NativeBackend::getBSCBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build)
+{
+	return np::getBSCBootVersion(slotID, version_major, version_minor, version_build);
+}
+
+np::NP_ErrorCode NativeBackend::getBSCVersion(int slotID, uint8_t* version_major, uint8_t* version_minor)
+{
+	return np::getBSCVersion(slotID, version_major, version_minor);
+}
+
+np::NP_ErrorCode NativeBackend::readBSCSN(int slotID, uint64_t* sn)
+{
+	return np::readBSCSN(slotID, sn);
+}
+
+np::NP_ErrorCode NativeBackend::readBSCPN(int slotID, char* pn, size_t len)
+{
+	return np::readBSCPN(slotID, pn, len);
+}
+
+np::NP_ErrorCode NativeBackend::closePort(int slotID, int portID)
+{
+	return np::closePort(slotID, portID);
+}
+
+np::NP_ErrorCode NativeBackend::setHSLed(int slotID, int portID, bool enable)
+{
+	return np::setHSLed(slotID, portID, enable);
+}
+
+np::NP_ErrorCode NativeBackend::getHSVersion(int slotID, int portID, uint8_t* version_major, uint8_t* version_minor)
+{
+	return np::getHSVersion(slotID, portID, version_major, version_minor);
+}
+
+np::NP_ErrorCode NativeBackend::readHSSN(int slotID, int portID, uint64_t* sn)
+{
+	return np::readHSSN(slotID, portID, sn);
+}
+
+np::NP_ErrorCode NativeBackend::readHSPN(int slotID, int portID, char* pn, size_t maxlen)
+{
+	return np::readHSPN(slotID, portID, pn, maxlen);
+}
+
+np::NP_ErrorCode NativeBackend::getFlexVersion(int slotID, int portID, int dockID, unsigned char* version_major, unsigned char* version_minor)
+{
+	return np::getFlexVersion(slotID, portID, dockID, version_major, version_minor);
+}
+
+np::NP_ErrorCode NativeBackend::readFlexPN(int slotID, int portID, int dockID, char* pn, size_t maxlen)
+{
+	return np::readFlexPN(slotID, portID, dockID, pn, maxlen);
+}
+
+np::NP_ErrorCode NativeBackend::openProbe(int slotID, int portID, int dockID)
+{
+	return np::openProbe(slotID, portID, dockID);
+}
+
+np::NP_ErrorCode NativeBackend::init(int slotID, int portID, int dockID)
+{
+	return np::init(slotID, portID, dockID);
+}
+
+np::NP_ErrorCode NativeBackend::readProbeSN(int slotID, int portID, int dockID, uint64_t* id)
+{
+	return np::readProbeSN(slotID, portID, dockID, id);
+}
+
+np::NP_ErrorCode NativeBackend::readProbePN(int slotID, int portID, int dockID, char* pn, size_t maxlen)
+{
+	return np::readProbePN(slotID, portID, dockID, pn, maxlen);
+}
+
+np::NP_ErrorCode NativeBackend::setOPMODE(int slotID, int portID, int dockID, np::probe_opmode_t mode)
+{
+	return np::setOPMODE(slotID, portID, dockID, mode);
+}
+
+np::NP_ErrorCode NativeBackend::selectElectrode(int slotID, int portID, int dockID, int channel, int shank, int bank)
+{
+	return np::selectElectrode(slotID, portID, dockID, channel, shank, bank);
+}
+
+np::NP_ErrorCode NativeBackend::setReference(int slotID, int portID, int dockID, int channel, int shank, np::channelreference_t reference, int intRefElectrodeBank)
+{
+	return np::setReference(slotID, portID, dockID, channel, shank, reference, intRefElectrodeBank);
+}
+
+np::NP_ErrorCode NativeBackend::setAPCornerFrequency(int slotID, int portID, int dockID, int channel, bool disableHighPass)
+{
+	return np::setAPCornerFrequency(slotID, portID, dockID, channel, disableHighPass);
+}
+
+np::NP_ErrorCode NativeBackend::setStdb(int slotID, int portID, int dockID, int channel, bool standby)
+{
+	return np::setStdb(slotID, portID, dockID, channel, standby);
+}
+
+np::NP_ErrorCode NativeBackend::writeProbeConfiguration(int slotID, int portID, int dockID, bool readCheck)
+{
+	return np::writeProbeConfiguration(slotID, portID, dockID, readCheck);
+}
+
+np::NP_ErrorCode NativeBackend::readPacket(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t requestedChannelCount, size_t* actualread)
+{
+	return np::readPacket(slotID, portID, dockID, source, pckinfo, data, requestedChannelCount, actualread);
+}
+
+np::NP_ErrorCode NativeBackend::readPackets(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t channelcount, size_t packetcount, size_t* packetsread)
+{
+	return np::readPackets(slotID, portID, dockID, source, pckinfo, data, channelcount, packetcount, packetsread);
+}
+
+np::NP_ErrorCode NativeBackend::getPacketFifoStatus(int slotID, int portID, int dockID, np::streamsource_t source, size_t* packetsavailable, size_t* headroom)
+{
+	return np::getPacketFifoStatus(slotID, portID, dockID, source, packetsavailable, headroom);
+}
+
+np::NP_ErrorCode NativeBackend::createProbePacketCallback(int slotID, int portID, int dockID, np::streamsource_t source, np::npcallbackhandle_t* handle, np::np_packetcallbackfn_t callback, const void* userdata)
+{
+	return np::createProbePacketCallback(slotID, portID, dockID, source, handle, callback, userdata);
+}
+
+np::NP_ErrorCode NativeBackend::destroyPacketCallback(np::npcallbackhandle_t* handle)
+{
+	return np::destroyPacketCallback(handle);
+}
+
+np::NP_ErrorCode NativeBackend::unpackData(const np::np_packet_t* packet, int16_t* output, size_t samplestoread, size_t* actualread)
+{
+	return np::unpackData(packet, output, samplestoread, actualread);
+}
+
+np::NP_ErrorCode NativeBackend::bistBS(int slotID)
+{
+	return np::bistBS(slotID);
+}
+
+np::NP_ErrorCode NativeBackend::bistHB(int slotID, int portID, int dockID)
+{
+	return np::bistHB(slotID, portID, dockID);
+}
+
+np::NP_ErrorCode NativeBackend::bistStartPRBS(int slotID, int portID)
+{
+	return np::bistStartPRBS(slotID, portID);
+}
+
+np::NP_ErrorCode NativeBackend::bistStopPRBS(int slotID, int portID, int* prbs_err)
+{
+	return np::bistStopPRBS(slotID, portID, prbs_err);
+}
+
+np::NP_ErrorCode NativeBackend::bistI2CMM(int slotID, int portID, int dockID)
+{
+	return np::bistI2CMM(slotID, portID, dockID);
+}
+
+np::NP_ErrorCode NativeBackend::bistEEPROM(int slotID, int portID)
+{
+	return np::bistEEPROM(slotID, portID);
+}
+
+np::NP_ErrorCode NativeBackend::bistSR(int slotID, int portID, int dockID)
+{
+	return np::bistSR(slotID, portID, dockID);
+}
+
+np::NP_ErrorCode NativeBackend::bistPSB(int slotID, int portID, int dockID)
+{
+	return np::bistPSB(slotID, portID, dockID);
+}
+
+np::NP_ErrorCode NativeBackend::bistNoise(int slotID, int portID, int dockID)
+{
+	return np::bistNoise(slotID, portID, dockID);
+}
+
+np::NP_ErrorCode NativeBackend::dbg_diagstats_read(int slotID, np::np_diagstats* stats)
+{
+	return np::dbg_diagstats_read(slotID, stats);
+}
+
+np::NP_ErrorCode NativeBackend::dbg_sourcestats_read(int slotID, uint8_t sourceID, np::np_sourcestats* stats)
+{
+	return np::dbg_sourcestats_read(slotID, sourceID, stats);
+}
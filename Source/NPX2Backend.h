@@ -0,0 +1,201 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NPX2BACKEND_H__
+#define __NPX2BACKEND_H__
+
+#include <DataThreadHeaders.h>
+#include <stdint.h>
+
+#include "npx2-api/NeuropixAPI.h"
+
+//The debug exports use the np types without opening the namespace themselves
+namespace np {
+#include "npx2-api/NeuropixAPI_debug.h"
+}
+
+/**
+
+	Every call the plugin makes into the Neuropixels hardware goes through the
+	installed NPX2Backend rather than straight to np::, so the hardware can be
+	swapped for a test double, recorded or replayed.
+
+	The methods mirror the np:: functions of the same name. NativeBackend
+	forwards to the linked library (the vendor API, or the simulator when built
+	with NPX2_SIMULATED_BACKEND); RecordingBackend and ReplayBackend live in
+	NPX2BackendTrace.h.
+
+	Implementations must be safe to call from several probe threads at once,
+	just like the vendor API.
+
+*/
+class NPX2Backend
+{
+public:
+	virtual ~NPX2Backend() {}
+
+	/** The backend in use; a NativeBackend unless another one was installed. */
+	static NPX2Backend& get();
+
+	/** Replaces the backend and takes ownership of it. Only call while no hardware is open. */
+	static void install(NPX2Backend* backend);
+
+	virtual String getName() const = 0;
+
+	/* System */
+	virtual void getAPIVersion(uint8_t* version_major, uint8_t* version_minor) = 0;
+	virtual np::NP_ErrorCode getAvailableSlots(uint32_t* slotmask) = 0;
+	virtual np::NP_ErrorCode setParameter(np::np_parameter_t paramid, int value) = 0;
+
+	/* Basestation */
+	virtual np::NP_ErrorCode openBS(int slotID) = 0;
+	virtual np::NP_ErrorCode closeBS(int slotID) = 0;
+	virtual np::NP_ErrorCode arm(int slotID) = 0;
+	virtual np::NP_ErrorCode setSWTrigger(int slotID) = 0;
+	virtual np::NP_ErrorCode setTriggerEdge(int slotID, bool rising) = 0;
+	virtual np::NP_ErrorCode setTriggerBinding(int slotID, np::signalline_t outputlines, np::signalline_t inputlines) = 0;
+	virtual np::NP_ErrorCode enableFileStream(int slotID, bool enable) = 0;
+	virtual np::NP_ErrorCode setFileStream(int slotID, const char* filename) = 0;
+	virtual np::NP_ErrorCode getBSBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build) = 0;
+	virtual np::NP_ErrorCode getBSCBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build) = 0;
+	virtual np::NP_ErrorCode getBSCVersion(int slotID, uint8_t* version_major, uint8_t* version_minor) = 0;
+	virtual np::NP_ErrorCode readBSCSN(int slotID, uint64_t* sn) = 0;
+	virtual np::NP_ErrorCode readBSCPN(int slotID, char* pn, size_t len) = 0;
+
+	/* Headstage and flex */
+	virtual np::NP_ErrorCode closePort(int slotID, int portID) = 0;
+	virtual np::NP_ErrorCode setHSLed(int slotID, int portID, bool enable) = 0;
+	virtual np::NP_ErrorCode getHSVersion(int slotID, int portID, uint8_t* version_major, uint8_t* version_minor) = 0;
+	virtual np::NP_ErrorCode readHSSN(int slotID, int portID, uint64_t* sn) = 0;
+	virtual np::NP_ErrorCode readHSPN(int slotID, int portID, char* pn, size_t maxlen) = 0;
+	virtual np::NP_ErrorCode getFlexVersion(int slotID, int portID, int dockID, unsigned char* version_major, unsigned char* version_minor) = 0;
+	virtual np::NP_ErrorCode readFlexPN(int slotID, int portID, int dockID, char* pn, size_t maxlen) = 0;
+
+	/* Probe */
+	virtual np::NP_ErrorCode openProbe(int slotID, int portID, int dockID) = 0;
+	virtual np::NP_ErrorCode init(int slotID, int portID, int dockID) = 0;
+	virtual np::NP_ErrorCode readProbeSN(int slotID, int portID, int dockID, uint64_t* id) = 0;
+	virtual np::NP_ErrorCode readProbePN(int slotID, int portID, int dockID, char* pn, size_t maxlen) = 0;
+	virtual np::NP_ErrorCode setOPMODE(int slotID, int portID, int dockID, np::probe_opmode_t mode) = 0;
+	virtual np::NP_ErrorCode selectElectrode(int slotID, int portID, int dockID, int channel, int shank, int bank) = 0;
+	virtual np::NP_ErrorCode setReference(int slotID, int portID, int dockID, int channel, int shank, np::channelreference_t reference, int intRefElectrodeBank) = 0;
+	virtual np::NP_ErrorCode setAPCornerFrequency(int slotID, int portID, int dockID, int channel, bool disableHighPass) = 0;
+	virtual np::NP_ErrorCode setStdb(int slotID, int portID, int dockID, int channel, bool standby) = 0;
+	virtual np::NP_ErrorCode writeProbeConfiguration(int slotID, int portID, int dockID, bool readCheck) = 0;
+
+	/* Data */
+	virtual np::NP_ErrorCode readPacket(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t requestedChannelCount, size_t* actualread) = 0;
+	virtual np::NP_ErrorCode readPackets(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t channelcount, size_t packetcount, size_t* packetsread) = 0;
+	virtual np::NP_ErrorCode getPacketFifoStatus(int slotID, int portID, int dockID, np::streamsource_t source, size_t* packetsavailable, size_t* headroom) = 0;
+	virtual np::NP_ErrorCode createProbePacketCallback(int slotID, int portID, int dockID, np::streamsource_t source, np::npcallbackhandle_t* handle, np::np_packetcallbackfn_t callback, const void* userdata) = 0;
+	virtual np::NP_ErrorCode destroyPacketCallback(np::npcallbackhandle_t* handle) = 0;
+	virtual np::NP_ErrorCode unpackData(const np::np_packet_t* packet, int16_t* output, size_t samplestoread, size_t* actualread) = 0;
+
+	/* Built-in self tests */
+	virtual np::NP_ErrorCode bistBS(int slotID) = 0;
+	virtual np::NP_ErrorCode bistHB(int slotID, int portID, int dockID) = 0;
+	virtual np::NP_ErrorCode bistStartPRBS(int slotID, int portID) = 0;
+	virtual np::NP_ErrorCode bistStopPRBS(int slotID, int portID, int* prbs_err) = 0;
+	virtual np::NP_ErrorCode bistI2CMM(int slotID, int portID, int dockID) = 0;
+	virtual np::NP_ErrorCode bistEEPROM(int slotID, int portID) = 0;
+	virtual np::NP_ErrorCode bistSR(int slotID, int portID, int dockID) = 0;
+	virtual np::NP_ErrorCode bistPSB(int slotID, int portID, int dockID) = 0;
+	virtual np::NP_ErrorCode bistNoise(int slotID, int portID, int dockID) = 0;
+
+	/* Debug statistics */
+	virtual np::NP_ErrorCode dbg_diagstats_read(int slotID, np::np_diagstats* stats) = 0;
+	virtual np::NP_ErrorCode dbg_sourcestats_read(int slotID, uint8_t sourceID, np::np_sourcestats* stats) = 0;
+};
+
+/** Forwards every call to the linked np:: library. */
+class NativeBackend : public NPX2Backend
+{
+public:
+	String getName() const override { return "native"; }
+
+	/* System */
+	void getAPIVersion(uint8_t* version_major, uint8_t* version_minor) override;
+	np::NP_ErrorCode getAvailableSlots(uint32_t* slotmask) override;
+	np::NP_ErrorCode setParameter(np::np_parameter_t paramid, int value) override;
+
+	/* Basestation */
+	np::NP_ErrorCode openBS(int slotID) override;
+	np::NP_ErrorCode closeBS(int slotID) override;
+	np::NP_ErrorCode arm(int slotID) override;
+	np::NP_ErrorCode setSWTrigger(int slotID) override;
+	np::NP_ErrorCode setTriggerEdge(int slotID, bool rising) override;
+	np::NP_ErrorCode setTriggerBinding(int slotID, np::signalline_t outputlines, np::signalline_t inputlines) override;
+	np::NP_ErrorCode enableFileStream(int slotID, bool enable) override;
+	np::NP_ErrorCode setFileStream(int slotID, const char* filename) override;
+	np::NP_ErrorCode getBSBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build) override;
+	np::NP_ErrorCode getBSCBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build) override;
+	np::NP_ErrorCode getBSCVersion(int slotID, uint8_t* version_major, uint8_t* version_minor) override;
+	np::NP_ErrorCode readBSCSN(int slotID, uint64_t* sn) override;
+	np::NP_ErrorCode readBSCPN(int slotID, char* pn, size_t len) override;
+
+	/* Headstage and flex */
+	np::NP_ErrorCode closePort(int slotID, int portID) override;
+	np::NP_ErrorCode setHSLed(int slotID, int portID, bool enable) override;
+	np::NP_ErrorCode getHSVersion(int slotID, int portID, uint8_t* version_major, uint8_t* version_minor) override;
+	np::NP_ErrorCode readHSSN(int slotID, int portID, uint64_t* sn) override;
+	np::NP_ErrorCode readHSPN(int slotID, int portID, char* pn, size_t maxlen) override;
+	np::NP_ErrorCode getFlexVersion(int slotID, int portID, int dockID, unsigned char* version_major, unsigned char* version_minor) override;
+	np::NP_ErrorCode readFlexPN(int slotID, int portID, int dockID, char* pn, size_t maxlen) override;
+
+	/* Probe */
+	np::NP_ErrorCode openProbe(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode init(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode readProbeSN(int slotID, int portID, int dockID, uint64_t* id) override;
+	np::NP_ErrorCode readProbePN(int slotID, int portID, int dockID, char* pn, size_t maxlen) override;
+	np::NP_ErrorCode setOPMODE(int slotID, int portID, int dockID, np::probe_opmode_t mode) override;
+	np::NP_ErrorCode selectElectrode(int slotID, int portID, int dockID, int channel, int shank, int bank) override;
+	np::NP_ErrorCode setReference(int slotID, int portID, int dockID, int channel, int shank, np::channelreference_t reference, int intRefElectrodeBank) override;
+	np::NP_ErrorCode setAPCornerFrequency(int slotID, int portID, int dockID, int channel, bool disableHighPass) override;
+	np::NP_ErrorCode setStdb(int slotID, int portID, int dockID, int channel, bool standby) override;
+	np::NP_ErrorCode writeProbeConfiguration(int slotID, int portID, int dockID, bool readCheck) override;
+
+	/* Data */
+	np::NP_ErrorCode readPacket(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t requestedChannelCount, size_t* actualread) override;
+	np::NP_ErrorCode readPackets(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t channelcount, size_t packetcount, size_t* packetsread) override;
+	np::NP_ErrorCode getPacketFifoStatus(int slotID, int portID, int dockID, np::streamsource_t source, size_t* packetsavailable, size_t* headroom) override;
+	np::NP_ErrorCode createProbePacketCallback(int slotID, int portID, int dockID, np::streamsource_t source, np::npcallbackhandle_t* handle, np::np_packetcallbackfn_t callback, const void* userdata) override;
+	np::NP_ErrorCode destroyPacketCallback(np::npcallbackhandle_t* handle) override;
+	np::NP_ErrorCode unpackData(const np::np_packet_t* packet, int16_t* output, size_t samplestoread, size_t* actualread) override;
+
+	/* Built-in self tests */
+	np::NP_ErrorCode bistBS(int slotID) override;
+	np::NP_ErrorCode bistHB(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistStartPRBS(int slotID, int portID) override;
+	np::NP_ErrorCode bistStopPRBS(int slotID, int portID, int* prbs_err) override;
+	np::NP_ErrorCode bistI2CMM(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistEEPROM(int slotID, int portID) override;
+	np::NP_ErrorCode bistSR(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistPSB(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistNoise(int slotID, int portID, int dockID) override;
+
+	/* Debug statistics */
+	np::NP_ErrorCode dbg_diagstats_read(int slotID, np::np_diagstats* stats) override;
+	np::NP_ErrorCode dbg_sourcestats_read(int slotID, uint8_t sourceID, np::np_sourcestats* stats) override;
+};
+
+#endif  // __NPX2BACKEND_H__
@@ -0,0 +1,1179 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "NPX2BackendTrace.h"
+
+#include <cstring>
+
+/** Largest number of 16 bit samples carried by one callback packet. */
+#define TRACE_PACKET_SAMPLES (NP_MAXPAYLOADSIZE / sizeof(int16_t))
+
+/* ----------------------------------------------------------------------- */
+/* RecordingBackend                                                         */
+/* ----------------------------------------------------------------------- */
+
+/** Collects one call's arguments and outputs; the record is written when the Call goes out of scope. */
+class RecordingBackend::Call
+{
+public:
+	Call(RecordingBackend& owner_, BackendCall call, int a0 = 0, int a1 = 0, int a2 = 0, int a3 = 0, int a4 = 0, int a5 = 0)
+		: owner(owner_)
+	{
+		memset(&header, 0, sizeof(header));
+
+		const int32 args[TRACE_MAX_ARGS] = { a0, a1, a2, a3, a4, a5 };
+
+		header.call = uint16(call);
+		memcpy(header.args, args, sizeof(args));
+		header.startMicros = owner.getMicros();
+	}
+
+	~Call()
+	{
+		header.payloadSize = uint32(payload.getSize());
+		owner.write(header, payload);
+	}
+
+	np::NP_ErrorCode finish(np::NP_ErrorCode result)
+	{
+		header.durationMicros = uint32(owner.getMicros() - header.startMicros);
+		header.result = int16(result);
+		return result;
+	}
+
+	void output(const void* source, size_t size)
+	{
+		uint32 chunkSize = source != nullptr ? uint32(size) : 0;
+
+		payload.append(&chunkSize, sizeof(chunkSize));
+
+		if (chunkSize > 0)
+			payload.append(source, chunkSize);
+	}
+
+private:
+	RecordingBackend& owner;
+	TraceRecordHeader header;
+	MemoryBlock payload;
+};
+
+struct RecordingBackend::CallbackTap
+{
+	RecordingBackend* owner;
+	np::np_packetcallbackfn_t callback;
+	const void* userdata;
+	int args[4];
+};
+
+RecordingBackend::RecordingBackend(NPX2Backend* inner_, const File& file)
+	: inner(inner_), startTicks(Time::getHighResolutionTicks()), numRecords(0)
+{
+	file.deleteFile();
+
+	stream = new FileOutputStream(file, 1 << 20);
+
+	if (stream->failedToOpen())
+	{
+		std::cout << "Could not open trace file " << file.getFullPathName() << std::endl;
+		stream = nullptr;
+		return;
+	}
+
+	uint32 version = TRACE_VERSION;
+
+	stream->write(TRACE_MAGIC, 8);
+	stream->write(&version, sizeof(version));
+
+	std::cout << "Recording hardware calls to " << file.getFullPathName() << std::endl;
+}
+
+RecordingBackend::~RecordingBackend()
+{
+	if (stream != nullptr)
+		stream->flush();
+}
+
+int64 RecordingBackend::getNumRecords() const
+{
+	const ScopedLock lock(writeLock);
+	return numRecords;
+}
+
+uint64 RecordingBackend::getMicros() const
+{
+	return uint64(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks) * 1e6);
+}
+
+void RecordingBackend::write(const TraceRecordHeader& header, const MemoryBlock& payload)
+{
+	const ScopedLock lock(writeLock);
+
+	if (stream == nullptr)
+		return;
+
+	stream->write(&header, sizeof(header));
+	stream->write(payload.getData(), payload.getSize());
+
+	numRecords++;
+}
+
+void NP_APIC RecordingBackend::tapCallback(const np::np_packet_t& packet, const void* userdata)
+{
+	const CallbackTap* tap = static_cast<const CallbackTap*>(userdata);
+
+	{
+		Call call(*tap->owner, CALL_PACKET, tap->args[0], tap->args[1], tap->args[2], tap->args[3]);
+
+		// Store the packet unpacked, so replay does not depend on the vendor's payload format
+		np::np_packet_t unpacked;
+		size_t samples = 0;
+
+		unpacked.hdr = packet.hdr;
+
+		call.finish(tap->owner->inner->unpackData(&packet, (int16_t*)unpacked.payload, TRACE_PACKET_SAMPLES, &samples));
+
+		unpacked.hdr.samplecount = uint16(samples);
+
+		call.output(&unpacked, sizeof(unpacked.hdr) + samples * sizeof(int16_t));
+	}
+
+	tap->callback(packet, tap->userdata);
+}
+
+np::NP_ErrorCode RecordingBackend::readPacket(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t requestedChannelCount, size_t* actualread)
+{
+	Call call(*this, CALL_READ_PACKET, slotID, portID, dockID, int(source), int(requestedChannelCount));
+	np::NP_ErrorCode result = call.finish(inner->readPacket(slotID, portID, dockID, source, pckinfo, data, requestedChannelCount, actualread));
+
+	size_t channels = result == np::SUCCESS && actualread != nullptr ? *actualread : 0;
+
+	call.output(pckinfo, channels > 0 ? sizeof(*pckinfo) : 0);
+	call.output(data, channels * sizeof(int16_t));
+	call.output(actualread, sizeof(*actualread));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::readPackets(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t channelcount, size_t packetcount, size_t* packetsread)
+{
+	Call call(*this, CALL_READ_PACKETS, slotID, portID, dockID, int(source), int(channelcount), int(packetcount));
+	np::NP_ErrorCode result = call.finish(inner->readPackets(slotID, portID, dockID, source, pckinfo, data, channelcount, packetcount, packetsread));
+
+	size_t count = result == np::SUCCESS && packetsread != nullptr ? *packetsread : 0;
+
+	call.output(pckinfo, count * sizeof(*pckinfo));
+	call.output(data, count * channelcount * sizeof(int16_t));
+	call.output(packetsread, sizeof(*packetsread));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::createProbePacketCallback(int slotID, int portID, int dockID, np::streamsource_t source, np::npcallbackhandle_t* handle, np::np_packetcallbackfn_t callback, const void* userdata)
+{
+	CallbackTap* tap = new CallbackTap();
+
+	tap->owner = this;
+	tap->callback = callback;
+	tap->userdata = userdata;
+	tap->args[0] = slotID;
+	tap->args[1] = portID;
+	tap->args[2] = dockID;
+	tap->args[3] = int(source);
+
+	{
+		const ScopedLock lock(tapLock);
+		taps.add(tap);
+	}
+
+	Call call(*this, CALL_CREATE_PROBE_PACKET_CALLBACK, slotID, portID, dockID, int(source));
+	return call.finish(inner->createProbePacketCallback(slotID, portID, dockID, source, handle, tapCallback, tap));
+}
+
+np::NP_ErrorCode RecordingBackend::destroyPacketCallback(np::npcallbackhandle_t* handle)
+{
+	Call call(*this, CALL_DESTROY_PACKET_CALLBACK);
+	return call.finish(inner->destroyPacketCallback(handle));
+}
+
+np::NP_ErrorCode RecordingBackend::unpackData(const np::np_packet_t* packet, int16_t* output, size_t samplestoread, size_t* actualread)
+{
+	// Pure function of the packet; captured as part of CALL_PACKET instead
+	return inner->unpackData(packet, output, samplestoread, actualread);
+}
+
+void RecordingBackend::getAPIVersion(uint8_t* version_major, uint8_t* version_minor)
+{
+	Call call(*this, CALL_GET_API_VERSION);
+	inner->getAPIVersion(version_major, version_minor);
+	call.finish(np::SUCCESS);
+	call.output(version_major, sizeof(*version_major));
+	call.output(version_minor, sizeof(*version_minor));
+}
+
+np::NP_ErrorCode RecordingBackend::getAvailableSlots(uint32_t* slotmask)
+{
+	Call call(*this, CALL_GET_AVAILABLE_SLOTS);
+	np::NP_ErrorCode result = call.finish(inner->getAvailableSlots(slotmask));
+	call.output(slotmask, sizeof(*slotmask));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setParameter(np::np_parameter_t paramid, int value)
+{
+	Call call(*this, CALL_SET_PARAMETER, int(paramid), value);
+	np::NP_ErrorCode result = call.finish(inner->setParameter(paramid, value));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::openBS(int slotID)
+{
+	Call call(*this, CALL_OPEN_BS, slotID);
+	np::NP_ErrorCode result = call.finish(inner->openBS(slotID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::closeBS(int slotID)
+{
+	Call call(*this, CALL_CLOSE_BS, slotID);
+	np::NP_ErrorCode result = call.finish(inner->closeBS(slotID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::arm(int slotID)
+{
+	Call call(*this, CALL_ARM, slotID);
+	np::NP_ErrorCode result = call.finish(inner->arm(slotID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setSWTrigger(int slotID)
+{
+	Call call(*this, CALL_SET_SW_TRIGGER, slotID);
+	np::NP_ErrorCode result = call.finish(inner->setSWTrigger(slotID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setTriggerEdge(int slotID, bool rising)
+{
+	Call call(*this, CALL_SET_TRIGGER_EDGE, slotID, int(rising));
+	np::NP_ErrorCode result = call.finish(inner->setTriggerEdge(slotID, rising));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setTriggerBinding(int slotID, np::signalline_t outputlines, np::signalline_t inputlines)
+{
+	Call call(*this, CALL_SET_TRIGGER_BINDING, slotID, int(outputlines), int(inputlines));
+	np::NP_ErrorCode result = call.finish(inner->setTriggerBinding(slotID, outputlines, inputlines));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::enableFileStream(int slotID, bool enable)
+{
+	Call call(*this, CALL_ENABLE_FILE_STREAM, slotID, int(enable));
+	np::NP_ErrorCode result = call.finish(inner->enableFileStream(slotID, enable));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setFileStream(int slotID, const char* filename)
+{
+	Call call(*this, CALL_SET_FILE_STREAM, slotID);
+	np::NP_ErrorCode result = call.finish(inner->setFileStream(slotID, filename));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::getBSBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build)
+{
+	Call call(*this, CALL_GET_BS_BOOT_VERSION, slotID);
+	np::NP_ErrorCode result = call.finish(inner->getBSBootVersion(slotID, version_major, version_minor, version_build));
+	call.output(version_major, sizeof(*version_major));
+	call.output(version_minor, sizeof(*version_minor));
+	call.output(version_build, version_build != nullptr ? sizeof(*version_build) : 0);
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::getBSCBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build)
+{
+	Call call(*this, CALL_GET_BSC_BOOT_VERSION, slotID);
+	np::NP_ErrorCode result = call.finish(inner->getBSCBootVersion(slotID, version_major, version_minor, version_build));
+	call.output(version_major, sizeof(*version_major));
+	call.output(version_minor, sizeof(*version_minor));
+	call.output(version_build, version_build != nullptr ? sizeof(*version_build) : 0);
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::getBSCVersion(int slotID, uint8_t* version_major, uint8_t* version_minor)
+{
+	Call call(*this, CALL_GET_BSC_VERSION, slotID);
+	np::NP_ErrorCode result = call.finish(inner->getBSCVersion(slotID, version_major, version_minor));
+	call.output(version_major, sizeof(*version_major));
+	call.output(version_minor, sizeof(*version_minor));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::readBSCSN(int slotID, uint64_t* sn)
+{
+	Call call(*this, CALL_READ_BSC_SN, slotID);
+	np::NP_ErrorCode result = call.finish(inner->readBSCSN(slotID, sn));
+	call.output(sn, sizeof(*sn));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::readBSCPN(int slotID, char* pn, size_t len)
+{
+	Call call(*this, CALL_READ_BSC_PN, slotID, int(len));
+	np::NP_ErrorCode result = call.finish(inner->readBSCPN(slotID, pn, len));
+	call.output(pn, pn != nullptr ? strnlen(pn, len) : 0);
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::closePort(int slotID, int portID)
+{
+	Call call(*this, CALL_CLOSE_PORT, slotID, portID);
+	np::NP_ErrorCode result = call.finish(inner->closePort(slotID, portID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setHSLed(int slotID, int portID, bool enable)
+{
+	Call call(*this, CALL_SET_HS_LED, slotID, portID, int(enable));
+	np::NP_ErrorCode result = call.finish(inner->setHSLed(slotID, portID, enable));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::getHSVersion(int slotID, int portID, uint8_t* version_major, uint8_t* version_minor)
+{
+	Call call(*this, CALL_GET_HS_VERSION, slotID, portID);
+	np::NP_ErrorCode result = call.finish(inner->getHSVersion(slotID, portID, version_major, version_minor));
+	call.output(version_major, sizeof(*version_major));
+	call.output(version_minor, sizeof(*version_minor));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::readHSSN(int slotID, int portID, uint64_t* sn)
+{
+	Call call(*this, CALL_READ_HS_SN, slotID, portID);
+	np::NP_ErrorCode result = call.finish(inner->readHSSN(slotID, portID, sn));
+	call.output(sn, sizeof(*sn));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::readHSPN(int slotID, int portID, char* pn, size_t maxlen)
+{
+	Call call(*this, CALL_READ_HS_PN, slotID, portID, int(maxlen));
+	np::NP_ErrorCode result = call.finish(inner->readHSPN(slotID, portID, pn, maxlen));
+	call.output(pn, pn != nullptr ? strnlen(pn, maxlen) : 0);
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::getFlexVersion(int slotID, int portID, int dockID, unsigned char* version_major, unsigned char* version_minor)
+{
+	Call call(*this, CALL_GET_FLEX_VERSION, slotID, portID, dockID);
+	np::NP_ErrorCode result = call.finish(inner->getFlexVersion(slotID, portID, dockID, version_major, version_minor));
+	call.output(version_major, sizeof(*version_major));
+	call.output(version_minor, sizeof(*version_minor));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::readFlexPN(int slotID, int portID, int dockID, char* pn, size_t maxlen)
+{
+	Call call(*this, CALL_READ_FLEX_PN, slotID, portID, dockID, int(maxlen));
+	np::NP_ErrorCode result = call.finish(inner->readFlexPN(slotID, portID, dockID, pn, maxlen));
+	call.output(pn, pn != nullptr ? strnlen(pn, maxlen) : 0);
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::openProbe(int slotID, int portID, int dockID)
+{
+	Call call(*this, CALL_OPEN_PROBE, slotID, portID, dockID);
+	np::NP_ErrorCode result = call.finish(inner->openProbe(slotID, portID, dockID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::init(int slotID, int portID, int dockID)
+{
+	Call call(*this, CALL_INIT, slotID, portID, dockID);
+	np::NP_ErrorCode result = call.finish(inner->init(slotID, portID, dockID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::readProbeSN(int slotID, int portID, int dockID, uint64_t* id)
+{
+	Call call(*this, CALL_READ_PROBE_SN, slotID, portID, dockID);
+	np::NP_ErrorCode result = call.finish(inner->readProbeSN(slotID, portID, dockID, id));
+	call.output(id, sizeof(*id));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::readProbePN(int slotID, int portID, int dockID, char* pn, size_t maxlen)
+{
+	Call call(*this, CALL_READ_PROBE_PN, slotID, portID, dockID, int(maxlen));
+	np::NP_ErrorCode result = call.finish(inner->readProbePN(slotID, portID, dockID, pn, maxlen));
+	call.output(pn, pn != nullptr ? strnlen(pn, maxlen) : 0);
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setOPMODE(int slotID, int portID, int dockID, np::probe_opmode_t mode)
+{
+	Call call(*this, CALL_SET_OPMODE, slotID, portID, dockID, int(mode));
+	np::NP_ErrorCode result = call.finish(inner->setOPMODE(slotID, portID, dockID, mode));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::selectElectrode(int slotID, int portID, int dockID, int channel, int shank, int bank)
+{
+	Call call(*this, CALL_SELECT_ELECTRODE, slotID, portID, dockID, channel, shank, bank);
+	np::NP_ErrorCode result = call.finish(inner->selectElectrode(slotID, portID, dockID, channel, shank, bank));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setReference(int slotID, int portID, int dockID, int channel, int shank, np::channelreference_t reference, int intRefElectrodeBank)
+{
+	Call call(*this, CALL_SET_REFERENCE, slotID, portID, dockID, channel, shank, int(reference));
+	np::NP_ErrorCode result = call.finish(inner->setReference(slotID, portID, dockID, channel, shank, reference, intRefElectrodeBank));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setAPCornerFrequency(int slotID, int portID, int dockID, int channel, bool disableHighPass)
+{
+	Call call(*this, CALL_SET_AP_CORNER_FREQUENCY, slotID, portID, dockID, channel, int(disableHighPass));
+	np::NP_ErrorCode result = call.finish(inner->setAPCornerFrequency(slotID, portID, dockID, channel, disableHighPass));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::setStdb(int slotID, int portID, int dockID, int channel, bool standby)
+{
+	Call call(*this, CALL_SET_STDB, slotID, portID, dockID, channel, int(standby));
+	np::NP_ErrorCode result = call.finish(inner->setStdb(slotID, portID, dockID, channel, standby));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::writeProbeConfiguration(int slotID, int portID, int dockID, bool readCheck)
+{
+	Call call(*this, CALL_WRITE_PROBE_CONFIGURATION, slotID, portID, dockID, int(readCheck));
+	np::NP_ErrorCode result = call.finish(inner->writeProbeConfiguration(slotID, portID, dockID, readCheck));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::getPacketFifoStatus(int slotID, int portID, int dockID, np::streamsource_t source, size_t* packetsavailable, size_t* headroom)
+{
+	Call call(*this, CALL_GET_PACKET_FIFO_STATUS, slotID, portID, dockID, int(source));
+	np::NP_ErrorCode result = call.finish(inner->getPacketFifoStatus(slotID, portID, dockID, source, packetsavailable, headroom));
+	call.output(packetsavailable, sizeof(*packetsavailable));
+	call.output(headroom, sizeof(*headroom));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::bistBS(int slotID)
+{
+	Call call(*this, CALL_BIST_BS, slotID);
+	np::NP_ErrorCode result = call.finish(inner->bistBS(slotID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::bistHB(int slotID, int portID, int dockID)
+{
+	Call call(*this, CALL_BIST_HB, slotID, portID, dockID);
+	np::NP_ErrorCode result = call.finish(inner->bistHB(slotID, portID, dockID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::bistStartPRBS(int slotID, int portID)
+{
+	Call call(*this, CALL_BIST_START_PRBS, slotID, portID);
+	np::NP_ErrorCode result = call.finish(inner->bistStartPRBS(slotID, portID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::bistStopPRBS(int slotID, int portID, int* prbs_err)
+{
+	Call call(*this, CALL_BIST_STOP_PRBS, slotID, portID);
+	np::NP_ErrorCode result = call.finish(inner->bistStopPRBS(slotID, portID, prbs_err));
+	call.output(prbs_err, sizeof(*prbs_err));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::bistI2CMM(int slotID, int portID, int dockID)
+{
+	Call call(*this, CALL_BIST_I2CMM, slotID, portID, dockID);
+	np::NP_ErrorCode result = call.finish(inner->bistI2CMM(slotID, portID, dockID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::bistEEPROM(int slotID, int portID)
+{
+	Call call(*this, CALL_BIST_EEPROM, slotID, portID);
+	np::NP_ErrorCode result = call.finish(inner->bistEEPROM(slotID, portID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::bistSR(int slotID, int portID, int dockID)
+{
+	Call call(*this, CALL_BIST_SR, slotID, portID, dockID);
+	np::NP_ErrorCode result = call.finish(inner->bistSR(slotID, portID, dockID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::bistPSB(int slotID, int portID, int dockID)
+{
+	Call call(*this, CALL_BIST_PSB, slotID, portID, dockID);
+	np::NP_ErrorCode result = call.finish(inner->bistPSB(slotID, portID, dockID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::bistNoise(int slotID, int portID, int dockID)
+{
+	Call call(*this, CALL_BIST_NOISE, slotID, portID, dockID);
+	np::NP_ErrorCode result = call.finish(inner->bistNoise(slotID, portID, dockID));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::dbg_diagstats_read(int slotID, np::np_diagstats* stats)
+{
+	Call call(*this, CALL_DBG_DIAGSTATS_READ, slotID);
+	np::NP_ErrorCode result = call.finish(inner->dbg_diagstats_read(slotID, stats));
+	call.output(stats, sizeof(*stats));
+	return result;
+}
+
+np::NP_ErrorCode RecordingBackend::dbg_sourcestats_read(int slotID, uint8_t sourceID, np::np_sourcestats* stats)
+{
+	Call call(*this, CALL_DBG_SOURCESTATS_READ, slotID, sourceID);
+	np::NP_ErrorCode result = call.finish(inner->dbg_sourcestats_read(slotID, sourceID, stats));
+	call.output(stats, sizeof(*stats));
+	return result;
+}
+
+/* ----------------------------------------------------------------------- */
+/* ReplayBackend                                                            */
+/* ----------------------------------------------------------------------- */
+
+/** Takes the next record matching a call and hands out its outputs in order. */
+class ReplayBackend::Reply
+{
+public:
+	Reply(ReplayBackend& owner_, BackendCall call, int a0 = 0, int a1 = 0, int a2 = 0, int a3 = 0, int a4 = 0, int a5 = 0)
+		: owner(owner_), record(nullptr), position(0), end(0)
+	{
+		const int32 args[TRACE_MAX_ARGS] = { a0, a1, a2, a3, a4, a5 };
+
+		record = owner.next(makeKey(call, args));
+
+		if (record == nullptr)
+		{
+			owner.misses++;
+			return;
+		}
+
+		owner.waitFor(*record);
+
+		position = record->payloadOffset;
+		end = position + record->header.payloadSize;
+	}
+
+	Reply(ReplayBackend& owner_, const Record* record_)
+		: owner(owner_), record(record_), position(record_->payloadOffset), end(record_->payloadOffset + record_->header.payloadSize)
+	{
+	}
+
+	bool found() const { return record != nullptr; }
+
+	/** Copies the next recorded output, truncated to capacity; returns its recorded size. */
+	size_t output(void* destination, size_t capacity)
+	{
+		if (record == nullptr || position + sizeof(uint32) > end)
+			return 0;
+
+		const char* bytes = static_cast<const char*>(owner.data.getData());
+		uint32 size;
+
+		memcpy(&size, bytes + position, sizeof(size));
+		position += sizeof(size);
+
+		size = uint32(jmin(size_t(size), end - position));
+
+		if (destination != nullptr)
+			memcpy(destination, bytes + position, jmin(size_t(size), capacity));
+
+		position += size;
+		return size;
+	}
+
+	/** Like output, but always leaves a null-terminated string in a buffer of capacity bytes. */
+	void outputString(char* destination, size_t capacity)
+	{
+		if (destination == nullptr || capacity == 0)
+		{
+			output(nullptr, 0);
+			return;
+		}
+
+		size_t length = jmin(output(destination, capacity - 1), capacity - 1);
+		destination[length] = 0;
+	}
+
+	np::NP_ErrorCode result(np::NP_ErrorCode missing = np::NOTSUPPORTED) const
+	{
+		return record != nullptr ? np::NP_ErrorCode(record->header.result) : missing;
+	}
+
+private:
+	ReplayBackend& owner;
+	const Record* record;
+	size_t position;
+	size_t end;
+};
+
+/** Delivers the recorded packets of one stream to a registered callback. */
+class ReplayBackend::CallbackPlayer : public Thread
+{
+public:
+	CallbackPlayer(ReplayBackend& owner_, const Key& key_, np::np_packetcallbackfn_t callback_, const void* userdata_)
+		: Thread("NPX2 Replay Callback"), owner(owner_), key(key_), callback(callback_), userdata(userdata_)
+	{
+	}
+
+	~CallbackPlayer()
+	{
+		stopThread(1000);
+	}
+
+	void run() override
+	{
+		np::np_packet_t packet;
+
+		while (!threadShouldExit())
+		{
+			const Record* record = owner.next(key);
+
+			if (record == nullptr)
+				return; // End of the trace for this stream
+
+			int64 micros;
+
+			while ((micros = owner.getMicrosUntilDue(*record)) > 0 && !threadShouldExit())
+				wait(int(jmax(int64(1), micros / 1000)));
+
+			memset(&packet.hdr, 0, sizeof(packet.hdr));
+
+			Reply reply(owner, record);
+			reply.output(&packet, sizeof(packet));
+
+			callback(packet, userdata);
+		}
+	}
+
+private:
+	ReplayBackend& owner;
+	const Key key;
+	np::np_packetcallbackfn_t callback;
+	const void* userdata;
+};
+
+ReplayBackend::ReplayBackend(const File& file, bool realTime_)
+	: valid(false), realTime(realTime_), startTicks(0), started(false), misses(0)
+{
+	if (!file.loadFileAsData(data) || data.getSize() < 8 + sizeof(uint32))
+	{
+		std::cout << "Could not read trace file " << file.getFullPathName() << std::endl;
+		return;
+	}
+
+	const char* bytes = static_cast<const char*>(data.getData());
+	uint32 version;
+
+	memcpy(&version, bytes + 8, sizeof(version));
+
+	if (memcmp(bytes, TRACE_MAGIC, 8) != 0 || version != TRACE_VERSION)
+	{
+		std::cout << file.getFullPathName() << " is not an NPX2 trace" << std::endl;
+		return;
+	}
+
+	size_t position = 8 + sizeof(uint32);
+
+	while (position + sizeof(TraceRecordHeader) <= data.getSize())
+	{
+		Record record;
+
+		memcpy(&record.header, bytes + position, sizeof(record.header));
+		record.payloadOffset = position + sizeof(record.header);
+
+		if (record.payloadOffset + record.header.payloadSize > data.getSize())
+			break; // Truncated last record
+
+		queues[makeKey(record.header.call, record.header.args)].push_back(records.size());
+		records.add(record);
+
+		position = record.payloadOffset + record.header.payloadSize;
+	}
+
+	valid = true;
+
+	std::cout << "Replaying " << records.size() << " hardware calls from " << file.getFullPathName() << std::endl;
+}
+
+ReplayBackend::~ReplayBackend()
+{
+	players.clear();
+}
+
+ReplayBackend::Key ReplayBackend::makeKey(int call, const int32* args)
+{
+	Key key;
+
+	key.call = call;
+
+	for (int i = 0; i < 4; i++)
+		key.args[i] = args[i];
+
+	return key;
+}
+
+const ReplayBackend::Record* ReplayBackend::next(const Key& key)
+{
+	const ScopedLock lock(queueLock);
+
+	if (!started)
+	{
+		startTicks = Time::getHighResolutionTicks();
+		started = true;
+	}
+
+	auto queue = queues.find(key);
+
+	if (queue == queues.end() || queue->second.empty())
+		return nullptr;
+
+	int index = queue->second.front();
+	queue->second.pop_front();
+
+	return &records.getReference(index);
+}
+
+int64 ReplayBackend::getMicrosUntilDue(const Record& record)
+{
+	if (!realTime)
+		return 0;
+
+	int64 due = int64(record.header.startMicros + record.header.durationMicros);
+	int64 elapsed = int64(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks) * 1e6);
+
+	return jmax(int64(0), due - elapsed);
+}
+
+void ReplayBackend::waitFor(const Record& record)
+{
+	int64 micros;
+
+	while ((micros = getMicrosUntilDue(record)) > 0)
+	{
+		if (micros >= 1000)
+			Thread::sleep(int(micros / 1000));
+		else
+			Thread::yield();
+	}
+}
+
+np::NP_ErrorCode ReplayBackend::readPacket(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t requestedChannelCount, size_t* actualread)
+{
+	Reply reply(*this, CALL_READ_PACKET, slotID, portID, dockID, int(source), int(requestedChannelCount));
+
+	if (actualread != nullptr)
+		*actualread = 0;
+
+	reply.output(pckinfo, sizeof(*pckinfo));
+	reply.output(data, requestedChannelCount * sizeof(int16_t));
+	reply.output(actualread, sizeof(*actualread));
+
+	if (actualread != nullptr)
+		*actualread = jmin(*actualread, requestedChannelCount);
+
+	// Past the end of the trace the stream simply has no more data
+	return reply.result(np::SUCCESS);
+}
+
+np::NP_ErrorCode ReplayBackend::readPackets(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t channelcount, size_t packetcount, size_t* packetsread)
+{
+	Reply reply(*this, CALL_READ_PACKETS, slotID, portID, dockID, int(source), int(channelcount), int(packetcount));
+
+	if (packetsread != nullptr)
+		*packetsread = 0;
+
+	// Packets beyond packetcount are dropped; replay with the batch size of the capture
+	reply.output(pckinfo, packetcount * sizeof(*pckinfo));
+	reply.output(data, packetcount * channelcount * sizeof(int16_t));
+	reply.output(packetsread, sizeof(*packetsread));
+
+	if (packetsread != nullptr)
+		*packetsread = jmin(*packetsread, packetcount);
+
+	return reply.result(np::SUCCESS);
+}
+
+np::NP_ErrorCode ReplayBackend::createProbePacketCallback(int slotID, int portID, int dockID, np::streamsource_t source, np::npcallbackhandle_t* handle, np::np_packetcallbackfn_t callback, const void* userdata)
+{
+	Reply reply(*this, CALL_CREATE_PROBE_PACKET_CALLBACK, slotID, portID, dockID, int(source));
+
+	if (reply.result() != np::SUCCESS)
+		return reply.result();
+
+	const int32 args[TRACE_MAX_ARGS] = { slotID, portID, dockID, int(source), 0, 0 };
+
+	CallbackPlayer* player = new CallbackPlayer(*this, makeKey(CALL_PACKET, args), callback, userdata);
+
+	{
+		const ScopedLock lock(playerLock);
+		players.add(player);
+	}
+
+	*handle = player;
+	player->startThread();
+
+	return np::SUCCESS;
+}
+
+np::NP_ErrorCode ReplayBackend::destroyPacketCallback(np::npcallbackhandle_t* handle)
+{
+	Reply reply(*this, CALL_DESTROY_PACKET_CALLBACK);
+
+	if (handle != nullptr && *handle != nullptr)
+	{
+		CallbackPlayer* player = static_cast<CallbackPlayer*>(*handle);
+
+		player->stopThread(1000);
+
+		const ScopedLock lock(playerLock);
+		players.removeObject(player);
+
+		*handle = nullptr;
+	}
+
+	return reply.result(np::SUCCESS);
+}
+
+np::NP_ErrorCode ReplayBackend::unpackData(const np::np_packet_t* packet, int16_t* output, size_t samplestoread, size_t* actualread)
+{
+	// Replayed packets carry the samples already unpacked
+	size_t count = jmin(samplestoread, size_t(packet->hdr.samplecount), TRACE_PACKET_SAMPLES);
+
+	memcpy(output, packet->payload, count * sizeof(int16_t));
+
+	if (actualread != nullptr)
+		*actualread = count;
+
+	return np::SUCCESS;
+}
+
+void ReplayBackend::getAPIVersion(uint8_t* version_major, uint8_t* version_minor)
+{
+	Reply reply(*this, CALL_GET_API_VERSION);
+	reply.output(version_major, sizeof(*version_major));
+	reply.output(version_minor, sizeof(*version_minor));
+}
+
+np::NP_ErrorCode ReplayBackend::getAvailableSlots(uint32_t* slotmask)
+{
+	Reply reply(*this, CALL_GET_AVAILABLE_SLOTS);
+	reply.output(slotmask, sizeof(*slotmask));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setParameter(np::np_parameter_t paramid, int value)
+{
+	Reply reply(*this, CALL_SET_PARAMETER, int(paramid), value);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::openBS(int slotID)
+{
+	Reply reply(*this, CALL_OPEN_BS, slotID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::closeBS(int slotID)
+{
+	Reply reply(*this, CALL_CLOSE_BS, slotID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::arm(int slotID)
+{
+	Reply reply(*this, CALL_ARM, slotID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setSWTrigger(int slotID)
+{
+	Reply reply(*this, CALL_SET_SW_TRIGGER, slotID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setTriggerEdge(int slotID, bool rising)
+{
+	Reply reply(*this, CALL_SET_TRIGGER_EDGE, slotID, int(rising));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setTriggerBinding(int slotID, np::signalline_t outputlines, np::signalline_t inputlines)
+{
+	Reply reply(*this, CALL_SET_TRIGGER_BINDING, slotID, int(outputlines), int(inputlines));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::enableFileStream(int slotID, bool enable)
+{
+	Reply reply(*this, CALL_ENABLE_FILE_STREAM, slotID, int(enable));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setFileStream(int slotID, const char* filename)
+{
+	Reply reply(*this, CALL_SET_FILE_STREAM, slotID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::getBSBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build)
+{
+	Reply reply(*this, CALL_GET_BS_BOOT_VERSION, slotID);
+	reply.output(version_major, sizeof(*version_major));
+	reply.output(version_minor, sizeof(*version_minor));
+	reply.output(version_build, version_build != nullptr ? sizeof(*version_build) : 0);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::getBSCBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build)
+{
+	Reply reply(*this, CALL_GET_BSC_BOOT_VERSION, slotID);
+	reply.output(version_major, sizeof(*version_major));
+	reply.output(version_minor, sizeof(*version_minor));
+	reply.output(version_build, version_build != nullptr ? sizeof(*version_build) : 0);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::getBSCVersion(int slotID, uint8_t* version_major, uint8_t* version_minor)
+{
+	Reply reply(*this, CALL_GET_BSC_VERSION, slotID);
+	reply.output(version_major, sizeof(*version_major));
+	reply.output(version_minor, sizeof(*version_minor));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::readBSCSN(int slotID, uint64_t* sn)
+{
+	Reply reply(*this, CALL_READ_BSC_SN, slotID);
+	reply.output(sn, sizeof(*sn));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::readBSCPN(int slotID, char* pn, size_t len)
+{
+	Reply reply(*this, CALL_READ_BSC_PN, slotID, int(len));
+	reply.outputString(pn, len);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::closePort(int slotID, int portID)
+{
+	Reply reply(*this, CALL_CLOSE_PORT, slotID, portID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setHSLed(int slotID, int portID, bool enable)
+{
+	Reply reply(*this, CALL_SET_HS_LED, slotID, portID, int(enable));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::getHSVersion(int slotID, int portID, uint8_t* version_major, uint8_t* version_minor)
+{
+	Reply reply(*this, CALL_GET_HS_VERSION, slotID, portID);
+	reply.output(version_major, sizeof(*version_major));
+	reply.output(version_minor, sizeof(*version_minor));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::readHSSN(int slotID, int portID, uint64_t* sn)
+{
+	Reply reply(*this, CALL_READ_HS_SN, slotID, portID);
+	reply.output(sn, sizeof(*sn));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::readHSPN(int slotID, int portID, char* pn, size_t maxlen)
+{
+	Reply reply(*this, CALL_READ_HS_PN, slotID, portID, int(maxlen));
+	reply.outputString(pn, maxlen);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::getFlexVersion(int slotID, int portID, int dockID, unsigned char* version_major, unsigned char* version_minor)
+{
+	Reply reply(*this, CALL_GET_FLEX_VERSION, slotID, portID, dockID);
+	reply.output(version_major, sizeof(*version_major));
+	reply.output(version_minor, sizeof(*version_minor));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::readFlexPN(int slotID, int portID, int dockID, char* pn, size_t maxlen)
+{
+	Reply reply(*this, CALL_READ_FLEX_PN, slotID, portID, dockID, int(maxlen));
+	reply.outputString(pn, maxlen);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::openProbe(int slotID, int portID, int dockID)
+{
+	Reply reply(*this, CALL_OPEN_PROBE, slotID, portID, dockID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::init(int slotID, int portID, int dockID)
+{
+	Reply reply(*this, CALL_INIT, slotID, portID, dockID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::readProbeSN(int slotID, int portID, int dockID, uint64_t* id)
+{
+	Reply reply(*this, CALL_READ_PROBE_SN, slotID, portID, dockID);
+	reply.output(id, sizeof(*id));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::readProbePN(int slotID, int portID, int dockID, char* pn, size_t maxlen)
+{
+	Reply reply(*this, CALL_READ_PROBE_PN, slotID, portID, dockID, int(maxlen));
+	reply.outputString(pn, maxlen);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setOPMODE(int slotID, int portID, int dockID, np::probe_opmode_t mode)
+{
+	Reply reply(*this, CALL_SET_OPMODE, slotID, portID, dockID, int(mode));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::selectElectrode(int slotID, int portID, int dockID, int channel, int shank, int bank)
+{
+	Reply reply(*this, CALL_SELECT_ELECTRODE, slotID, portID, dockID, channel, shank, bank);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setReference(int slotID, int portID, int dockID, int channel, int shank, np::channelreference_t reference, int intRefElectrodeBank)
+{
+	Reply reply(*this, CALL_SET_REFERENCE, slotID, portID, dockID, channel, shank, int(reference));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setAPCornerFrequency(int slotID, int portID, int dockID, int channel, bool disableHighPass)
+{
+	Reply reply(*this, CALL_SET_AP_CORNER_FREQUENCY, slotID, portID, dockID, channel, int(disableHighPass));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::setStdb(int slotID, int portID, int dockID, int channel, bool standby)
+{
+	Reply reply(*this, CALL_SET_STDB, slotID, portID, dockID, channel, int(standby));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::writeProbeConfiguration(int slotID, int portID, int dockID, bool readCheck)
+{
+	Reply reply(*this, CALL_WRITE_PROBE_CONFIGURATION, slotID, portID, dockID, int(readCheck));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::getPacketFifoStatus(int slotID, int portID, int dockID, np::streamsource_t source, size_t* packetsavailable, size_t* headroom)
+{
+	Reply reply(*this, CALL_GET_PACKET_FIFO_STATUS, slotID, portID, dockID, int(source));
+	reply.output(packetsavailable, sizeof(*packetsavailable));
+	reply.output(headroom, sizeof(*headroom));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::bistBS(int slotID)
+{
+	Reply reply(*this, CALL_BIST_BS, slotID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::bistHB(int slotID, int portID, int dockID)
+{
+	Reply reply(*this, CALL_BIST_HB, slotID, portID, dockID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::bistStartPRBS(int slotID, int portID)
+{
+	Reply reply(*this, CALL_BIST_START_PRBS, slotID, portID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::bistStopPRBS(int slotID, int portID, int* prbs_err)
+{
+	Reply reply(*this, CALL_BIST_STOP_PRBS, slotID, portID);
+	reply.output(prbs_err, sizeof(*prbs_err));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::bistI2CMM(int slotID, int portID, int dockID)
+{
+	Reply reply(*this, CALL_BIST_I2CMM, slotID, portID, dockID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::bistEEPROM(int slotID, int portID)
+{
+	Reply reply(*this, CALL_BIST_EEPROM, slotID, portID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::bistSR(int slotID, int portID, int dockID)
+{
+	Reply reply(*this, CALL_BIST_SR, slotID, portID, dockID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::bistPSB(int slotID, int portID, int dockID)
+{
+	Reply reply(*this, CALL_BIST_PSB, slotID, portID, dockID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::bistNoise(int slotID, int portID, int dockID)
+{
+	Reply reply(*this, CALL_BIST_NOISE, slotID, portID, dockID);
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::dbg_diagstats_read(int slotID, np::np_diagstats* stats)
+{
+	Reply reply(*this, CALL_DBG_DIAGSTATS_READ, slotID);
+	reply.output(stats, sizeof(*stats));
+	return reply.result();
+}
+
+np::NP_ErrorCode ReplayBackend::dbg_sourcestats_read(int slotID, uint8_t sourceID, np::np_sourcestats* stats)
+{
+	Reply reply(*this, CALL_DBG_SOURCESTATS_READ, slotID, sourceID);
+	reply.output(stats, sizeof(*stats));
+	return reply.result();
+}
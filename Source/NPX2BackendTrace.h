@@ -0,0 +1,371 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NPX2BACKENDTRACE_H__
+#define __NPX2BACKENDTRACE_H__
+
+#include <DataThreadHeaders.h>
+#include <map>
+#include <deque>
+
+#include "NPX2Backend.h"
+
+#define TRACE_MAGIC 		"NPX2TRC1"
+#define TRACE_VERSION 		1
+#define TRACE_MAX_ARGS 		6
+
+/** Identifies the backend method a trace record belongs to; stored in trace files, so only append. */
+typedef enum {
+	CALL_GET_API_VERSION,
+	CALL_GET_AVAILABLE_SLOTS,
+	CALL_SET_PARAMETER,
+	CALL_OPEN_BS,
+	CALL_CLOSE_BS,
+	CALL_ARM,
+	CALL_SET_SW_TRIGGER,
+	CALL_SET_TRIGGER_EDGE,
+	CALL_SET_TRIGGER_BINDING,
+	CALL_ENABLE_FILE_STREAM,
+	CALL_SET_FILE_STREAM,
+	CALL_GET_BS_BOOT_VERSION,
+	CALL_GET_BSC_BOOT_VERSION,
+	CALL_GET_BSC_VERSION,
+	CALL_READ_BSC_SN,
+	CALL_READ_BSC_PN,
+	CALL_CLOSE_PORT,
+	CALL_SET_HS_LED,
+	CALL_GET_HS_VERSION,
+	CALL_READ_HS_SN,
+	CALL_READ_HS_PN,
+	CALL_GET_FLEX_VERSION,
+	CALL_READ_FLEX_PN,
+	CALL_OPEN_PROBE,
+	CALL_INIT,
+	CALL_READ_PROBE_SN,
+	CALL_READ_PROBE_PN,
+	CALL_SET_OPMODE,
+	CALL_SELECT_ELECTRODE,
+	CALL_SET_REFERENCE,
+	CALL_SET_AP_CORNER_FREQUENCY,
+	CALL_SET_STDB,
+	CALL_WRITE_PROBE_CONFIGURATION,
+	CALL_READ_PACKET,
+	CALL_READ_PACKETS,
+	CALL_GET_PACKET_FIFO_STATUS,
+	CALL_CREATE_PROBE_PACKET_CALLBACK,
+	CALL_DESTROY_PACKET_CALLBACK,
+	CALL_BIST_BS,
+	CALL_BIST_HB,
+	CALL_BIST_START_PRBS,
+	CALL_BIST_STOP_PRBS,
+	CALL_BIST_I2CMM,
+	CALL_BIST_EEPROM,
+	CALL_BIST_SR,
+	CALL_BIST_PSB,
+	CALL_BIST_NOISE,
+	CALL_DBG_DIAGSTATS_READ,
+	CALL_DBG_SOURCESTATS_READ,
+	CALL_PACKET             //A packet delivered to a probe packet callback
+} BackendCall;
+
+/**
+
+	Fixed part of a trace record, followed by payloadSize bytes of outputs.
+
+	The payload holds the data the call wrote through its pointer arguments
+	(serial numbers, FIFO levels, packet info and samples, ...) as a sequence
+	of [uint32 size][bytes] chunks, in argument order. args holds the
+	call's integer arguments; replay matches calls on the first four.
+
+*/
+struct TraceRecordHeader
+{
+	uint16 call;
+	int16 result;
+	int32 args[TRACE_MAX_ARGS];
+	uint64 startMicros;       //Since the trace started
+	uint32 durationMicros;
+	uint32 payloadSize;
+};
+
+/**
+
+	Decorator that forwards every call to another backend and appends its
+	arguments, outputs, return code and timing to a trace file.
+
+	Packets delivered through probe packet callbacks are captured as
+	CALL_PACKET records. Records from concurrent calls are serialized in the
+	order the calls returned.
+
+*/
+class RecordingBackend : public NPX2Backend
+{
+public:
+	/** Takes ownership of inner. */
+	RecordingBackend(NPX2Backend* inner, const File& file);
+	~RecordingBackend();
+
+	String getName() const override { return "recording (" + inner->getName() + ")"; }
+
+	/** Number of records written so far. */
+	int64 getNumRecords() const;
+
+	/* System */
+	void getAPIVersion(uint8_t* version_major, uint8_t* version_minor) override;
+	np::NP_ErrorCode getAvailableSlots(uint32_t* slotmask) override;
+	np::NP_ErrorCode setParameter(np::np_parameter_t paramid, int value) override;
+
+	/* Basestation */
+	np::NP_ErrorCode openBS(int slotID) override;
+	np::NP_ErrorCode closeBS(int slotID) override;
+	np::NP_ErrorCode arm(int slotID) override;
+	np::NP_ErrorCode setSWTrigger(int slotID) override;
+	np::NP_ErrorCode setTriggerEdge(int slotID, bool rising) override;
+	np::NP_ErrorCode setTriggerBinding(int slotID, np::signalline_t outputlines, np::signalline_t inputlines) override;
+	np::NP_ErrorCode enableFileStream(int slotID, bool enable) override;
+	np::NP_ErrorCode setFileStream(int slotID, const char* filename) override;
+	np::NP_ErrorCode getBSBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build) override;
+	np::NP_ErrorCode getBSCBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build) override;
+	np::NP_ErrorCode getBSCVersion(int slotID, uint8_t* version_major, uint8_t* version_minor) override;
+	np::NP_ErrorCode readBSCSN(int slotID, uint64_t* sn) override;
+	np::NP_ErrorCode readBSCPN(int slotID, char* pn, size_t len) override;
+
+	/* Headstage and flex */
+	np::NP_ErrorCode closePort(int slotID, int portID) override;
+	np::NP_ErrorCode setHSLed(int slotID, int portID, bool enable) override;
+	np::NP_ErrorCode getHSVersion(int slotID, int portID, uint8_t* version_major, uint8_t* version_minor) override;
+	np::NP_ErrorCode readHSSN(int slotID, int portID, uint64_t* sn) override;
+	np::NP_ErrorCode readHSPN(int slotID, int portID, char* pn, size_t maxlen) override;
+	np::NP_ErrorCode getFlexVersion(int slotID, int portID, int dockID, unsigned char* version_major, unsigned char* version_minor) override;
+	np::NP_ErrorCode readFlexPN(int slotID, int portID, int dockID, char* pn, size_t maxlen) override;
+
+	/* Probe */
+	np::NP_ErrorCode openProbe(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode init(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode readProbeSN(int slotID, int portID, int dockID, uint64_t* id) override;
+	np::NP_ErrorCode readProbePN(int slotID, int portID, int dockID, char* pn, size_t maxlen) override;
+	np::NP_ErrorCode setOPMODE(int slotID, int portID, int dockID, np::probe_opmode_t mode) override;
+	np::NP_ErrorCode selectElectrode(int slotID, int portID, int dockID, int channel, int shank, int bank) override;
+	np::NP_ErrorCode setReference(int slotID, int portID, int dockID, int channel, int shank, np::channelreference_t reference, int intRefElectrodeBank) override;
+	np::NP_ErrorCode setAPCornerFrequency(int slotID, int portID, int dockID, int channel, bool disableHighPass) override;
+	np::NP_ErrorCode setStdb(int slotID, int portID, int dockID, int channel, bool standby) override;
+	np::NP_ErrorCode writeProbeConfiguration(int slotID, int portID, int dockID, bool readCheck) override;
+
+	/* Data */
+	np::NP_ErrorCode readPacket(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t requestedChannelCount, size_t* actualread) override;
+	np::NP_ErrorCode readPackets(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t channelcount, size_t packetcount, size_t* packetsread) override;
+	np::NP_ErrorCode getPacketFifoStatus(int slotID, int portID, int dockID, np::streamsource_t source, size_t* packetsavailable, size_t* headroom) override;
+	np::NP_ErrorCode createProbePacketCallback(int slotID, int portID, int dockID, np::streamsource_t source, np::npcallbackhandle_t* handle, np::np_packetcallbackfn_t callback, const void* userdata) override;
+	np::NP_ErrorCode destroyPacketCallback(np::npcallbackhandle_t* handle) override;
+	np::NP_ErrorCode unpackData(const np::np_packet_t* packet, int16_t* output, size_t samplestoread, size_t* actualread) override;
+
+	/* Built-in self tests */
+	np::NP_ErrorCode bistBS(int slotID) override;
+	np::NP_ErrorCode bistHB(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistStartPRBS(int slotID, int portID) override;
+	np::NP_ErrorCode bistStopPRBS(int slotID, int portID, int* prbs_err) override;
+	np::NP_ErrorCode bistI2CMM(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistEEPROM(int slotID, int portID) override;
+	np::NP_ErrorCode bistSR(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistPSB(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistNoise(int slotID, int portID, int dockID) override;
+
+	/* Debug statistics */
+	np::NP_ErrorCode dbg_diagstats_read(int slotID, np::np_diagstats* stats) override;
+	np::NP_ErrorCode dbg_sourcestats_read(int slotID, uint8_t sourceID, np::np_sourcestats* stats) override;
+private:
+
+	class Call;
+	struct CallbackTap;
+
+	static void NP_APIC tapCallback(const np::np_packet_t& packet, const void* userdata);
+
+	void write(const TraceRecordHeader& header, const MemoryBlock& payload);
+	uint64 getMicros() const;
+
+	ScopedPointer<NPX2Backend> inner;
+	ScopedPointer<FileOutputStream> stream;
+
+	CriticalSection writeLock;
+	int64 startTicks;
+	int64 numRecords;
+
+	OwnedArray<CallbackTap> taps;
+	CriticalSection tapLock;
+};
+
+/**
+
+	Backend that answers every call from a trace written by RecordingBackend,
+	without any hardware.
+
+	Calls are matched to records by method and first four integer arguments,
+	in the order they were recorded, so each probe stream sees exactly the
+	packets it saw during the capture. In real-time mode a call does not
+	return before its record's offset from the start of the trace has
+	elapsed; otherwise the session plays back as fast as it is read.
+	Recorded callback packets are delivered from one thread per callback.
+
+	Calls with no matching record return NOTSUPPORTED; packet reads past the
+	end of the trace return no data.
+
+*/
+class ReplayBackend : public NPX2Backend
+{
+public:
+	ReplayBackend(const File& file, bool realTime);
+	~ReplayBackend();
+
+	String getName() const override { return realTime ? "replay (real time)" : "replay (full speed)"; }
+
+	/** False if the file could not be read or is not a trace. */
+	bool isValid() const { return valid; }
+
+	int getNumRecords() const { return records.size(); }
+
+	/** Number of calls that found no matching record. */
+	int64 getNumMisses() const { return misses.load(); }
+
+	/* System */
+	void getAPIVersion(uint8_t* version_major, uint8_t* version_minor) override;
+	np::NP_ErrorCode getAvailableSlots(uint32_t* slotmask) override;
+	np::NP_ErrorCode setParameter(np::np_parameter_t paramid, int value) override;
+
+	/* Basestation */
+	np::NP_ErrorCode openBS(int slotID) override;
+	np::NP_ErrorCode closeBS(int slotID) override;
+	np::NP_ErrorCode arm(int slotID) override;
+	np::NP_ErrorCode setSWTrigger(int slotID) override;
+	np::NP_ErrorCode setTriggerEdge(int slotID, bool rising) override;
+	np::NP_ErrorCode setTriggerBinding(int slotID, np::signalline_t outputlines, np::signalline_t inputlines) override;
+	np::NP_ErrorCode enableFileStream(int slotID, bool enable) override;
+	np::NP_ErrorCode setFileStream(int slotID, const char* filename) override;
+	np::NP_ErrorCode getBSBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build) override;
+	np::NP_ErrorCode getBSCBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build) override;
+	np::NP_ErrorCode getBSCVersion(int slotID, uint8_t* version_major, uint8_t* version_minor) override;
+	np::NP_ErrorCode readBSCSN(int slotID, uint64_t* sn) override;
+	np::NP_ErrorCode readBSCPN(int slotID, char* pn, size_t len) override;
+
+	/* Headstage and flex */
+	np::NP_ErrorCode closePort(int slotID, int portID) override;
+	np::NP_ErrorCode setHSLed(int slotID, int portID, bool enable) override;
+	np::NP_ErrorCode getHSVersion(int slotID, int portID, uint8_t* version_major, uint8_t* version_minor) override;
+	np::NP_ErrorCode readHSSN(int slotID, int portID, uint64_t* sn) override;
+	np::NP_ErrorCode readHSPN(int slotID, int portID, char* pn, size_t maxlen) override;
+	np::NP_ErrorCode getFlexVersion(int slotID, int portID, int dockID, unsigned char* version_major, unsigned char* version_minor) override;
+	np::NP_ErrorCode readFlexPN(int slotID, int portID, int dockID, char* pn, size_t maxlen) override;
+
+	/* Probe */
+	np::NP_ErrorCode openProbe(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode init(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode readProbeSN(int slotID, int portID, int dockID, uint64_t* id) override;
+	np::NP_ErrorCode readProbePN(int slotID, int portID, int dockID, char* pn, size_t maxlen) override;
+	np::NP_ErrorCode setOPMODE(int slotID, int portID, int dockID, np::probe_opmode_t mode) override;
+	np::NP_ErrorCode selectElectrode(int slotID, int portID, int dockID, int channel, int shank, int bank) override;
+	np::NP_ErrorCode setReference(int slotID, int portID, int dockID, int channel, int shank, np::channelreference_t reference, int intRefElectrodeBank) override;
+	np::NP_ErrorCode setAPCornerFrequency(int slotID, int portID, int dockID, int channel, bool disableHighPass) override;
+	np::NP_ErrorCode setStdb(int slotID, int portID, int dockID, int channel, bool standby) override;
+	np::NP_ErrorCode writeProbeConfiguration(int slotID, int portID, int dockID, bool readCheck) override;
+
+	/* Data */
+	np::NP_ErrorCode readPacket(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t requestedChannelCount, size_t* actualread) override;
+	np::NP_ErrorCode readPackets(int slotID, int portID, int dockID, np::streamsource_t source, np::PacketInfo* pckinfo, int16_t* data, size_t channelcount, size_t packetcount, size_t* packetsread) override;
+	np::NP_ErrorCode getPacketFifoStatus(int slotID, int portID, int dockID, np::streamsource_t source, size_t* packetsavailable, size_t* headroom) override;
+	np::NP_ErrorCode createProbePacketCallback(int slotID, int portID, int dockID, np::streamsource_t source, np::npcallbackhandle_t* handle, np::np_packetcallbackfn_t callback, const void* userdata) override;
+	np::NP_ErrorCode destroyPacketCallback(np::npcallbackhandle_t* handle) override;
+	np::NP_ErrorCode unpackData(const np::np_packet_t* packet, int16_t* output, size_t samplestoread, size_t* actualread) override;
+
+	/* Built-in self tests */
+	np::NP_ErrorCode bistBS(int slotID) override;
+	np::NP_ErrorCode bistHB(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistStartPRBS(int slotID, int portID) override;
+	np::NP_ErrorCode bistStopPRBS(int slotID, int portID, int* prbs_err) override;
+	np::NP_ErrorCode bistI2CMM(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistEEPROM(int slotID, int portID) override;
+	np::NP_ErrorCode bistSR(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistPSB(int slotID, int portID, int dockID) override;
+	np::NP_ErrorCode bistNoise(int slotID, int portID, int dockID) override;
+
+	/* Debug statistics */
+	np::NP_ErrorCode dbg_diagstats_read(int slotID, np::np_diagstats* stats) override;
+	np::NP_ErrorCode dbg_sourcestats_read(int slotID, uint8_t sourceID, np::np_sourcestats* stats) override;
+private:
+
+	class Reply;
+	class CallbackPlayer;
+
+	struct Record
+	{
+		TraceRecordHeader header;
+		size_t payloadOffset;
+	};
+
+	struct Key
+	{
+		int call;
+		int args[4];
+
+		bool operator<(const Key& other) const
+		{
+			if (call != other.call)
+				return call < other.call;
+
+			for (int i = 0; i < 4; i++)
+			{
+				if (args[i] != other.args[i])
+					return args[i] < other.args[i];
+			}
+
+			return false;
+		}
+	};
+
+	static Key makeKey(int call, const int32* args);
+
+	/** Removes and returns the next record for a key, or nullptr. */
+	const Record* next(const Key& key);
+
+	/** Microseconds until the record is due; 0 if it is or in full-speed mode. */
+	int64 getMicrosUntilDue(const Record& record);
+
+	/** Blocks until the record is due. */
+	void waitFor(const Record& record);
+
+	bool valid;
+	bool realTime;
+
+	MemoryBlock data;
+	Array<Record> records;
+
+	std::map<Key, std::deque<int>> queues;
+	CriticalSection queueLock;
+
+	int64 startTicks;
+	bool started;
+	std::atomic<int64> misses;
+
+	OwnedArray<CallbackPlayer> players;
+	CriticalSection playerLock;
+};
+
+#endif  // __NPX2BACKENDTRACE_H__
@@ -26,10 +26,61 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <thread>
 
 #include "NPX2Components.h"
+#include "NPX2SampleConverter.h"
+#include "NPX2SampleRing.h"
+#include "NPX2ElectrodeMap.h"
 
 #define MAXLEN 50
 
-np::NP_ErrorCode errorCode;
+//Discovery and configuration run on several threads, each keeps its own last error
+thread_local np::NP_ErrorCode errorCode;
+
+static CriticalSection& getStartupTimingLock()
+{
+	static CriticalSection lock;
+	return lock;
+}
+
+static Array<StartupTiming>& getStartupTimingLog()
+{
+	static Array<StartupTiming> log;
+	return log;
+}
+
+void StartupProfiler::record(int slot, int port, int dock, const String& stage, float milliseconds)
+{
+	StartupTiming timing;
+	timing.slot = slot;
+	timing.port = port;
+	timing.dock = dock;
+	timing.stage = stage;
+	timing.milliseconds = milliseconds;
+
+	const ScopedLock lock(getStartupTimingLock());
+	getStartupTimingLog().add(timing);
+}
+
+Array<StartupTiming> StartupProfiler::getTimings()
+{
+	const ScopedLock lock(getStartupTimingLock());
+	return getStartupTimingLog();
+}
+
+void StartupProfiler::clear()
+{
+	const ScopedLock lock(getStartupTimingLock());
+	getStartupTimingLog().clear();
+}
+
+StartupProfiler::ScopedStage::ScopedStage(int slot_, int port_, int dock_, const String& stage_)
+	: slot(slot_), port(port_), dock(dock_), stage(stage_), start(Time::getHighResolutionTicks())
+{
+}
+
+StartupProfiler::ScopedStage::~ScopedStage()
+{
+	record(slot, port, dock, stage, float(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0));
+}
 
 NeuropixComponent::NeuropixComponent() : serial_number(-1), part_number(""), version("")
 {
@@ -39,7 +90,7 @@ void Neuropix2API::getInfo()
 {
 	uint8_t version_major;
 	uint8_t version_minor;
-	np::getAPIVersion(&version_major, &version_minor);
+	NPX2Backend::get().getAPIVersion(&version_major, &version_minor);
 
 	version = String(version_major) + "." + String(version_minor);
 }
@@ -51,7 +102,7 @@ void Basestation::getInfo()
 	uint8_t version_minor;
 	uint16_t version_build;
 
-	errorCode = np::getBSBootVersion(slot, &version_major, &version_minor, &version_build);
+	errorCode = NPX2Backend::get().getBSBootVersion(slot, &version_major, &version_minor, &version_build);
 
 	boot_version = String(version_major) + "." + String(version_minor);
 
@@ -70,7 +121,7 @@ void BasestationConnectBoard::getInfo()
 	uint8_t version_minor;
 	uint16_t version_build;
 
-	errorCode = np::getBSCBootVersion(basestation->slot, &version_major, &version_minor, &version_build);
+	errorCode = NPX2Backend::get().getBSCBootVersion(basestation->slot, &version_major, &version_minor, &version_build);
 
 	boot_version = String(version_major) + "." + String(version_minor);
 
@@ -80,14 +131,14 @@ void BasestationConnectBoard::getInfo()
 		boot_version += String(version_build);
 	}
 
-	errorCode = np::getBSCVersion(basestation->slot, &version_major, &version_minor);
+	errorCode = NPX2Backend::get().getBSCVersion(basestation->slot, &version_major, &version_minor);
 
 	version = String(version_major) + "." + String(version_minor);
 
-	errorCode = np::readBSCSN(basestation->slot, &serial_number);
+	errorCode = NPX2Backend::get().readBSCSN(basestation->slot, &serial_number);
 
 	char pn[MAXLEN];
-	np::readBSCPN(basestation->slot, pn, MAXLEN);
+	NPX2Backend::get().readBSCPN(basestation->slot, pn, MAXLEN);
 
 	part_number = String(pn);
 
@@ -99,14 +150,14 @@ void Headstage::getInfo()
 	uint8_t version_major;
 	uint8_t version_minor;
 
-	errorCode = np::getHSVersion(probe->basestation->slot, probe->port, &version_major, &version_minor);
+	errorCode = NPX2Backend::get().getHSVersion(probe->basestation->slot, probe->port, &version_major, &version_minor);
 
 	version = String(version_major) + "." + String(version_minor);
 
-	errorCode = np::readHSSN(probe->basestation->slot, probe->port, &serial_number);
+	errorCode = NPX2Backend::get().readHSSN(probe->basestation->slot, probe->port, &serial_number);
 
 	char pn[MAXLEN];
-	errorCode = np::readHSPN(probe->basestation->slot, probe->port, pn, MAXLEN);
+	errorCode = NPX2Backend::get().readHSPN(probe->basestation->slot, probe->port, pn, MAXLEN);
 
 	part_number = String(pn);
 
@@ -119,12 +170,12 @@ void Flex::getInfo()
 	uint8_t version_major;
 	uint8_t version_minor;
 
-	errorCode = np::getFlexVersion(probe->basestation->slot, probe->port, probe->dock, &version_major, &version_minor);
+	errorCode = NPX2Backend::get().getFlexVersion(probe->basestation->slot, probe->port, probe->dock, &version_major, &version_minor);
 
 	version = String(version_major) + "." + String(version_minor);
 
 	char pn[MAXLEN];
-	errorCode = np::readFlexPN(probe->basestation->slot, probe->port, probe->dock, pn, MAXLEN);
+	errorCode = NPX2Backend::get().readFlexPN(probe->basestation->slot, probe->port, probe->dock, pn, MAXLEN);
 
 	part_number = String(pn);
 
@@ -134,10 +185,10 @@ void Flex::getInfo()
 void Probe::getInfo()
 {
 
-	errorCode = np::readProbeSN(basestation->slot, port, dock, &serial_number);
+	errorCode = NPX2Backend::get().readProbeSN(basestation->slot, port, dock, &serial_number);
 
 	char pn[MAXLEN];
-	errorCode = np::readProbePN(basestation->slot, port, dock, pn, MAXLEN);
+	errorCode = NPX2Backend::get().readProbePN(basestation->slot, port, dock, pn, MAXLEN);
 
 	part_number = String(pn);
 	
@@ -146,422 +197,1863 @@ void Probe::getInfo()
 Probe::Probe(Basestation* bs, int port, int dock) : Thread("probe_" + String(port)), 
 	basestation(bs), port(port), dock(dock), shank(0)
 {
+	armed = false;
 
 	setStatus(ProbeStatus::DISCONNECTED);
 	setSelected(false);
 
-	flex = new Flex(this);
-	headstage = new Headstage(this);
+	{
+		StartupProfiler::ScopedStage stage(bs->slot, port, dock, "Flex getInfo");
+		flex = new Flex(this);
+	}
+	{
+		StartupProfiler::ScopedStage stage(bs->slot, port, dock, "Headstage getInfo");
+		headstage = new Headstage(this);
+	}
+	{
+		StartupProfiler::ScopedStage stage(bs->slot, port, dock, "Probe getInfo");
+		getInfo();
+	}
 
-	getInfo();
+	apStream = new ProbeStream(this, np::SourceAP);
 
-	fifoFillPercentage = 0.0f;
+	acquisitionMode = AcquisitionMode::BATCHED_PACKETS;
+	acquisitionThreading = AcquisitionThreading::THREAD_PER_PROBE;
+	apPacketsSinceLfpRead = 0;
+	gapPolicy = GapPolicy::GAP_FILL_ZEROS;
 
-}
+	statusMonitor = new PacketStatusMonitor(this);
+
+	invalidateConfiguration();
+	memset(&electrodeStats, 0, sizeof(electrodeStats));
+	memset(&configStats, 0, sizeof(configStats));
 
-void Probe::setStatus(ProbeStatus status)
-{
-	this->status = status;
 }
 
-void Probe::setSelected(bool isSelected)
+Probe::~Probe()
 {
-	this->isSelected = isSelected;
+	//Flushing a pending callback batch decodes it with statusMonitor, which
+	//would otherwise be destroyed before the streams
+	apStream->stopPacketCallback();
+
+	if (lfpStream != nullptr)
+		lfpStream->stopPacketCallback();
 }
 
-void Probe::setChannels(Array<int> channelStatus)
+bool Probe::init()
 {
 
-	/* ChannelMap as defined in Neuropixels_2_0_System_User_API_V0_3 p. 13/83 */
+	StartupProfiler::ScopedStage stage(basestation->slot, port, dock, "Probe init");
 
-	//Disconnect all channels from all electrodes
-	for (int ch = 0; ch < NUM_CHANNELS; ch++)
+	errorCode = NPX2Backend::get().init(basestation->slot, port, dock);
+
+	if (errorCode != np::SUCCESS)
 	{
-		errorCode = np::selectElectrode(basestation->slot, port, dock, ch, shank, 0xFF);
-		if (errorCode != np::SUCCESS)
-		{
-			printf("Failed to disconnect channel: %d w/ error: %d\n", ch, errorCode);
-		}
+		std::cout << String("Initializing probe on port " + String(port) + ", dock " + String(dock) + " FAILED!\n");
+		return false;
 	}
 
-	//Connect selected electrodes to their corresponding channels 
-	for (int i = 0; i < NUM_ELECTRODES; i++)
-	{
-		if (channelStatus[i] == 1)
-		{
+	invalidateConfiguration();
+	detectLfpStream();
 
-			int bank = i / NUM_CHANNELS;
-			int block = (i % NUM_CHANNELS) / ELECTRODES_PER_BLOCK;
-			int row = ((i % NUM_CHANNELS) / ELECTRODES_PER_ROW) % ROWS_PER_BLOCK;
+	errorCode = NPX2Backend::get().setOPMODE(basestation->slot, port, dock, np::probe_opmode_t::RECORDING);
 
-			//uint8_t bankMask = (1 << (i / NUM_CHANNELS)); 
-			//np::electrodebanks_t bank = static_cast<np::electrodebanks_t>(bankMask);
+	//TODO: Confirm 2.0 probes DO NOT require calibration.
+	//calibrate();
 
-			int offset;
-			int channel;
+	if (errorCode != np::SUCCESS)
+	{
+		std::cout << String("Setting recording mode on port " + String(port) + ", dock " + String(dock)
+			+ " failed with error code " + String(errorCode) + "\n");
+		return false;
+	}
 
-			switch (bank) {
+	apStream->timestamp = 0;
+	apStream->eventCode = 0;
+	if (lfpStream != nullptr)
+	{
+		lfpStream->timestamp = 0;
+		lfpStream->eventCode = 0;
+	}
 
-				case 0 : //np::electrodebanks_t::BankA :
-				{
-					channel = (row * ELECTRODES_PER_ROW) + (block * ELECTRODES_PER_BLOCK) + (i % ELECTRODES_PER_ROW);
-					break;
-				}
-				case 1 : //np::electrodebanks_t::BankB :
-				{
-					offset = (i % ELECTRODES_PER_ROW) * 4;
-					channel = (row * 7 + offset) % ROWS_PER_BLOCK * ELECTRODES_PER_ROW + (block * ELECTRODES_PER_BLOCK) + (i % ELECTRODES_PER_ROW);
-					break;
-				}
-				case 2 : //np::electrodebanks_t::BankC :
-				{
-					offset = (i % ELECTRODES_PER_ROW) * 8;
-					channel = (row * 5 + offset) % ROWS_PER_BLOCK * ELECTRODES_PER_ROW + (block * ELECTRODES_PER_BLOCK) + (i % ELECTRODES_PER_ROW);
-					break;
-				}
-				case 3: //np::electrodebanks_t::BankD :
-				{
-					offset = (i % ELECTRODES_PER_ROW) * 12;
-					channel = (row * 3 + offset) % ROWS_PER_BLOCK * ELECTRODES_PER_ROW + (block * ELECTRODES_PER_BLOCK) + (i % ELECTRODES_PER_ROW);
-					break;
-				}
-				default:
-				{
-					channel = -1;
-					printf("Error: Should not have reached here!\n");
-				}
+	bool ledEnable = false;
+	errorCode = NPX2Backend::get().setHSLed(basestation->slot, port, ledEnable);
 
-			}
+	setStatus(ProbeStatus::CONNECTED);
 
-			Array<int> electrodes;
-			if (channelMap.contains(channel))
-				electrodes = channelMap[channel];
-			electrodes.add(i);
-			channelMap.set(channel, electrodes);
-			
-			errorCode = np::selectElectrode(basestation->slot, port, dock, channel, shank, bank);
-			if (errorCode != np::SUCCESS)
-			{
-				printf("Failed to set ch: %d to bank: %d w/ error: %d\n", channel, bank, errorCode);
-			}
+	std::cout << String("Initialized probe on port " + String(port) + ", dock " + String(dock) + "\n");
 
-		}
-	}
+	return true;
+}
 
-	//Display channelMap for debugging as needed 
-	if (false)
+void Probe::detectLfpStream()
+{
+	size_t packetsAvailable;
+	size_t headroom;
+
+	np::NP_ErrorCode ec = NPX2Backend::get().getPacketFifoStatus(basestation->slot, port, dock, np::SourceLFP, &packetsAvailable, &headroom);
+
+	if (ec == np::SUCCESS)
 	{
-		printf(" CH |     ELECTRODES      \n");
-		for (HashMap<int, Array<int>>::Iterator i (channelMap); i.next();)
-		{
-			int channel = i.getKey();
-			printf("%3d | ", channel);
-			Array<int> electrodes = i.getValue();
-	    	for (auto electrode : electrodes)
-	    		printf("%4d ", electrode);
-	    	std::cout << std::endl;
-		}
+		if (lfpStream == nullptr)
+			lfpStream = new ProbeStream(this, np::SourceLFP);
 	}
-
-	bool readCheck = false;
-	errorCode = np::writeProbeConfiguration(basestation->slot, port, dock, readCheck);
-	if (errorCode != np::SUCCESS)
+	else
 	{
-		printf("Failed to write probe configuration w/ error: %d\n", errorCode);
+		std::cout << "  No LFP stream on slot " << basestation->slot << ", port " << port << ", dock " << dock << " (error " << ec << ")" << std::endl;
 	}
-
 }
 
-void Probe::setReferences(np::channelreference_t ref, np::electrodebanks_t bank)
+float Probe::getFillPercentage()
 {
-	
-	for (int channel = 0; channel < NUM_CHANNELS; channel++)
-		errorCode = np::setReference(basestation->slot, port, dock, channel, shank, ref, bank);
+	float perc = apStream->getFifoStatistics(true).peak;
 
-	bool readCheck = false;
-	errorCode = np::writeProbeConfiguration(basestation->slot, port, dock, readCheck);
+	if (lfpStream != nullptr)
+		perc = jmax(perc, lfpStream->getFifoStatistics(true).peak);
 
-	std::cout << "Wrote reference " << int(ref) << ", " << int(bank) << " with error code " << errorCode << std::endl;
+	return perc;
 }
 
-void Probe::run()
+void Probe::setPacketBatchSize(int packetsPerRead)
 {
+	apStream->setPacketBatchSize(packetsPerRead);
 
-	int64 timestamp = 0;
+	if (lfpStream != nullptr)
+		lfpStream->setPacketBatchSize(packetsPerRead);
+}
 
-	while (!threadShouldExit())
+void Probe::startAcquisition()
+{
+	statusMonitor->reset();
+
+	apStream->reset();
+
+	if (lfpStream != nullptr)
+		lfpStream->reset();
+
+	apPacketsSinceLfpRead = 0;
+
+	if (acquisitionMode == AcquisitionMode::PACKET_CALLBACK)
 	{
+		std::cout << "  Registering packet callbacks." << std::endl;
+		apStream->startPacketCallback();
 
-		errorCode = np::readPacket(
-			basestation->slot,
-			port,
-			dock,
-			static_cast<np::streamsource_t>(0), 
-			&pckinfo[0],
-			&data[0],
-			samplesToRead,
-			&actualRead);
+		if (lfpStream != nullptr)
+			lfpStream->startPacketCallback();
 
-		if (errorCode == np::SUCCESS && actualRead > 0)
-		{
+		armed = true;
+	}
+	else if (acquisitionThreading == AcquisitionThreading::THREAD_PER_PROBE)
+	{
+		std::cout << "  Starting thread." << std::endl;
+		startThread();
+	}
+}
 
-			eventCode = pckinfo->Status >> 6; //TODO: Confirm event code is same bit...
+void Probe::stopAcquisition()
+{
+	armed = false;
 
-			//int64 npx_timestamp = pckinfo->Timestamp;
-			timestamp++;
+	if (acquisitionMode == AcquisitionMode::PACKET_CALLBACK)
+	{
+		apStream->stopPacketCallback();
 
-			float samples[NUM_CHANNELS];
+		if (lfpStream != nullptr)
+			lfpStream->stopPacketCallback();
+	}
+	else if (acquisitionThreading == AcquisitionThreading::THREAD_PER_PROBE)
+	{
+		stopThread(1000);
+	}
+}
 
-			for (int i = 0; i < NUM_CHANNELS; i++)
-			{
-				samples[i] = 100.0f * float(data[i]) / 8192; //TODO: Confirm scale factor...
-			}
+void Probe::run()
+{
+
+	armed = true;
+
+	while (!threadShouldExit())
+		readNext();
 
-			stream->addToBuffer(samples, &timestamp, &eventCode, 1);
+}
 
-			size_t packetsAvailable;
-			size_t headroom;
+int Probe::readNext()
+{
 
-			errorCode = np::getPacketFifoStatus(
-				basestation->slot,
-				port,
-				dock,
-				static_cast<np::streamsource_t>(0),
-				&packetsAvailable,
-				&headroom);
+	bool batched = acquisitionMode == AcquisitionMode::BATCHED_PACKETS;
 
-			fifoFillPercentage = float(packetsAvailable) / float(packetsAvailable + headroom);
+	int count = apStream->readPackets(batched);
 
-		}
+	// The LFP FIFO only fills once per PROBE_SUPERFRAMESIZE AP samples, so it is
+	// drained by the same reader whenever enough AP packets have gone by.
+	apPacketsSinceLfpRead += count;
 
+	if (lfpStream != nullptr && apPacketsSinceLfpRead >= PROBE_SUPERFRAMESIZE)
+	{
+		lfpStream->readPackets(batched);
+		apPacketsSinceLfpRead = 0;
 	}
 
+	return count;
+
 }
 
-Headstage::Headstage(Probe* probe_) : probe(probe_)
+bool Probe::isArmed()
 {
-	getInfo();
+	return armed;
 }
 
-Flex::Flex(Probe* probe_) : probe(probe_)
+void Probe::setStatus(ProbeStatus status)
 {
-	getInfo();
+	this->status = status;
 }
 
-BasestationConnectBoard::BasestationConnectBoard(Basestation* bs) : basestation(bs)
+void Probe::setSelected(bool isSelected)
 {
-	getInfo();
+	this->isSelected = isSelected;
 }
 
-
-Basestation::Basestation(int slot_number) : probesInitialized(false)
+void Probe::setChannels(Array<int> channelStatus, bool forceFullRewrite)
 {
+	ProbeConfigTransaction transaction(this);
+	transaction.setElectrodes(channelStatus, forceFullRewrite);
+	transaction.commit();
+}
 
-	slot = slot_number;
+int Probe::stageChannels(const Array<int>& channelStatus, bool forceFullRewrite)
+{
 
-	errorCode = np::openBS(slot);
+	/* ChannelMap as defined in Neuropixels_2_0_System_User_API_V0_3 p. 13/83 */
 
-	if (errorCode == np::SUCCESS)
-	{
+	if (forceFullRewrite)
+		invalidateChannelState();
 
-		std::cout << "  Opened BS on slot " << slot << std::endl;
+	int requestedBank[NUM_CHANNELS];
+	for (int ch = 0; ch < NUM_CHANNELS; ch++)
+		requestedBank[ch] = DISCONNECTED_BANK;
 
-		getInfo();
-		basestationConnectBoard = new BasestationConnectBoard(this);
+	ChannelTableSnapshot table;
+	memset(table.electrodes, 0xFF, sizeof(table.electrodes));
 
-		savingDirectory = File();
+	int selectedElectrodes = 0;
 
-		for (int port = 1; port <= NUM_PORTS; port++)
+	//Work out which bank each channel should be connected to
+	for (int i = 0; i < NUM_ELECTRODES; i++)
+	{
+		if (channelStatus[i] == 1)
 		{
-			for (int dock = 1; dock <= NUM_DOCKS; dock++)
-			{
-				errorCode = np::openProbe(slot, port, dock);
 
-				if (errorCode == np::SUCCESS)
-				{
-					Probe* probe = new Probe(this, port, dock);
-					if (probe->serial_number / NPX2_MIN_PROBE_SERIAL > 0)
-					{
-						probe->setStatus(ProbeStatus::CONNECTING);
-						probes.add(probe);
-					}
-					else
-					{
-						delete probe;
-					}
-				}
-			}
+			int bank = ElectrodeMap::getBank(i);
+			int channel = ElectrodeMap::getChannel(i);
+
+			table.electrodes[channel][bank] = int16_t(i);
+			requestedBank[channel] = bank;
+			selectedElectrodes++;
+
 		}
-		std::cout << "Found " << String(probes.size()) << (probes.size() == 1 ? " probe." : " probes.") << std::endl;
 	}
 
-	syncFrequencies.add(1);
-	syncFrequencies.add(10);
-}
-
-void Basestation::init()
-{
+	//Only send the channels whose connection differs from what was last applied
+	int calls = 0;
 
-	for (int i = 0; i < probes.size(); i++)
+	for (int ch = 0; ch < NUM_CHANNELS; ch++)
 	{
-		std::cout << "Initializing probe " << String(i + 1) << "/" << String(probes.size()) << "...";
+		if (appliedBank[ch] == requestedBank[ch])
+			continue;
 
-		errorCode = np::init(this->slot, probes[i]->port, probes[i]->dock);
-		if (errorCode != np::SUCCESS)
-			std::cout << "  FAILED!." << std::endl;
+		np::NP_ErrorCode ec = NPX2Backend::get().selectElectrode(basestation->slot, port, dock, ch, shank, requestedBank[ch]);
+		calls++;
+
+		if (ec != np::SUCCESS)
+		{
+			printf("Failed to set ch: %d to bank: %d w/ error: %d\n", ch, requestedBank[ch], ec);
+			appliedBank[ch] = UNKNOWN_BANK;
+		}
 		else
 		{
-			probes[i]->setStatus(ProbeStatus::CONNECTED);
-			std::cout << "  Success!" << std::endl;
+			appliedBank[ch] = requestedBank[ch];
 		}
 	}
 
-}
+	for (int ch = 0; ch < NUM_CHANNELS; ch++)
+		table.connectedBank[ch] = requestedBank[ch] == DISCONNECTED_BANK ? -1 : int8_t(requestedBank[ch]);
+
+	channelTable.publish(table);
+
+	//A full rewrite used to disconnect every channel, connect each electrode and write the configuration
+	int legacyCalls = NUM_CHANNELS + selectedElectrodes + 1;
 
-Basestation::~Basestation()
-{
-	for (int i = 0; i < probes.size(); i++)
 	{
-		errorCode = np::closePort(slot, probes[i]->port);
-	}
-	errorCode = np::closeBS(slot);
-}
+		const SpinLock::ScopedLockType lock(statsLock);
 
-void Basestation::setSyncAsInput()
-{
+		electrodeStats.updates++;
+		if (forceFullRewrite)
+			electrodeStats.fullRewrites++;
 
-	errorCode = np::setParameter(np::NP_PARAM_SYNCMASTER, slot);
-	if (errorCode != np::SUCCESS)
+		if (calls == 0)
+		{
+			electrodeStats.skippedWrites++;
+			electrodeStats.apiCallsSaved += legacyCalls;
+		}
+		else
+		{
+			electrodeStats.apiCalls += calls + 1;
+			electrodeStats.apiCallsSaved += legacyCalls - (calls + 1);
+		}
+	}
+
+	//Display channel table for debugging as needed 
+	if (false)
 	{
-		printf("Failed to set slot %d as sync master!\n");
-		return;
+		printf(" CH |     ELECTRODES      \n");
+		for (int ch = 0; ch < NUM_CHANNELS; ch++)
+		{
+			printf("%3d | ", ch);
+			for (int bank = 0; bank < NUM_BANKS; bank++)
+				if (table.electrodes[ch][bank] >= 0)
+					printf("%4d ", table.electrodes[ch][bank]);
+	    	std::cout << std::endl;
+		}
 	}
 
-	errorCode = np::setParameter(np::NP_PARAM_SYNCSOURCE, np::SIGNALLINE_SMA);
-	if (errorCode != np::SUCCESS)
-		printf("Failed to set slot %d SMA as sync source!\n");
+	return calls;
 
 }
 
-Array<int> Basestation::getSyncFrequencies()
+int Probe::stageReferences(np::channelreference_t ref, np::electrodebanks_t bank, bool forceFullRewrite)
 {
-	return syncFrequencies;
-}
 
-void Basestation::setSyncAsOutput(int freqIndex)
-{
+	if (!forceFullRewrite && appliedReference == int(ref) && appliedReferenceBank == int(bank))
+		return 0;
 
-	//TODO: Can't find the corresponding calls in NPX2 API
-	/*
-	np1_error = np::setParameter(np::NP_PARAM_SYNCMASTER, slot);
-	if (np1_error != np::SUCCESS)
-	{
-		printf("Failed to set slot %d as sync master!\n", slot);
-		return;
-	} 
+	int failures = 0;
 
-	np1_error = np::setParameter(np::NP_PARAM_SYNCSOURCE, np::TRIGIN_SYNCCLOCK);
-	if (np1_error != np::SUCCESS)
+	for (int channel = 0; channel < NUM_CHANNELS; channel++)
 	{
-		printf("Failed to set slot %d internal clock as sync source!\n", slot);
-		return;
+		np::NP_ErrorCode ec = NPX2Backend::get().setReference(basestation->slot, port, dock, channel, shank, ref, bank);
+
+		if (ec != np::SUCCESS)
+		{
+			printf("Failed to set reference on ch: %d w/ error: %d\n", channel, ec);
+			failures++;
+		}
 	}
 
-	int freq = syncFrequencies[freqIndex];
+	//Leave the reference unknown so the next transaction rewrites every channel
+	appliedReference = failures == 0 ? int(ref) : -1;
+	appliedReferenceBank = failures == 0 ? int(bank) : -1;
 
-	printf("Setting slot %d sync frequency to %d Hz...\n", slot, freq);
-	np1_error = setParameter(np::NP_PARAM_SYNCFREQUENCY_HZ, freq);
-	if (np1_error != np::SUCCESS)
-	{
-		printf("Failed to set slot %d sync frequency to %d Hz!\n", slot, freq);
-		return;
-	}
-	*/
+	return NUM_CHANNELS;
 
 }
 
-int Basestation::getProbeCount()
+int Probe::stageApFilter(bool disableHighPass, bool forceFullRewrite)
 {
-	return probes.size();
-}
 
-float Basestation::getFillPercentage()
-{
-	float perc = 0.0;
+	if (!forceFullRewrite && appliedHighPass == int(disableHighPass))
+		return 0;
 
-	//Use the highest fifo percentage of all probes
-	for (int i = 0; i < getProbeCount(); i++)
+	int failures = 0;
+
+	for (int channel = 0; channel < NUM_CHANNELS; channel++)
 	{
-		if (probes[i]->fifoFillPercentage > perc)
-			perc = probes[i]->fifoFillPercentage;
+		np::NP_ErrorCode ec = NPX2Backend::get().setAPCornerFrequency(basestation->slot, port, dock, channel, disableHighPass);
+
+		if (ec != np::SUCCESS)
+		{
+			printf("Failed to set AP corner frequency on ch: %d w/ error: %d\n", channel, ec);
+			failures++;
+		}
 	}
 
-	return perc;
+	appliedHighPass = failures == 0 ? int(disableHighPass) : -1;
+
+	return NUM_CHANNELS;
+
 }
 
-void Basestation::initializeProbes()
+int Probe::stageStandby(const bool* standby, bool forceFullRewrite)
 {
-	if (!probesInitialized)
-	{
-		//TODO: Can't find the corresponding calls in NPX2 API
-		//np1_error = np::setTriggerInput(slot, np::TRIGIN_SW);
-
-		for (int i = 0; i < probes.size(); i++)
-		{
-			errorCode = np::setOPMODE(slot, probes[i]->port, probes[i]->dock, np::probe_opmode_t::RECORDING);
 
-			//TODO: Confirm 2.0 probes DO NOT require calibration.
-			//probes[i]->calibrate();
+	int calls = 0;
 
-			if (errorCode == np::SUCCESS)
-			{
-				std::cout << "     Probe initialized." << std::endl;
-				probes[i]->timestamp = 0;
-				probes[i]->eventCode = 0;
-				probes[i]->setStatus(ProbeStatus::CONNECTED);
-			}
-			else {
-				std::cout << "     Failed with error code " << errorCode << std::endl;
-			}
+	for (int channel = 0; channel < NUM_CHANNELS; channel++)
+	{
+		if (!forceFullRewrite && appliedStandby[channel] == int8_t(standby[channel]))
+			continue;
 
-			bool ledEnable = false;
-			errorCode = np::setHSLed(slot, probes[i]->port, ledEnable);
+		np::NP_ErrorCode ec = NPX2Backend::get().setStdb(basestation->slot, port, dock, channel, standby[channel]);
+		calls++;
 
+		if (ec != np::SUCCESS)
+		{
+			printf("Failed to set standby on ch: %d w/ error: %d\n", channel, ec);
+			appliedStandby[channel] = -1;
+		}
+		else
+		{
+			appliedStandby[channel] = int8_t(standby[channel]);
 		}
-
-		probesInitialized = true;
 	}
 
-	errorCode = np::arm(slot);
+	return calls;
 
 }
 
-void Basestation::startAcquisition()
+void Probe::invalidateChannelState()
 {
+	for (int ch = 0; ch < NUM_CHANNELS; ch++)
+		appliedBank[ch] = UNKNOWN_BANK;
+}
 
-	for (int i = 0; i < probes.size(); i++)
-	{
-		std::cout << "Probe " << int(probes[i]->port) << " Dock: " << int(probes[i]->dock) << " setting timestamp to 0" << std::endl;
-		probes[i]->timestamp = 0;
-		//std::cout << "... and clearing buffers" << std::endl;
-		probes[i]->stream->clear();
-		std::cout << "  Starting thread." << std::endl;
-		probes[i]->startThread();
-	}
+void Probe::invalidateConfiguration()
+{
+	invalidateChannelState();
 
-	errorCode = np::setSWTrigger(slot);
+	appliedReference = -1;
+	appliedReferenceBank = -1;
+	appliedHighPass = -1;
+	memset(appliedStandby, -1, sizeof(appliedStandby));
+}
+
+bool Probe::isApHighPassDisabled()
+{
+	return appliedHighPass == 1;
+}
+
+ElectrodeSelectionStatistics Probe::getElectrodeSelectionStatistics()
+{
+	const SpinLock::ScopedLockType lock(statsLock);
+	return electrodeStats;
+}
+
+ProbeConfigStatistics Probe::getConfigStatistics()
+{
+	const SpinLock::ScopedLockType lock(statsLock);
+	return configStats;
+}
+
+ProbeConfigTransaction::ProbeConfigTransaction(Probe* probe_)
+	: probe(probe_),
+	  hasElectrodes(false),
+	  hasReference(false),
+	  hasApFilter(false),
+	  hasStandby(false),
+	  forceFullRewrite(false)
+{
+	memset(standby, 0, sizeof(standby));
+}
+
+void ProbeConfigTransaction::setElectrodes(Array<int> channelStatus_, bool forceFullRewrite_)
+{
+	channelStatus = channelStatus_;
+	hasElectrodes = true;
+	forceFullRewrite |= forceFullRewrite_;
+}
+
+void ProbeConfigTransaction::setReference(np::channelreference_t reference_, np::electrodebanks_t referenceBank_)
+{
+	reference = reference_;
+	referenceBank = referenceBank_;
+	hasReference = true;
+}
+
+void ProbeConfigTransaction::setApFilter(bool disableHighPass_)
+{
+	disableHighPass = disableHighPass_;
+	hasApFilter = true;
+}
+
+void ProbeConfigTransaction::setStandby(int channel, bool standby_)
+{
+	if (!hasStandby)
+	{
+		//Channels that are not mentioned stay active
+		memset(standby, 0, sizeof(standby));
+		hasStandby = true;
+	}
+
+	if (channel >= 0 && channel < NUM_CHANNELS)
+		standby[channel] = standby_;
+}
+
+bool ProbeConfigTransaction::validate(String& error)
+{
+
+	if (hasElectrodes)
+	{
+		if (channelStatus.size() < NUM_ELECTRODES)
+		{
+			error = "electrode status has " + String(channelStatus.size()) + " entries, expected " + String(NUM_ELECTRODES);
+			return false;
+		}
+
+		//The internal reference electrode cannot record at the same time
+		if (hasReference && reference == np::INT_REF)
+		{
+			int refs[NUM_REF_ELECTRODES] = REF_ELECTRODES;
+			int refIndex = int(referenceBank) - 1;
+
+			if (refIndex >= 0 && refIndex < NUM_REF_ELECTRODES && channelStatus[refs[refIndex] - 1] == 1)
+			{
+				error = "electrode " + String(refs[refIndex]) + " is both selected and used as internal reference";
+				return false;
+			}
+		}
+	}
+
+	if (hasReference && reference == np::INT_REF)
+	{
+		if (int(referenceBank) < 1 || int(referenceBank) > NUM_REF_ELECTRODES)
+		{
+			error = "internal reference index " + String(int(referenceBank)) + " is out of range";
+			return false;
+		}
+	}
+
+	return true;
+
+}
+
+bool ProbeConfigTransaction::commit()
+{
+
+	String error;
+
+	if (!validate(error))
+	{
+		std::cout << "Rejected configuration for slot " << probe->basestation->slot << ", port " << probe->port
+			<< ", dock " << probe->dock << ": " << error << std::endl;
+
+		const SpinLock::ScopedLockType lock(probe->statsLock);
+		probe->configStats.failedCommits++;
+		return false;
+	}
+
+	int64 start = Time::getHighResolutionTicks();
+
+	int calls = 0;
+
+	if (hasElectrodes)
+		calls += probe->stageChannels(channelStatus, forceFullRewrite);
+
+	if (hasReference)
+		calls += probe->stageReferences(reference, referenceBank, forceFullRewrite);
+
+	if (hasApFilter)
+		calls += probe->stageApFilter(disableHighPass, forceFullRewrite);
+
+	if (hasStandby)
+		calls += probe->stageStandby(standby, forceFullRewrite);
+
+	bool success = true;
+
+	//Everything staged above goes out in a single shift register upload
+	if (calls > 0)
+	{
+		bool readCheck = false;
+		np::NP_ErrorCode ec = NPX2Backend::get().writeProbeConfiguration(probe->basestation->slot, probe->port, probe->dock, readCheck);
+		calls++;
+
+		if (ec != np::SUCCESS)
+		{
+			printf("Failed to write probe configuration w/ error: %d\n", ec);
+
+			//The shift register contents are no longer known
+			probe->invalidateConfiguration();
+			success = false;
+		}
+	}
+
+	float milliseconds = float(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0);
+
+	const SpinLock::ScopedLockType lock(probe->statsLock);
+
+	ProbeConfigStatistics& stats = probe->configStats;
+	stats.commits++;
+	if (!success)
+		stats.failedCommits++;
+	if (calls > 0)
+		stats.writes++;
+	stats.apiCalls += calls;
+	stats.lastCommitMs = milliseconds;
+	stats.maxCommitMs = jmax(stats.maxCommitMs, milliseconds);
+	stats.totalCommitMs += milliseconds;
+
+	return success;
+
+}
+
+ChannelTable::ChannelTable()
+{
+	sequence = 0;
+
+	for (int ch = 0; ch < NUM_CHANNELS; ch++)
+	{
+		for (int bank = 0; bank < NUM_BANKS; bank++)
+			electrodes[ch][bank].store(-1, std::memory_order_relaxed);
+		connectedBank[ch].store(-1, std::memory_order_relaxed);
+	}
+}
+
+void ChannelTable::publish(const ChannelTableSnapshot& table)
+{
+	uint32 seq = sequence.load(std::memory_order_relaxed);
+
+	sequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (int ch = 0; ch < NUM_CHANNELS; ch++)
+	{
+		for (int bank = 0; bank < NUM_BANKS; bank++)
+			electrodes[ch][bank].store(table.electrodes[ch][bank], std::memory_order_relaxed);
+		connectedBank[ch].store(table.connectedBank[ch], std::memory_order_relaxed);
+	}
+
+	sequence.store(seq + 2, std::memory_order_release);
+}
+
+void ChannelTable::read(ChannelTableSnapshot& table) const
+{
+	uint32 before;
+	uint32 after;
+
+	do
+	{
+		before = sequence.load(std::memory_order_acquire);
+
+		for (int ch = 0; ch < NUM_CHANNELS; ch++)
+		{
+			for (int bank = 0; bank < NUM_BANKS; bank++)
+				table.electrodes[ch][bank] = electrodes[ch][bank].load(std::memory_order_relaxed);
+			table.connectedBank[ch] = connectedBank[ch].load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = sequence.load(std::memory_order_relaxed);
+
+	} while ((before & 1) || before != after);
+
+	table.version = before / 2;
+}
+
+uint32 ChannelTable::getVersion() const
+{
+	return sequence.load(std::memory_order_acquire) / 2;
+}
+
+void Probe::setReferences(np::channelreference_t ref, np::electrodebanks_t bank)
+{
+	ProbeConfigTransaction transaction(this);
+	transaction.setReference(ref, bank);
+	transaction.commit();
+}
+
+TimestampUnwrapper::TimestampUnwrapper(int ticksPerSample_) : ticksPerSample(ticksPerSample_)
+{
+	reset();
+}
+
+void TimestampUnwrapper::reset()
+{
+	started = false;
+	lastTimestamp = 0;
+	ticks = 0;
+
+	discontinuities = 0;
+	backwardJumps = 0;
+	skippedTicks = 0;
+	lastSampleNumber = 0;
+}
+
+void TimestampUnwrapper::unwrap(const np::PacketInfo* packets, int64* sampleNumbers, int count)
+{
+
+	if (!started)
+	{
+		//Pretend the previous packet arrived exactly one sample earlier
+		lastTimestamp = packets[0].Timestamp - ticksPerSample;
+		ticks = int64(packets[0].Timestamp) - ticksPerSample;
+		started = true;
+	}
+
+	uint64 jumps = 0;
+	uint64 backwards = 0;
+	int64 skipped = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		//Unsigned subtraction handles the 32-bit rollover
+		int32 delta = int32(packets[i].Timestamp - lastTimestamp);
+		lastTimestamp = packets[i].Timestamp;
+
+		if (delta <= 0)
+		{
+			backwards++;
+			delta = ticksPerSample;
+		}
+
+		ticks += delta;
+		jumps += (delta != ticksPerSample);
+		skipped += delta - ticksPerSample;
+
+		sampleNumbers[i] = ticks;
+	}
+
+	if (ticksPerSample > 1)
+	{
+		for (int i = 0; i < count; i++)
+			sampleNumbers[i] /= ticksPerSample;
+	}
+
+	if (jumps + backwards > 0)
+	{
+		discontinuities.fetch_add(jumps + backwards, std::memory_order_relaxed);
+		backwardJumps.fetch_add(backwards, std::memory_order_relaxed);
+		skippedTicks.fetch_add(skipped, std::memory_order_relaxed);
+	}
+
+	lastSampleNumber.store(sampleNumbers[count - 1], std::memory_order_relaxed);
+
+}
+
+TimestampStatistics TimestampUnwrapper::getStatistics()
+{
+	TimestampStatistics stats;
+
+	stats.discontinuities = discontinuities.load(std::memory_order_relaxed);
+	stats.backwardJumps = backwardJumps.load(std::memory_order_relaxed);
+	stats.skippedSamples = skippedTicks.load(std::memory_order_relaxed) / ticksPerSample;
+	stats.lastSampleNumber = lastSampleNumber.load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+static const uint16_t packetErrorMasks[NUM_PACKET_ERROR_TYPES] = {
+	ELECTRODEPACKET_STATUS_ERR_COUNT,
+	ELECTRODEPACKET_STATUS_ERR_SERDES,
+	ELECTRODEPACKET_STATUS_ERR_LOCK,
+	ELECTRODEPACKET_STATUS_ERR_POP,
+	ELECTRODEPACKET_STATUS_ERR_SYNC
+};
+
+//ERR_POP is a firmware debug flag and does not indicate data loss
+static const uint16_t alertingErrorMask = ELECTRODEPACKET_STATUS_ERR_COUNT | ELECTRODEPACKET_STATUS_ERR_SERDES
+	| ELECTRODEPACKET_STATUS_ERR_LOCK | ELECTRODEPACKET_STATUS_ERR_SYNC;
+
+static const uint16_t allErrorMask = alertingErrorMask | ELECTRODEPACKET_STATUS_ERR_POP;
+
+PacketStatusMonitor::PacketStatusMonitor(Probe* probe_) : probe(probe_)
+{
+	alertThreshold = DEFAULT_ERROR_ALERT_THRESHOLD;
+	reset();
+}
+
+void PacketStatusMonitor::reset()
+{
+	packets = 0;
+	packetsWithErrors = 0;
+
+	for (int i = 0; i < NUM_PACKET_ERROR_TYPES; i++)
+		errors[i] = 0;
+
+	alerts = 0;
+
+	windowStart = Time::getMillisecondCounter();
+	lastAlert = windowStart.load() - ERROR_ALERT_INTERVAL_MS;
+	windowPackets = 0;
+	windowErrors = 0;
+}
+
+void PacketStatusMonitor::setAlertThreshold(float fraction)
+{
+	alertThreshold = fraction;
+}
+
+void PacketStatusMonitor::decode(const np::PacketInfo* packetInfo, int count)
+{
+
+	uint16_t anyErrors = 0;
+
+	for (int i = 0; i < count; i++)
+		anyErrors |= packetInfo[i].Status;
+
+	packets.fetch_add(count, std::memory_order_relaxed);
+	windowPackets.fetch_add(count, std::memory_order_relaxed);
+
+	//Error bits are rare, so the common case is a single OR per packet
+	if (anyErrors & allErrorMask)
+	{
+		uint64 errorCounts[NUM_PACKET_ERROR_TYPES] = {};
+		uint64 alerting = 0;
+
+		for (int i = 0; i < count; i++)
+		{
+			uint16_t status = packetInfo[i].Status;
+
+			for (int type = 0; type < NUM_PACKET_ERROR_TYPES; type++)
+				errorCounts[type] += (status & packetErrorMasks[type]) != 0;
+
+			alerting += (status & alertingErrorMask) != 0;
+		}
+
+		for (int type = 0; type < NUM_PACKET_ERROR_TYPES; type++)
+		{
+			if (errorCounts[type] > 0)
+				errors[type].fetch_add(errorCounts[type], std::memory_order_relaxed);
+		}
+
+		if (alerting > 0)
+		{
+			packetsWithErrors.fetch_add(alerting, std::memory_order_relaxed);
+			windowErrors.fetch_add(alerting, std::memory_order_relaxed);
+		}
+	}
+
+	uint32 now = Time::getMillisecondCounter();
+
+	if (now - windowStart.load(std::memory_order_relaxed) >= ERROR_RATE_WINDOW_MS)
+		checkErrorRate(now);
+
+}
+
+void PacketStatusMonitor::checkErrorRate(uint32 now)
+{
+
+	//Only one of the stream threads evaluates each window
+	uint32 start = windowStart.load(std::memory_order_relaxed);
+	if (!windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed))
+		return;
+
+	uint64 newPackets = windowPackets.exchange(0, std::memory_order_relaxed);
+	uint64 newErrors = windowErrors.exchange(0, std::memory_order_relaxed);
+
+	if (newPackets == 0 || float(newErrors) <= alertThreshold.load(std::memory_order_relaxed) * float(newPackets))
+		return;
+
+	if (now - lastAlert.load(std::memory_order_relaxed) < ERROR_ALERT_INTERVAL_MS)
+		return;
+
+	lastAlert.store(now, std::memory_order_relaxed);
+	alerts.fetch_add(1, std::memory_order_relaxed);
+
+	std::cout << "Slot " << probe->basestation->slot << ", port " << probe->port << ", dock " << probe->dock
+		<< ": " << newErrors << " of " << newPackets << " packets had errors in the last "
+		<< (now - start) << " ms" << std::endl;
+
+}
+
+PacketErrorCounters PacketStatusMonitor::getCounters()
+{
+	PacketErrorCounters counters;
+
+	counters.packets = packets.load(std::memory_order_relaxed);
+	counters.packetsWithErrors = packetsWithErrors.load(std::memory_order_relaxed);
+
+	for (int i = 0; i < NUM_PACKET_ERROR_TYPES; i++)
+		counters.errors[i] = errors[i].load(std::memory_order_relaxed);
+
+	counters.alerts = alerts.load(std::memory_order_relaxed);
+
+	return counters;
+}
+
+String PacketStatusMonitor::getErrorName(int errorType)
+{
+	switch (errorType)
+	{
+	case PACKET_ERR_COUNT:
+		return "Frame count";
+	case PACKET_ERR_SERDES:
+		return "Serdes";
+	case PACKET_ERR_LOCK:
+		return "Lock";
+	case PACKET_ERR_POP:
+		return "Pop";
+	case PACKET_ERR_SYNC:
+		return "Sync";
+	default:
+		return "Unknown";
+	}
+}
+
+ProbeStream::ProbeStream(Probe* probe_, np::streamsource_t source_) : probe(probe_), source(source_), buffer(nullptr)
+{
+	hasFirstPacket = false;
+	firstTimestamp = 0;
+	firstPacketTime = 0.0;
+
+
+	if (source == np::SourceLFP)
+	{
+		sampleRate = LFP_SAMPLERATE;
+		bitVolts = NPX2_LFP_BITVOLTS;
+	}
+	else
+	{
+		sampleRate = SAMPLERATE;
+		bitVolts = NPX2_BITVOLTS;
+	}
+
+	converter = new SampleConverter();
+	setOutputMode(SampleOutputMode::OUTPUT_LEGACY_SCALED);
+
+	unwrapper = new TimestampUnwrapper(source == np::SourceLFP ? LFP_TICKS_PER_SAMPLE : AP_TICKS_PER_SAMPLE);
+
+	ring = new SampleRing(NUM_CHANNELS, int(sampleRate) * DEFAULT_RING_CAPACITY_MS / 1000);
+
+	timestamp = 0;
+	eventCode = 0;
+
+	fifoPollInterval = jmax(1, int(sampleRate) / FIFO_POLLS_PER_SECOND);
+	packetsSinceFifoPoll = 0;
+	fifoCurrent = 0.0f;
+	fifoPeak = 0.0f;
+	fifoSum = 0;
+	fifoPolls = 0;
+
+	nextSampleNumber = -1;
+	maxGapFillSamples = int(sampleRate); //Longer gaps are only marked
+	memset(lastSample, 0, sizeof(lastSample));
+	gapCount = 0;
+	missingSamples = 0;
+	filledSamples = 0;
+	gapLogCount = 0;
+
+	packetBatchSize = SAMPLECOUNT;
+	resetBatchStatistics();
+
+	callbackHandle = nullptr;
+	pendingCallbackPackets = 0;
+	pendingCallbackSince = 0.0;
+
+}
+
+ProbeStream::~ProbeStream()
+{
+	stopPacketCallback();
+}
+
+void ProbeStream::reset()
+{
+	timestamp = 0;
+	eventCode = 0;
+
+	if (buffer != nullptr)
+		buffer->clear();
+
+	ring->reset();
+
+	unwrapper->reset();
+	resetBatchStatistics();
+
+	nextSampleNumber = -1;
+	memset(lastSample, 0, sizeof(lastSample));
+	gapCount = 0;
+	missingSamples = 0;
+	filledSamples = 0;
+
+	{
+		const SpinLock::ScopedLockType lock(gapLogLock);
+		gapLogCount = 0;
+	}
+
+	packetsSinceFifoPoll = 0;
+	getFifoStatistics(true);
+	fifoCurrent = 0.0f;
+
+	hasFirstPacket = false;
+}
+
+bool ProbeStream::getFirstPacket(uint32& timestamp_, double& hostTimeMs)
+{
+	if (!hasFirstPacket.load(std::memory_order_acquire))
+		return false;
+
+	timestamp_ = firstTimestamp;
+	hostTimeMs = firstPacketTime;
+	return true;
+}
+
+void ProbeStream::setPacketBatchSize(int packetsPerRead)
+{
+	packetBatchSize = jlimit(1, SAMPLECOUNT, packetsPerRead);
+}
+
+int ProbeStream::getPacketBatchSize()
+{
+	return packetBatchSize;
+}
+
+BatchStatistics ProbeStream::getBatchStatistics()
+{
+	BatchStatistics stats;
+
+	stats.reads = batchReads.load(std::memory_order_relaxed);
+	stats.emptyReads = emptyReads.load(std::memory_order_relaxed);
+	stats.packets = packetsRead.load(std::memory_order_relaxed);
+	stats.maxBatchSize = maxBatchSize.load(std::memory_order_relaxed);
+
+	for (int i = 0; i <= SAMPLECOUNT; i++)
+		stats.histogram[i] = batchHistogram[i].load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+void ProbeStream::resetBatchStatistics()
+{
+	batchReads = 0;
+	emptyReads = 0;
+	packetsRead = 0;
+	maxBatchSize = 0;
+
+	for (int i = 0; i <= SAMPLECOUNT; i++)
+		batchHistogram[i] = 0;
+}
+
+int ProbeStream::readPackets(bool batched)
+{
+
+	np::NP_ErrorCode ec;
+	size_t count = 0;
+
+	if (batched)
+	{
+		ec = NPX2Backend::get().readPackets(
+			probe->basestation->slot,
+			probe->port,
+			probe->dock,
+			source,
+			&pckinfo[0],
+			&data[0],
+			NUM_CHANNELS,
+			packetBatchSize.load(std::memory_order_relaxed),
+			&count);
+	}
+	else
+	{
+		size_t actualRead = 0;
+
+		ec = NPX2Backend::get().readPacket(
+			probe->basestation->slot,
+			probe->port,
+			probe->dock,
+			source,
+			&pckinfo[0],
+			&data[0],
+			NUM_CHANNELS,
+			&actualRead);
+
+		count = actualRead > 0 ? 1 : 0;
+	}
+
+	if (ec != np::SUCCESS || count == 0)
+	{
+		emptyReads.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	processPacketBlock(int(count));
+
+	return int(count);
+
+}
+
+void ProbeStream::processPacketBlock(int count)
+{
+
+	for (int i = 0; i < count; i++)
+	{
+		eventCodes[i] = (pckinfo[i].Status & ELECTRODEPACKET_STATUS_SYNC) ? SYNC_EVENT_BIT : 0;
+	}
+
+	if (!hasFirstPacket.load(std::memory_order_relaxed))
+	{
+		firstTimestamp = pckinfo[0].Timestamp;
+		firstPacketTime = Time::getMillisecondCounterHiRes();
+		hasFirstPacket.store(true, std::memory_order_release);
+	}
+
+	probe->statusMonitor->decode(pckinfo, count);
+	unwrapper->unwrap(pckinfo, timestamps, count);
+
+	// Push contiguous runs of packets, repairing the timeline wherever
+	// the hardware timestamps show that samples went missing.
+	int firstPacket = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (nextSampleNumber >= 0 && timestamps[i] > nextSampleNumber)
+		{
+			pushSamples(firstPacket, i - firstPacket);
+
+			const int16_t* holdSample = i > 0 ? &data[(i - 1) * NUM_CHANNELS] : lastSample;
+			repairGap(i, nextSampleNumber, timestamps[i] - nextSampleNumber, holdSample);
+
+			firstPacket = i;
+		}
+		nextSampleNumber = timestamps[i] + 1;
+	}
+
+	pushSamples(firstPacket, count - firstPacket);
+
+	if (probe->gapPolicy.load(std::memory_order_relaxed) == GapPolicy::GAP_HOLD_LAST)
+		memcpy(lastSample, &data[(count - 1) * NUM_CHANNELS], sizeof(lastSample));
+
+	eventCode = eventCodes[count - 1];
+	timestamp = timestamps[count - 1];
+
+	batchReads.fetch_add(1, std::memory_order_relaxed);
+	packetsRead.fetch_add(count, std::memory_order_relaxed);
+	batchHistogram[count].fetch_add(1, std::memory_order_relaxed);
+	if (maxBatchSize.load(std::memory_order_relaxed) < count)
+		maxBatchSize.store(count, std::memory_order_relaxed);
+
+	//The FIFO is sampled every fifoPollInterval packets instead of after every read
+	packetsSinceFifoPoll += count;
+
+	if (packetsSinceFifoPoll >= fifoPollInterval.load(std::memory_order_relaxed))
+	{
+		packetsSinceFifoPoll = 0;
+		pollFifoStatus();
+	}
+
+}
+
+void ProbeStream::pollFifoStatus()
+{
+
+	size_t packetsAvailable;
+	size_t headroom;
+
+	np::NP_ErrorCode ec = NPX2Backend::get().getPacketFifoStatus(
+		probe->basestation->slot,
+		probe->port,
+		probe->dock,
+		source,
+		&packetsAvailable,
+		&headroom);
+
+	if (ec != np::SUCCESS || packetsAvailable + headroom == 0)
+		return;
+
+	float fill = float(packetsAvailable) / float(packetsAvailable + headroom);
+
+	fifoCurrent.store(fill, std::memory_order_relaxed);
+
+	float peak = fifoPeak.load(std::memory_order_relaxed);
+	while (fill > peak && !fifoPeak.compare_exchange_weak(peak, fill, std::memory_order_relaxed))
+		;
+
+	fifoSum.fetch_add(uint64(fill * 1e6f), std::memory_order_relaxed);
+	fifoPolls.fetch_add(1, std::memory_order_relaxed);
+
+}
+
+FifoStatistics ProbeStream::getFifoStatistics(bool consume)
+{
+	FifoStatistics stats;
+
+	stats.current = fifoCurrent.load(std::memory_order_relaxed);
+
+	uint64 sum;
+
+	if (consume)
+	{
+		stats.peak = fifoPeak.exchange(0.0f, std::memory_order_relaxed);
+		stats.polls = fifoPolls.exchange(0, std::memory_order_relaxed);
+		sum = fifoSum.exchange(0, std::memory_order_relaxed);
+	}
+	else
+	{
+		stats.peak = fifoPeak.load(std::memory_order_relaxed);
+		stats.polls = fifoPolls.load(std::memory_order_relaxed);
+		sum = fifoSum.load(std::memory_order_relaxed);
+	}
+
+	stats.mean = stats.polls > 0 ? float(sum) / 1e6f / float(stats.polls) : stats.current;
+
+	//No poll since the last read: report the latest occupancy rather than an empty FIFO
+	if (stats.polls == 0)
+		stats.peak = stats.current;
+
+	return stats;
+}
+
+void ProbeStream::setFifoPollInterval(int packets)
+{
+	fifoPollInterval = jmax(1, packets);
+}
+
+void ProbeStream::setRingCapacity(int milliseconds)
+{
+	ring->setCapacity(jmax(SAMPLECOUNT, int(sampleRate * milliseconds / 1000)));
+}
+
+RingStatistics ProbeStream::getRingStatistics()
+{
+	return ring->getStatistics();
+}
+
+int ProbeStream::drain(float* scratch, int maxSamples)
+{
+	if (buffer == nullptr)
+		return 0;
+
+	return ring->read(buffer, converter, scratch, maxSamples);
+}
+
+void ProbeStream::setOutputMode(SampleOutputMode mode)
+{
+	outputMode = mode;
+
+	//Legacy scaling keeps the float data of earlier versions, which does not match the reported bit-volts
+	if (mode == SampleOutputMode::OUTPUT_MICROVOLTS)
+		converter->setScale(bitVolts);
+	else
+		converter->setScale(100.0f / 8192);
+}
+
+void ProbeStream::pushSamples(int firstPacket, int count)
+{
+	if (count > 0)
+	{
+		ring->write(
+			&data[firstPacket * NUM_CHANNELS],
+			&timestamps[firstPacket],
+			&eventCodes[firstPacket],
+			count);
+	}
+}
+
+void ProbeStream::repairGap(int packetIndex, int64 firstMissing, int64 missing, const int16_t* holdSample)
+{
+
+	GapPolicy policy = probe->gapPolicy.load(std::memory_order_relaxed);
+	bool fill = policy != GapPolicy::GAP_MARK_ONLY && missing <= maxGapFillSamples;
+
+	{
+		const SpinLock::ScopedLockType lock(gapLogLock);
+
+		GapEvent& gap = gapLog[gapLogCount % GAP_LOG_SIZE];
+		gap.sampleNumber = firstMissing;
+		gap.length = missing;
+		gap.filled = fill;
+		gapLogCount++;
+	}
+
+	gapCount.fetch_add(1, std::memory_order_relaxed);
+	missingSamples.fetch_add(missing, std::memory_order_relaxed);
+
+	if (!fill)
+	{
+		//The timestamps jump; flag the first sample after the gap
+		eventCodes[packetIndex] |= GAP_EVENT_BIT;
+		return;
+	}
+
+	int rows = int(jmin(int64(SAMPLECOUNT), missing));
+
+	for (int row = 0; row < rows; row++)
+	{
+		if (policy == GapPolicy::GAP_HOLD_LAST)
+			memcpy(&fillSamples[row * NUM_CHANNELS], holdSample, NUM_CHANNELS * sizeof(int16_t));
+		else
+			memset(&fillSamples[row * NUM_CHANNELS], 0, NUM_CHANNELS * sizeof(int16_t));
+	}
+
+	//Fill samples keep the current sync state and raise the gap line
+	uint64 fillEventCode = (eventCodes[packetIndex] & SYNC_EVENT_BIT) | GAP_EVENT_BIT;
+
+	for (int64 done = 0; done < missing; done += rows)
+	{
+		rows = int(jmin(int64(SAMPLECOUNT), missing - done));
+
+		for (int row = 0; row < rows; row++)
+		{
+			fillTimestamps[row] = firstMissing + done + row;
+			fillEventCodes[row] = fillEventCode;
+		}
+
+		ring->write(fillSamples, fillTimestamps, fillEventCodes, rows);
+	}
+
+	filledSamples.fetch_add(missing, std::memory_order_relaxed);
+
+}
+
+GapStatistics ProbeStream::getGapStatistics()
+{
+	GapStatistics stats;
+
+	stats.gaps = gapCount.load(std::memory_order_relaxed);
+	stats.missingSamples = missingSamples.load(std::memory_order_relaxed);
+	stats.filledSamples = filledSamples.load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+Array<GapEvent> ProbeStream::getRecentGaps()
+{
+	Array<GapEvent> gaps;
+
+	const SpinLock::ScopedLockType lock(gapLogLock);
+
+	uint64 count = gapLogCount;
+	uint64 first = count > GAP_LOG_SIZE ? count - GAP_LOG_SIZE : 0;
+
+	for (uint64 i = first; i < count; i++)
+		gaps.add(gapLog[i % GAP_LOG_SIZE]);
+
+	return gaps;
+}
+
+bool ProbeStream::startPacketCallback()
+{
+
+	pendingCallbackPackets = 0;
+	pendingCallbackSince = 0.0;
+
+	np::NP_ErrorCode ec = NPX2Backend::get().createProbePacketCallback(
+		probe->basestation->slot,
+		probe->port,
+		probe->dock,
+		source,
+		&callbackHandle,
+		&ProbeStream::packetCallback,
+		this);
+
+	if (ec != np::SUCCESS)
+	{
+		printf("Failed to register packet callback for slot %d, port %d, dock %d w/ error: %d\n", probe->basestation->slot, probe->port, probe->dock, ec);
+		callbackHandle = nullptr;
+		return false;
+	}
+
+	return true;
+
+}
+
+void ProbeStream::stopPacketCallback()
+{
+
+	if (callbackHandle == nullptr)
+		return;
+
+	NPX2Backend::get().destroyPacketCallback(&callbackHandle);
+	callbackHandle = nullptr;
+
+	//The callback can no longer run: flush any packets still waiting for a full batch
+	flushCallbackBatch();
+
+}
+
+void ProbeStream::flushCallbackBatch()
+{
+	if (pendingCallbackPackets > 0)
+		processPacketBlock(pendingCallbackPackets);
+
+	pendingCallbackPackets = 0;
+}
+
+void NP_APIC ProbeStream::packetCallback(const np::np_packet_t& packet, const void* userdata)
+{
+	ProbeStream* stream = (ProbeStream*) userdata;
+	stream->handleCallbackPacket(packet);
+}
+
+void ProbeStream::handleCallbackPacket(const np::np_packet_t& packet)
+{
+
+	size_t channelsRead = 0;
+
+	int16_t* packetData = &data[pendingCallbackPackets * NUM_CHANNELS];
+
+	np::NP_ErrorCode ec = NPX2Backend::get().unpackData(&packet, packetData, NUM_CHANNELS, &channelsRead);
+
+	if (ec != np::SUCCESS || channelsRead == 0)
+	{
+		emptyReads.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	pckinfo[pendingCallbackPackets].Timestamp = packet.hdr.timestamp;
+	pckinfo[pendingCallbackPackets].Status = packet.hdr.status;
+	pckinfo[pendingCallbackPackets].payloadlength = uint16_t(channelsRead);
+
+	double now = Time::getMillisecondCounterHiRes();
+
+	if (pendingCallbackPackets++ == 0)
+		pendingCallbackSince = now;
+
+	//Push a full batch, or a partial one once its oldest packet has waited long enough.
+	//Only the callback writes to the ring, so a batch that stalls waits for the next packet or stop.
+	if (pendingCallbackPackets >= packetBatchSize.load(std::memory_order_relaxed)
+		|| now - pendingCallbackSince >= CALLBACK_FLUSH_MS)
+		flushCallbackBatch();
+
+}
+
+Headstage::Headstage(Probe* probe_) : probe(probe_)
+{
+	getInfo();
+}
+
+Flex::Flex(Probe* probe_) : probe(probe_)
+{
+	getInfo();
+}
+
+BasestationConnectBoard::BasestationConnectBoard(Basestation* bs) : basestation(bs)
+{
+	getInfo();
+}
+
+
+Basestation::Basestation(int slot_number) : opened(false)
+{
+
+	slot = slot_number;
+
+	for (int port = 0; port < NUM_PORTS; port++)
+		for (int dock = 0; dock < NUM_DOCKS; dock++)
+			discovered[port][dock] = nullptr;
+
+	{
+		StartupProfiler::ScopedStage stage(slot, 0, 0, "openBS");
+		errorCode = NPX2Backend::get().openBS(slot);
+	}
+
+	if (errorCode == np::SUCCESS)
+	{
+
+		opened = true;
+
+		std::cout << "  Opened BS on slot " << slot << std::endl;
+
+		{
+			StartupProfiler::ScopedStage stage(slot, 0, 0, "Basestation getInfo");
+			getInfo();
+		}
+		{
+			StartupProfiler::ScopedStage stage(slot, 0, 0, "BSC getInfo");
+			basestationConnectBoard = new BasestationConnectBoard(this);
+		}
+
+		savingDirectory = File();
+
+	}
+
+	syncFrequencies.add(1);
+	syncFrequencies.add(10);
+}
+
+bool Basestation::isOpen()
+{
+	return opened;
+}
+
+void Basestation::discoverProbes()
+{
+	for (int port = 1; port <= NUM_PORTS; port++)
+		discoverPort(port);
+
+	collectDiscoveredProbes();
+}
+
+void Basestation::discoverPort(int port)
+{
+
+	if (!opened)
+		return;
+
+	for (int dock = 1; dock <= NUM_DOCKS; dock++)
+	{
+		{
+			StartupProfiler::ScopedStage stage(slot, port, dock, "openProbe");
+			errorCode = NPX2Backend::get().openProbe(slot, port, dock);
+		}
+
+		if (errorCode == np::SUCCESS)
+		{
+			Probe* probe = new Probe(this, port, dock);
+			if (probe->serial_number / NPX2_MIN_PROBE_SERIAL > 0)
+			{
+				probe->setStatus(ProbeStatus::CONNECTING);
+				discovered[port - 1][dock - 1] = probe;
+			}
+			else
+			{
+				delete probe;
+			}
+		}
+	}
+
+}
+
+void Basestation::collectDiscoveredProbes()
+{
+
+	if (!opened)
+		return;
+
+	//Same order as a sequential port/dock scan, whichever port finished first
+	for (int port = 0; port < NUM_PORTS; port++)
+	{
+		for (int dock = 0; dock < NUM_DOCKS; dock++)
+		{
+			if (discovered[port][dock] != nullptr)
+			{
+				probes.add(discovered[port][dock]);
+				discovered[port][dock] = nullptr;
+			}
+		}
+	}
+
+	std::cout << "Found " << String(probes.size()) << (probes.size() == 1 ? " probe." : " probes.") << std::endl;
+
+}
+
+void Basestation::init()
+{
+
+	if (diagnostics == nullptr)
+	{
+		diagnostics = new DiagnosticsPoller(this);
+		diagnostics->startThread();
+	}
+
+	errorCode = NPX2Backend::get().arm(slot);
+
+}
+
+Basestation::~Basestation()
+{
+	diagnostics = nullptr;
+
+	for (int i = 0; i < probes.size(); i++)
+	{
+		errorCode = NPX2Backend::get().closePort(slot, probes[i]->port);
+	}
+	errorCode = NPX2Backend::get().closeBS(slot);
+}
+
+DiagnosticsPoller::DiagnosticsPoller(Basestation* basestation_)
+	: Thread("Diagnostics " + String(basestation_->slot)),
+	  basestation(basestation_),
+	  interval(DIAGNOSTICS_INTERVAL_MS),
+	  hasPrevious(false),
+	  linkDegraded(false)
+{
+}
+
+DiagnosticsPoller::~DiagnosticsPoller()
+{
+	stopThread(interval + 1000);
+}
+
+void DiagnosticsPoller::setInterval(int milliseconds)
+{
+	interval = jmax(100, milliseconds);
+}
+
+void DiagnosticsPoller::run()
+{
+	while (!threadShouldExit())
+	{
+		poll();
+		wait(interval);
+	}
+}
+
+float DiagnosticsPoller::getRate(uint32_t current, uint32_t previous, float seconds)
+{
+	//The hardware counters are 32 bit and wrap around
+	return seconds > 0 ? float(uint32_t(current - previous)) / seconds : 0.0f;
+}
+
+void DiagnosticsPoller::poll()
+{
+
+	DiagnosticsSample sample = {};
+	sample.time = Time::currentTimeMillis();
+
+	np::NP_ErrorCode ec = NPX2Backend::get().dbg_diagstats_read(basestation->slot, &sample.counters);
+	sample.valid = (ec == np::SUCCESS);
+
+	for (int i = 0; i < basestation->probes.size(); i++)
+	{
+		Probe* probe = basestation->probes[i];
+
+		for (int source = np::SourceAP; source <= np::SourceLFP; source++)
+		{
+			if (source == np::SourceLFP && probe->lfpStream == nullptr)
+				continue;
+
+			SourceDiagnostics sd = {};
+			sd.port = probe->port;
+			sd.dock = probe->dock;
+			sd.source = np::streamsource_t(source);
+
+			//Sources are numbered per port, dock and stream in the order the basestation enumerates them
+			uint8_t sourceId = uint8_t((((probe->port - 1) * NUM_DOCKS) + (probe->dock - 1)) * 2 + source);
+
+			if (NPX2Backend::get().dbg_sourcestats_read(basestation->slot, sourceId, &sd.counters) == np::SUCCESS)
+				sample.sources.add(sd);
+		}
+	}
+
+	if (hasPrevious && sample.valid && previous.valid)
+	{
+		float seconds = float(sample.time - previous.time) / 1000.0f;
+		const np::np_diagstats& c = sample.counters;
+		const np::np_diagstats& p = previous.counters;
+
+		sample.bytesPerSecond = seconds > 0 ? float(c.totalbytes - p.totalbytes) / seconds : 0.0f;
+		sample.packetsPerSecond = getRate(c.packetcount, p.packetcount, seconds);
+		sample.badMagicPerSecond = getRate(c.err_badmagic, p.err_badmagic, seconds);
+		sample.badCrcPerSecond = getRate(c.err_badcrc, p.err_badcrc, seconds);
+		sample.droppedFramesPerSecond = getRate(c.err_droppedframes, p.err_droppedframes, seconds);
+		sample.countErrorsPerSecond = getRate(c.err_count, p.err_count, seconds);
+		sample.serdesErrorsPerSecond = getRate(c.err_serdes, p.err_serdes, seconds);
+		sample.lockErrorsPerSecond = getRate(c.err_lock, p.err_lock, seconds);
+		sample.syncErrorsPerSecond = getRate(c.err_sync, p.err_sync, seconds);
+
+		for (int i = 0; i < sample.sources.size(); i++)
+		{
+			SourceDiagnostics& sd = sample.sources.getReference(i);
+
+			for (int j = 0; j < previous.sources.size(); j++)
+			{
+				const SourceDiagnostics& prev = previous.sources.getReference(j);
+
+				if (prev.port == sd.port && prev.dock == sd.dock && prev.source == sd.source)
+				{
+					float sourceSeconds = float(uint32_t(sd.counters.timestamp - prev.counters.timestamp)) / SAMPLERATE;
+					if (sourceSeconds <= 0)
+						sourceSeconds = seconds;
+
+					sd.packetsPerSecond = getRate(sd.counters.packetcount, prev.counters.packetcount, sourceSeconds);
+					sd.samplesPerSecond = getRate(sd.counters.samplecount, prev.counters.samplecount, sourceSeconds);
+					sd.fifoOverflowsPerSecond = getRate(sd.counters.fifooverflow, prev.counters.fifooverflow, sourceSeconds);
+					break;
+				}
+			}
+		}
+
+		bool degraded = sample.droppedFramesPerSecond > 0 || sample.badCrcPerSecond > 0 || sample.lockErrorsPerSecond > 0;
+
+		if (degraded && !linkDegraded)
+			std::cout << "Slot " << basestation->slot << " link degraded: " << sample.droppedFramesPerSecond << " dropped frames/s, "
+				<< sample.badCrcPerSecond << " CRC errors/s, " << sample.lockErrorsPerSecond << " lock errors/s" << std::endl;
+		else if (!degraded && linkDegraded)
+			std::cout << "Slot " << basestation->slot << " link recovered" << std::endl;
+
+		linkDegraded = degraded;
+	}
+
+	previous = sample;
+	hasPrevious = true;
+
+	const ScopedLock lock(historyLock);
+
+	history.add(sample);
+
+	if (history.size() > DIAGNOSTICS_HISTORY)
+		history.removeRange(0, history.size() - DIAGNOSTICS_HISTORY);
+
+}
+
+DiagnosticsSample DiagnosticsPoller::getLatest()
+{
+	const ScopedLock lock(historyLock);
+
+	if (history.size() > 0)
+		return history.getLast();
+
+	DiagnosticsSample empty = {};
+	return empty;
+}
+
+Array<DiagnosticsSample> DiagnosticsPoller::getHistory()
+{
+	const ScopedLock lock(historyLock);
+	return history;
+}
+
+void Basestation::setSyncAsInput()
+{
+
+	errorCode = NPX2Backend::get().setParameter(np::NP_PARAM_SYNCMASTER, slot);
+	if (errorCode != np::SUCCESS)
+	{
+		printf("Failed to set slot %d as sync master!\n");
+		return;
+	}
+
+	errorCode = NPX2Backend::get().setParameter(np::NP_PARAM_SYNCSOURCE, np::SIGNALLINE_SMA);
+	if (errorCode != np::SUCCESS)
+		printf("Failed to set slot %d SMA as sync source!\n");
+
+}
+
+Array<int> Basestation::getSyncFrequencies()
+{
+	return syncFrequencies;
+}
+
+void Basestation::setSyncAsOutput(int freqIndex)
+{
+
+	//TODO: Can't find the corresponding calls in NPX2 API
+	/*
+	np1_error = NPX2Backend::get().setParameter(np::NP_PARAM_SYNCMASTER, slot);
+	if (np1_error != np::SUCCESS)
+	{
+		printf("Failed to set slot %d as sync master!\n", slot);
+		return;
+	} 
+
+	np1_error = NPX2Backend::get().setParameter(np::NP_PARAM_SYNCSOURCE, np::TRIGIN_SYNCCLOCK);
+	if (np1_error != np::SUCCESS)
+	{
+		printf("Failed to set slot %d internal clock as sync source!\n", slot);
+		return;
+	}
+
+	int freq = syncFrequencies[freqIndex];
+
+	printf("Setting slot %d sync frequency to %d Hz...\n", slot, freq);
+	np1_error = setParameter(np::NP_PARAM_SYNCFREQUENCY_HZ, freq);
+	if (np1_error != np::SUCCESS)
+	{
+		printf("Failed to set slot %d sync frequency to %d Hz!\n", slot, freq);
+		return;
+	}
+	*/
+
+}
+
+int Basestation::getProbeCount()
+{
+	return probes.size();
+}
+
+float Basestation::getFillPercentage()
+{
+	float perc = 0.0;
+
+	//Use the highest fifo percentage of all probes; each read consumes the probe's peak
+	for (int i = 0; i < getProbeCount(); i++)
+	{
+		float probePerc = probes[i]->getFillPercentage();
+
+		if (probePerc > perc)
+			perc = probePerc;
+	}
+
+	return perc;
+}
+
+void Basestation::armProbes()
+{
+
+	for (int i = 0; i < probes.size(); i++)
+	{
+		std::cout << "Arming probe on port " << int(probes[i]->port) << ", dock " << int(probes[i]->dock) << std::endl;
+		probes[i]->startAcquisition();
+	}
+
+}
+
+bool Basestation::isArmed()
+{
+	for (int i = 0; i < probes.size(); i++)
+	{
+		if (!probes[i]->isArmed())
+			return false;
+	}
+
+	return true;
+}
+
+void Basestation::trigger()
+{
+	errorCode = NPX2Backend::get().setSWTrigger(slot);
+}
+
+bool Basestation::setStartTrigger(StartTriggerMode mode, bool master)
+{
+
+	np::signalline_t input = mode == StartTriggerMode::START_HARDWARE_SYNCHRONIZED ? START_TRIGGER_LINE : np::SIGNALLINE_SW;
+
+	errorCode = NPX2Backend::get().setTriggerBinding(slot, np::SIGNALLINE_LOCALTRIGGER, input);
+	if (errorCode != np::SUCCESS)
+	{
+		printf("Failed to bind slot %d trigger input!\n", slot);
+		return false;
+	}
+
+	//Only the master drives the shared line; the other slots merely listen to it
+	np::signalline_t driven = mode == StartTriggerMode::START_HARDWARE_SYNCHRONIZED && master ? np::SIGNALLINE_SW : np::SIGNALLINE_NONE;
+
+	errorCode = NPX2Backend::get().setTriggerBinding(slot, START_TRIGGER_LINE, driven);
+	if (errorCode != np::SUCCESS)
+	{
+		printf("Failed to bind slot %d trigger output!\n", slot);
+		return false;
+	}
+
+	errorCode = NPX2Backend::get().setTriggerEdge(slot, true);
+	if (errorCode != np::SUCCESS)
+	{
+		printf("Failed to set slot %d trigger edge!\n", slot);
+		return false;
+	}
+
+	return true;
+}
+
+bool Basestation::getStartTime(SlotStartTime& start)
+{
+
+	start.slot = slot;
+	start.firstTimestamp = 0;
+	start.triggerTimeMs = 0.0;
+
+	bool first = true;
+
+	for (int i = 0; i < probes.size(); i++)
+	{
+		uint32 timestamp;
+		double hostTime;
+
+		if (!probes[i]->apStream->getFirstPacket(timestamp, hostTime))
+			return false;
+
+		//Read latency only ever delays the arrival, so the earliest estimate is the closest one
+		double triggerTime = hostTime - double(timestamp) * 1000.0 / double(probes[i]->apStream->sampleRate);
+
+		if (first || triggerTime < start.triggerTimeMs)
+		{
+			start.firstTimestamp = timestamp;
+			start.triggerTimeMs = triggerTime;
+			first = false;
+		}
+	}
 
+	return !first;
 }
 
 void Basestation::stopAcquisition()
 {
 	for (int i = 0; i < probes.size(); i++)
-		probes[i]->stopThread(1000);
+		probes[i]->stopAcquisition();
 
-	errorCode = np::arm(slot);
+	errorCode = NPX2Backend::get().arm(slot);
 }
 
-void Basestation::setChannels(int slot, int port, int dock, Array<int> channelStatus)
+void Basestation::setChannels(int slot, int port, int dock, Array<int> channelStatus, bool forceFullRewrite)
 {
 	if (slot == this->slot)
 	{
@@ -569,7 +2061,7 @@ void Basestation::setChannels(int slot, int port, int dock, Array<int> channelSt
 		{
 			if (probes[i]->port == port && probes[i]->dock == dock)
 			{
-				probes[i]->setChannels(channelStatus);
+				probes[i]->setChannels(channelStatus, forceFullRewrite);
 				std::cout << "Set electrode-channel connections " << std::endl;
 			}
 		}
@@ -597,40 +2089,40 @@ bool Basestation::runBist(int slot, int port, int dock, int bistIndex)
 			    }
 			    case BIST_NOISE:
 			    {
-			        if (np::bistNoise(slot, port, dock) == np::SUCCESS)
+			        if (NPX2Backend::get().bistNoise(slot, port, dock) == np::SUCCESS)
 			            returnValue = true;
 			        break;
 			    }
 			    case BIST_PSB:
 			    {
-			        if (np::bistPSB(slot, port, dock) == np::SUCCESS)
+			        if (NPX2Backend::get().bistPSB(slot, port, dock) == np::SUCCESS)
 			            returnValue = true;
 			        break;
 			    }
 			    case BIST_SR:
 			    {
-			        if (np::bistSR(slot, port, dock) == np::SUCCESS)
+			        if (NPX2Backend::get().bistSR(slot, port, dock) == np::SUCCESS)
 			            returnValue = true;
 			        break;
 			    }
 			    case BIST_EEPROM:
 			    {
-			        if (np::bistEEPROM(slot, port) == np::SUCCESS)
+			        if (NPX2Backend::get().bistEEPROM(slot, port) == np::SUCCESS)
 			            returnValue = true;
 			        break;
 			    }
 			    case BIST_I2C:
 			    {
-			        if (np::bistI2CMM(slot, port, dock) == np::SUCCESS)
+			        if (NPX2Backend::get().bistI2CMM(slot, port, dock) == np::SUCCESS)
 			            returnValue = true;
 			        break;
 			    }
 			    case BIST_SERDES:
 			    {
 			        int errors;
-			        np::bistStartPRBS(slot, port);
+			        NPX2Backend::get().bistStartPRBS(slot, port);
 			        std::this_thread::sleep_for(std::chrono::milliseconds(200));
-			        np::bistStopPRBS(slot, port, &errors);
+			        NPX2Backend::get().bistStopPRBS(slot, port, &errors);
 
 			        if (errors == 0)
 			            returnValue = true;
@@ -638,13 +2130,13 @@ bool Basestation::runBist(int slot, int port, int dock, int bistIndex)
 			    }
 			    case BIST_HB:
 			    {
-			        if (np::bistHB(slot, port, dock) == np::SUCCESS)
+			        if (NPX2Backend::get().bistHB(slot, port, dock) == np::SUCCESS)
 			            returnValue = true;
 			        break;
 			    } 
 			    case BIST_BS:
 			    {
-			        if (np::bistBS(slot) == np::SUCCESS)
+			        if (NPX2Backend::get().bistBS(slot) == np::SUCCESS)
 			            returnValue = true;
 			        break;
 			    } 
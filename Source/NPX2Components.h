@@ -27,8 +27,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <DataThreadHeaders.h>
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
 
-#include "npx2-api/NeuropixAPI.h"
+#include "NPX2Backend.h"
 
 /* DAQ PROPERTIES */
 #define MAX_NUM_SLOTS 			32
@@ -38,12 +39,46 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define NUM_DOCKS 				2
 #define NUM_CHANNELS 			384
 #define NUM_ELECTRODES 			1280
+#define NUM_BANKS 				4
 #define NUM_REF_ELECTRODES  	4
 #define REF_ELECTRODES      	{ 128, 508, 888, 1252 }
 #define SAMPLECOUNT 			64	
 #define SAMPLERATE              30000
+#define LFP_SAMPLERATE          (SAMPLERATE / PROBE_SUPERFRAMESIZE)
 #define NPX2_MIN_PROBE_SERIAL 	19000000000
 #define NPX2_BITVOLTS 			0.1950000f
+#define NPX2_LFP_BITVOLTS 		0.1950000f
+#define AP_TICKS_PER_SAMPLE 	1
+#define LFP_TICKS_PER_SAMPLE 	PROBE_SUPERFRAMESIZE
+
+/* EVENT CODES */
+#define SYNC_EVENT_BIT 			(1 << 0)
+#define GAP_EVENT_BIT 			(1 << 1)
+#define NUM_TTL_LINES 			2
+#define GAP_LOG_SIZE 			64
+
+/* PACKET ERROR ALERTS */
+#define ERROR_RATE_WINDOW_MS 	1000
+#define ERROR_ALERT_INTERVAL_MS 10000
+#define DEFAULT_ERROR_ALERT_THRESHOLD 0.001f
+
+/* FIFO MONITORING */
+#define FIFO_POLLS_PER_SECOND 	100
+
+/* PACKET CALLBACKS */
+#define CALLBACK_FLUSH_MS 		1.0 //Age at which the callback pushes a partial batch
+
+/* SAMPLE RING */
+#define DEFAULT_RING_CAPACITY_MS 250
+#define RING_DRAIN_SIZE 		256
+
+/* BASESTATION DIAGNOSTICS */
+#define DIAGNOSTICS_INTERVAL_MS 1000
+#define DIAGNOSTICS_HISTORY 	300
+
+/* ELECTRODE SELECTION */
+#define DISCONNECTED_BANK 		0xFF
+#define UNKNOWN_BANK 			-1
 
 /* SINGLE SHANK PROBE PROPERTIES */
 #define ELECTRODES_PER_BLOCK    32
@@ -51,10 +86,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define ROWS_PER_BLOCK 			16
 #define ELECTRODES_PER_ROW		2
 
+class Basestation;
 class BasestationConnectBoard;
 class Flex;
 class Headstage;
 class Probe;
+class SampleConverter;
+class SampleRing;
 
 class NeuropixComponent
 {
@@ -88,12 +126,136 @@ enum BISTS {
     
 };
 
+/* START TRIGGER */
+#define START_TRIGGER_LINE 		np::SIGNALLINE_PXI0
+
+typedef enum {
+	START_SOFTWARE,              //Each slot is started by its own software trigger, one after the other
+	START_HARDWARE_SYNCHRONIZED, //The master slot drives START_TRIGGER_LINE; every slot starts on its edge
+} StartTriggerMode;
+
+/** First hardware timestamp a slot produced after the trigger and the estimated host time
+	at which its timestamp counter was zero. */
+struct SlotStartTime
+{
+	int slot;
+	uint32 firstTimestamp;
+	double triggerTimeMs;
+};
+
+struct SourceDiagnostics
+{
+	int port;
+	int dock;
+	np::streamsource_t source;
+	np::np_sourcestats counters;  //Raw counters as read from the basestation
+	float packetsPerSecond;
+	float samplesPerSecond;
+	float fifoOverflowsPerSecond;
+};
+
+/** One sample of the basestation debug counters, with rates computed against the previous sample. */
+struct DiagnosticsSample
+{
+	int64 time;                   //Time::currentTimeMillis() when the counters were read
+	bool valid;                   //False if dbg_diagstats_read failed
+	np::np_diagstats counters;
+	float bytesPerSecond;
+	float packetsPerSecond;
+	float badMagicPerSecond;
+	float badCrcPerSecond;
+	float droppedFramesPerSecond;
+	float countErrorsPerSecond;
+	float serdesErrorsPerSecond;
+	float lockErrorsPerSecond;
+	float syncErrorsPerSecond;
+	Array<SourceDiagnostics> sources;
+};
+
+/** Low-rate thread that samples dbg_diagstats_read / dbg_sourcestats_read for one basestation
+	and keeps a rolling history of the resulting rates. */
+class DiagnosticsPoller : public Thread
+{
+public:
+	DiagnosticsPoller(Basestation* basestation);
+	~DiagnosticsPoller();
+
+	void run() override;
+
+	/** Returns the most recent sample; valid is false if none has been taken yet. */
+	DiagnosticsSample getLatest();
+
+	/** Returns up to DIAGNOSTICS_HISTORY samples, oldest first. */
+	Array<DiagnosticsSample> getHistory();
+
+	void setInterval(int milliseconds);
+
+private:
+	void poll();
+
+	static float getRate(uint32_t current, uint32_t previous, float seconds);
+
+	Basestation* basestation;
+	int interval;
+
+	bool hasPrevious;
+	DiagnosticsSample previous;
+	bool linkDegraded; //Logged when it changes, not on every poll
+
+	CriticalSection historyLock;
+	Array<DiagnosticsSample> history;
+};
+
+struct StartupTiming
+{
+	int slot;
+	int port;         //0 for basestation stages
+	int dock;         //0 for basestation and port stages
+	String stage;
+	float milliseconds;
+};
+
+/** Collects the duration of each hardware discovery stage; safe to use from several threads. */
+class StartupProfiler
+{
+public:
+	static void record(int slot, int port, int dock, const String& stage, float milliseconds);
+	static Array<StartupTiming> getTimings();
+	static void clear();
+
+	/** Records the time between construction and destruction as one stage. */
+	class ScopedStage
+	{
+	public:
+		ScopedStage(int slot, int port, int dock, const String& stage);
+		~ScopedStage();
+	private:
+		int slot;
+		int port;
+		int dock;
+		String stage;
+		int64 start;
+	};
+};
+
 class Basestation : public NeuropixComponent
 {
 public:
+	/** Opens the basestation and reads its info; probes are found by discoverProbes. */
 	Basestation(int slot);
 	~Basestation();
 
+	bool isOpen();
+
+	/** Opens every port and dock in sequence and fills probes. */
+	void discoverProbes();
+
+	/** Opens the docks of one port; different ports may be discovered concurrently. */
+	void discoverPort(int port);
+
+	/** Moves the probes found by discoverPort into probes, in port/dock order. */
+	void collectDiscoveredProbes();
+
 	int slot;
 	String boot_version;
 	void updateFirmware();
@@ -101,15 +263,16 @@ public:
 	ScopedPointer<BasestationConnectBoard> basestationConnectBoard;
 	OwnedArray<Probe> probes;
 
+	/** Starts the diagnostics poller and arms the basestation. Its probes must have been
+		initialized with Probe::init first. */
 	void init();
 
 	float getTemperature();
 
 	int getProbeCount();
-	void initializeProbes();
 
 	bool runBist(int slot, int port, int dock, int bistIndex);
-	void setChannels(int slot, int port, int dock, Array<int> channelStatus);
+	void setChannels(int slot, int port, int dock, Array<int> channelStatus, bool forceFullRewrite = false);
 	void setReferences(int slot, int port, int dock, np::channelreference_t ref, np::electrodebanks_t bank);
 	void setGains(int slot, int port, int dock, unsigned char apGain, unsigned char lfpGain);
 	void setApFilterState(int slot, int port, int dock, bool filterState);
@@ -118,7 +281,18 @@ public:
 	void setSyncAsOutput(int freqIndex);
 	Array<int> getSyncFrequencies();
 
-	void startAcquisition();
+	/** Arms every probe; no data flows until trigger is called. */
+	void armProbes();
+	bool isArmed();
+	void trigger();
+
+	/** Binds the local trigger to the software trigger (START_SOFTWARE) or to START_TRIGGER_LINE.
+		The master slot also drives START_TRIGGER_LINE from its software trigger. */
+	bool setStartTrigger(StartTriggerMode mode, bool master);
+
+	/** Fills start from the first AP packet of each probe; false until every probe has one. */
+	bool getStartTime(SlotStartTime& start);
+
 	void stopAcquisition();
 
 	void setSavingDirectory(File);
@@ -126,11 +300,14 @@ public:
 
 	float getFillPercentage();
 
+	ScopedPointer<DiagnosticsPoller> diagnostics;
+
 	void getInfo();
 	
 private:
 
-	bool probesInitialized;
+	bool opened;
+	Probe* discovered[NUM_PORTS][NUM_DOCKS];
 	Array<int> syncFrequencies;
 	File savingDirectory;
 };
@@ -156,28 +333,430 @@ typedef enum {
 	RECORDING, 	  //The prove is recording the streaming data
 } ProbeStatus;
 
+typedef enum {
+	SINGLE_PACKET,   //One np::readPacket call per sample
+	BATCHED_PACKETS, //np::readPackets drains up to packetBatchSize samples per call
+	PACKET_CALLBACK, //The API pushes packets through createProbePacketCallback, no probe thread
+} AcquisitionMode;
+
+typedef enum {
+	THREAD_PER_PROBE, //Every probe reads its FIFOs from its own thread
+	SHARED_POOL,      //An AcquisitionExecutor reads all probes on a fixed pool of workers
+} AcquisitionThreading;
+
+typedef enum {
+	GAP_MARK_ONLY,  //Leave the gap in the timestamps and raise the gap TTL line on the next sample
+	GAP_FILL_ZEROS, //Insert zero-valued samples for the missing range
+	GAP_HOLD_LAST,  //Repeat the last received sample for the missing range
+} GapPolicy;
+
+typedef enum {
+	OUTPUT_LEGACY_SCALED, //float = ADC * 100/8192, nominal bit-volts reported (previous behaviour)
+	OUTPUT_MICROVOLTS,    //float = ADC * bit-volts, so recorders recover the raw ADC value exactly
+} SampleOutputMode;
+
+struct ElectrodeSelectionStatistics
+{
+	uint64 updates;        //setChannels calls
+	uint64 fullRewrites;   //Updates that were forced to resend every channel
+	uint64 skippedWrites;  //Updates that changed nothing and skipped writeProbeConfiguration
+	uint64 apiCalls;       //selectElectrode + writeProbeConfiguration calls actually made
+	uint64 apiCallsSaved;  //Calls avoided compared to disconnecting and reconnecting every channel
+};
+
+/** Channel -> electrode table of a probe as published by setChannels. */
+struct ChannelTableSnapshot
+{
+	uint32 version;                             //Incremented on every setChannels
+	int16_t electrodes[NUM_CHANNELS][NUM_BANKS]; //Selected electrode per channel and bank, -1 if none
+	int8_t connectedBank[NUM_CHANNELS];          //Bank sent to the hardware, -1 if disconnected
+
+	/** Electrode the hardware records on a channel, -1 if disconnected. */
+	int getConnectedElectrode(int channel) const
+	{
+		int bank = connectedBank[channel];
+		return bank < 0 ? -1 : electrodes[channel][bank];
+	}
+};
+
+/** Fixed-size channel table with versioned, lock-free snapshots. A single configuration thread
+	publishes; any thread may read while acquisition is running. */
+class ChannelTable
+{
+public:
+	ChannelTable();
+
+	/** Replaces the table contents. Only one thread may publish at a time. */
+	void publish(const ChannelTableSnapshot& table);
+
+	/** Copies a consistent version of the table; retries while a publish is in progress. */
+	void read(ChannelTableSnapshot& table) const;
+
+	uint32 getVersion() const;
+
+private:
+	std::atomic<uint32> sequence; //Odd while a publish is in progress
+	std::atomic<int16_t> electrodes[NUM_CHANNELS][NUM_BANKS];
+	std::atomic<int8_t> connectedBank[NUM_CHANNELS];
+};
+
+struct ProbeConfigStatistics
+{
+	uint64 commits;       //Transactions committed
+	uint64 failedCommits; //Transactions rejected by validation or whose write failed
+	uint64 writes;        //writeProbeConfiguration calls
+	uint64 apiCalls;      //All configuration API calls, including the writes
+	float lastCommitMs;
+	float maxCommitMs;
+	float totalCommitMs;
+};
+
+/** Collects electrode, reference, AP filter and standby changes for one probe, validates them
+	and commits them with a single writeProbeConfiguration. Settings that match what the probe
+	already has are not resent; a transaction that changes nothing writes nothing. */
+class ProbeConfigTransaction
+{
+public:
+	ProbeConfigTransaction(Probe* probe);
+
+	void setElectrodes(Array<int> channelStatus, bool forceFullRewrite = false);
+	void setReference(np::channelreference_t reference, np::electrodebanks_t referenceBank);
+	void setApFilter(bool disableHighPass);
+	void setStandby(int channel, bool standby);
+
+	/** Checks the staged settings for consistency; error describes the first problem found. */
+	bool validate(String& error);
+
+	/** Validates, sends the changed settings and writes the probe configuration once. */
+	bool commit();
+
+private:
+	Probe* probe;
+
+	bool hasElectrodes;
+	bool hasReference;
+	bool hasApFilter;
+	bool hasStandby;
+	bool forceFullRewrite;
+
+	Array<int> channelStatus;
+	np::channelreference_t reference;
+	np::electrodebanks_t referenceBank;
+	bool disableHighPass;
+	bool standby[NUM_CHANNELS];
+};
+
+struct GapEvent
+{
+	int64 sampleNumber; //First missing sample
+	int64 length;       //Number of missing samples
+	bool filled;        //True if fill samples were inserted
+};
+
+struct GapStatistics
+{
+	uint64 gaps;           //Number of missing sample ranges
+	uint64 missingSamples; //Total samples missing from the hardware stream
+	uint64 filledSamples;  //Samples synthesized according to the gap policy
+};
+
+enum PacketErrorType {
+	PACKET_ERR_COUNT = 0, //PSB frame counter out of sequence
+	PACKET_ERR_SERDES,    //Deserializer error during reception
+	PACKET_ERR_LOCK,      //Deserializer lost lock
+	PACKET_ERR_POP,       //Round-robin FIFO empty on pop (debug only, not alerted)
+	PACKET_ERR_SYNC,      //Front-end receivers out of sync
+	NUM_PACKET_ERROR_TYPES
+};
+
+struct PacketErrorCounters
+{
+	uint64 packets;           //Packets decoded
+	uint64 packetsWithErrors; //Packets with at least one alerting error bit
+	uint64 errors[NUM_PACKET_ERROR_TYPES];
+	uint32 alerts;            //Number of times the error rate crossed the alert threshold
+};
+
+/** Classifies PacketInfo::Status words into error categories and keeps lock-free counters.
+	decode() may be called concurrently for the AP and LFP streams of the same probe. */
+class PacketStatusMonitor
+{
+public:
+	PacketStatusMonitor(Probe* probe);
+
+	void reset();
+
+	void decode(const np::PacketInfo* packets, int count);
+
+	PacketErrorCounters getCounters();
+
+	/** Fraction of packets with errors, measured over one second, above which an alert is raised. */
+	void setAlertThreshold(float fraction);
+
+	static String getErrorName(int errorType);
+
+private:
+	void checkErrorRate(uint32 now);
+
+	Probe* probe;
+
+	std::atomic<uint64> packets;
+	std::atomic<uint64> packetsWithErrors;
+	std::atomic<uint64> errors[NUM_PACKET_ERROR_TYPES];
+	std::atomic<uint32> alerts;
+
+	std::atomic<float> alertThreshold;
+	std::atomic<uint32> windowStart;
+	std::atomic<uint32> lastAlert;
+	std::atomic<uint64> windowPackets; //Accumulated since windowStart by both stream threads
+	std::atomic<uint64> windowErrors;
+};
+
+/** Hardware FIFO occupancy (0 to 1) sampled by the acquisition path. */
+struct FifoStatistics
+{
+	float current; //Most recent sample
+	float peak;    //Highest sample since the last consuming read
+	float mean;    //Mean of the samples since the last consuming read
+	uint32 polls;  //Number of samples since the last consuming read
+};
+
+/** Occupancy and overflow accounting of a stream's sample ring. */
+struct RingStatistics
+{
+	int capacity;          //Samples
+	int occupancy;         //Samples waiting for the consumer
+	int highWater;         //Highest occupancy since acquisition started
+	uint64 samplesWritten;
+	uint64 samplesRead;
+	uint64 samplesDropped; //Samples discarded because the ring was full
+	uint64 overflows;      //Number of separate overflow episodes
+	uint64 consumerStalls; //Drains cut short because the DataBuffer was full
+};
+
+/** Counters describing the batch sizes a probe thread actually achieved. */
+struct BatchStatistics
+{
+	uint64 reads;        //Number of read calls that returned data
+	uint64 emptyReads;   //Number of read calls that found the FIFO empty
+	uint64 packets;      //Total number of packets read
+	int maxBatchSize;    //Largest batch returned by a single read
+	uint64 histogram[SAMPLECOUNT + 1]; //Number of reads per batch size
+
+	float getMeanBatchSize() const { return reads > 0 ? float(packets) / float(reads) : 0.0f; }
+};
+
+struct TimestampStatistics
+{
+	uint64 discontinuities; //Packets whose timestamp did not follow the previous one by exactly one sample
+	uint64 backwardJumps;   //Packets whose timestamp was not later than the previous one
+	int64 skippedSamples;   //Samples missing between consecutive packets
+	int64 lastSampleNumber; //Sample number of the most recent packet
+};
+
+/** Extends the 32-bit PacketInfo::Timestamp into a monotonic 64-bit sample number. */
+class TimestampUnwrapper
+{
+public:
+	TimestampUnwrapper(int ticksPerSample);
+
+	void reset();
+
+	/** Writes the sample number of each packet to sampleNumbers. */
+	void unwrap(const np::PacketInfo* packets, int64* sampleNumbers, int count);
+
+	TimestampStatistics getStatistics();
+
+private:
+	int ticksPerSample;
+
+	bool started;
+	uint32 lastTimestamp;
+	int64 ticks;
+
+	std::atomic<uint64> discontinuities;
+	std::atomic<uint64> backwardJumps;
+	std::atomic<int64> skippedTicks;
+	std::atomic<int64> lastSampleNumber;
+};
+
+/** One hardware stream (AP or LFP) of a probe, feeding its own DataBuffer. */
+class ProbeStream
+{
+public:
+	ProbeStream(Probe* probe, np::streamsource_t source);
+	~ProbeStream();
+
+	Probe* probe;
+	np::streamsource_t source;
+
+	DataBuffer* buffer;
+	float sampleRate;
+	float bitVolts; //Nominal microvolts per ADC count
+
+	int64 timestamp;
+	uint64 eventCode;
+
+	ScopedPointer<SampleConverter> converter;
+	ScopedPointer<TimestampUnwrapper> unwrapper;
+	ScopedPointer<SampleRing> ring;
+
+	/** Clears the buffer, timestamp and counters before acquisition starts. */
+	void reset();
+
+	/** Reads one packet (single) or up to packetBatchSize packets and pushes them to the buffer.
+		Returns the number of packets read. */
+	int readPackets(bool batched);
+
+	/** Registers/unregisters the packet callback used in PACKET_CALLBACK mode. */
+	bool startPacketCallback();
+	void stopPacketCallback();
+
+	/** Sets the maximum number of packets drained per np::readPackets call (1 to SAMPLECOUNT). */
+	void setPacketBatchSize(int packetsPerRead);
+	int getPacketBatchSize();
+
+	BatchStatistics getBatchStatistics();
+	void resetBatchStatistics();
+
+	GapStatistics getGapStatistics();
+
+	/** Returns up to GAP_LOG_SIZE of the most recent gaps, oldest first. */
+	Array<GapEvent> getRecentGaps();
+
+	/** Returns the FIFO occupancy; consume restarts the peak and mean accumulation. */
+	FifoStatistics getFifoStatistics(bool consume);
+
+	/** Sets how many packets are read between two np::getPacketFifoStatus calls. */
+	void setFifoPollInterval(int packets);
+
+	/** Resizes the sample ring to hold the given duration of data; only call while stopped. */
+	void setRingCapacity(int milliseconds);
+	RingStatistics getRingStatistics();
+
+	/** Consumer side: converts up to maxSamples from the ring into the DataBuffer.
+		scratch must hold maxSamples * NUM_CHANNELS floats. */
+	int drain(float* scratch, int maxSamples);
+
+	/** Selects how the int16 samples are scaled at the DataBuffer boundary; only call while stopped. */
+	void setOutputMode(SampleOutputMode mode);
+	SampleOutputMode getOutputMode() const { return outputMode; }
+
+	/** Raw timestamp and host arrival time of the first packet since reset. */
+	bool getFirstPacket(uint32& timestamp, double& hostTimeMs);
+
+	/** Bit-volts to report for the stream's channels. */
+	float getBitVolts() const { return bitVolts; }
+
+private:
+
+	void pollFifoStatus();
+
+	std::atomic<bool> hasFirstPacket;
+	uint32 firstTimestamp;
+	double firstPacketTime;
+
+	void processPacketBlock(int count);
+
+	void pushSamples(int firstPacket, int count);
+	void repairGap(int packetIndex, int64 firstMissing, int64 missing, const int16_t* holdSample);
+
+	int64 nextSampleNumber; //-1 until the first packet has been pushed
+	int maxGapFillSamples;
+	int16_t lastSample[NUM_CHANNELS];
+	int16_t fillSamples[SAMPLECOUNT * NUM_CHANNELS];
+	int64 fillTimestamps[SAMPLECOUNT];
+	uint64 fillEventCodes[SAMPLECOUNT];
+
+	std::atomic<uint64> gapCount;
+	std::atomic<uint64> missingSamples;
+	std::atomic<uint64> filledSamples;
+	SpinLock gapLogLock; //Gaps are rare, so the reader can afford to take it
+	GapEvent gapLog[GAP_LOG_SIZE];
+	uint64 gapLogCount;
+
+	SampleOutputMode outputMode;
+
+	std::atomic<int> fifoPollInterval;
+	int packetsSinceFifoPoll;
+	std::atomic<float> fifoCurrent;
+	std::atomic<float> fifoPeak;
+	std::atomic<uint64> fifoSum;   //Sum of samples in parts per million
+	std::atomic<uint32> fifoPolls;
+
+	static void NP_APIC packetCallback(const np::np_packet_t& packet, const void* userdata);
+	void handleCallbackPacket(const np::np_packet_t& packet);
+
+	void flushCallbackBatch();
+
+	np::npcallbackhandle_t callbackHandle;
+	int pendingCallbackPackets;
+	double pendingCallbackSince; //Host time of the oldest pending packet
+
+	np::PacketInfo pckinfo[SAMPLECOUNT];
+	int16_t data[SAMPLECOUNT * NUM_CHANNELS];
+	int64 timestamps[SAMPLECOUNT];
+	uint64 eventCodes[SAMPLECOUNT];
+
+	std::atomic<int> packetBatchSize;
+
+	std::atomic<uint64> batchReads;
+	std::atomic<uint64> emptyReads;
+	std::atomic<uint64> packetsRead;
+	std::atomic<int> maxBatchSize;
+	std::atomic<uint64> batchHistogram[SAMPLECOUNT + 1];
+
+};
+
 class Probe : public NeuropixComponent, public Thread
 {
 public:
 	Probe(Basestation* bs, int port, int dock);
+	~Probe();
 
 	Basestation* basestation;
 	int port;
 	int dock;
 	int shank;
 
-	DataBuffer* stream;
-	int64 timestamp;
+	ScopedPointer<ProbeStream> apStream;
+	ScopedPointer<ProbeStream> lfpStream; //nullptr if the probe does not provide an LFP stream
 
 	ScopedPointer<Headstage> headstage;
 	ScopedPointer<Flex> flex;
 
 	int reference;
 
-	void init();
+	/** Runs np::init and puts the probe in recording mode. Probes on different ports
+		may be initialized concurrently. */
+	bool init();
+
+	/** Creates lfpStream if the hardware accepts SourceLFP for this probe. */
+	void detectLfpStream();
 
-	void setChannels(Array<int> channelStatus);
-	HashMap<int, Array<int>> channelMap;
+	/** Connects the electrodes flagged in channelStatus, sending only the channels whose
+		bank changed since the last call. forceFullRewrite resends every channel. */
+	void setChannels(Array<int> channelStatus, bool forceFullRewrite = false);
+	ChannelTable channelTable;
+
+	/** Forgets the applied electrode selection so the next setChannels rewrites every channel. */
+	void invalidateChannelState();
+
+	/** Forgets every applied setting, e.g. after init or a failed configuration write. */
+	void invalidateConfiguration();
+
+	ElectrodeSelectionStatistics getElectrodeSelectionStatistics();
+	ProbeConfigStatistics getConfigStatistics();
+
+	/** Staging calls used by ProbeConfigTransaction: each sends the per-channel API calls whose
+		setting differs from what was last applied, without writing the probe configuration.
+		Returns the number of API calls made. */
+	int stageChannels(const Array<int>& channelStatus, bool forceFullRewrite);
+	int stageReferences(np::channelreference_t ref, np::electrodebanks_t bank, bool forceFullRewrite);
+	int stageApFilter(bool disableHighPass, bool forceFullRewrite);
+	int stageStandby(const bool* standby, bool forceFullRewrite);
+
+	bool isApHighPassDisabled();
 
 	Array<int> apGains;
 	Array<int> lfpGains;
@@ -194,22 +773,50 @@ public:
 
 	int channel_count;
 
-	float fifoFillPercentage;
+	/** Returns the highest FIFO fill fraction of the probe's streams. */
+	float getFillPercentage();
 
 	String name;
 
 	void run();
 
-	uint64 eventCode;
+	/** Reads the next AP batch, and the LFP FIFO once a superframe of AP samples has gone
+		by. Callers must not overlap. Returns the number of AP packets read. */
+	int readNext();
+
+	AcquisitionMode acquisitionMode;
+	AcquisitionThreading acquisitionThreading; //Ignored in PACKET_CALLBACK mode
+	std::atomic<bool> armed;
+
+	void setPacketBatchSize(int packetsPerRead);
+
+	std::atomic<GapPolicy> gapPolicy; //Set by the GUI, read by the reader
+
+	ScopedPointer<PacketStatusMonitor> statusMonitor;
+
+	/** Resets the streams and starts reading packets; isArmed turns true once the reader is running.
+		With SHARED_POOL threading the reading is left to an AcquisitionExecutor. */
+	void startAcquisition();
+	void stopAcquisition();
+
+	bool isArmed();
 
 private:
 	 
 	Array<int> gains;
 
-	np::PacketInfo pckinfo[SAMPLECOUNT];
-	int16_t data[NUM_CHANNELS];
-	size_t samplesToRead = NUM_CHANNELS;
-	size_t actualRead;
+	int apPacketsSinceLfpRead;
+
+	int appliedBank[NUM_CHANNELS]; //Bank each channel was last connected to, UNKNOWN_BANK if not known
+	int appliedReference;          //-1 if not known
+	int appliedReferenceBank;
+	int appliedHighPass;           //1 if the AP high pass is disabled, -1 if not known
+	int8_t appliedStandby[NUM_CHANNELS];
+	SpinLock statsLock; //Configuration runs on scheduler workers while the GUI reads the statistics
+	ElectrodeSelectionStatistics electrodeStats;
+	ProbeConfigStatistics configStats;
+
+	friend class ProbeConfigTransaction;
 
 };
 
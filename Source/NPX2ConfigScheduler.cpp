@@ -0,0 +1,170 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "NPX2ConfigScheduler.h"
+
+class ConfigScheduler::Lane : public ThreadPoolJob
+{
+public:
+	Lane(int key_) : ThreadPoolJob("Config lane " + String(key_)), key(key_), remaining(nullptr), done(nullptr), runStart(0) {}
+
+	struct Job
+	{
+		int index; //Position in the scheduler's queue
+		ConfigJobTiming timing;
+		std::function<bool()> function;
+	};
+
+	JobStatus runJob() override
+	{
+		for (int i = 0; i < jobs.size(); i++)
+		{
+			Job& job = jobs.getReference(i);
+
+			int64 start = Time::getHighResolutionTicks();
+			job.timing.success = job.function();
+			int64 end = Time::getHighResolutionTicks();
+
+			job.timing.waitMs = float(Time::highResolutionTicksToSeconds(start - runStart) * 1000.0);
+			job.timing.durationMs = float(Time::highResolutionTicksToSeconds(end - start) * 1000.0);
+		}
+
+		//The last lane to finish releases the barrier
+		if (remaining->fetch_sub(1) == 1)
+			done->signal();
+
+		return jobHasFinished;
+	}
+
+	int key;
+	Array<Job> jobs;
+
+	std::atomic<int>* remaining;
+	WaitableEvent* done;
+	int64 runStart;
+};
+
+ConfigScheduler::ConfigScheduler(LaneGranularity granularity_, int maxWorkers_)
+	: granularity(granularity_), maxWorkers(jmax(1, maxWorkers_)), numJobs(0), elapsedMs(0)
+{
+}
+
+ConfigScheduler::~ConfigScheduler()
+{
+}
+
+int ConfigScheduler::getLaneKey(int slot, int port) const
+{
+	switch (granularity)
+	{
+	case LANE_PER_PORT:
+		return slot * (NUM_PORTS + 1) + port;
+	case LANE_PER_SLOT:
+		return slot;
+	default:
+		return 0;
+	}
+}
+
+void ConfigScheduler::add(int slot, int port, int dock, const String& name, std::function<bool()> job)
+{
+	int key = getLaneKey(slot, port);
+
+	Lane* lane = nullptr;
+
+	for (int i = 0; i < lanes.size(); i++)
+	{
+		if (lanes[i]->key == key)
+		{
+			lane = lanes[i];
+			break;
+		}
+	}
+
+	if (lane == nullptr)
+		lane = lanes.add(new Lane(key));
+
+	Lane::Job entry;
+	entry.index = numJobs++;
+	entry.timing.slot = slot;
+	entry.timing.port = port;
+	entry.timing.dock = dock;
+	entry.timing.name = name;
+	entry.timing.success = false;
+	entry.timing.waitMs = 0;
+	entry.timing.durationMs = 0;
+	entry.function = job;
+
+	lane->jobs.add(entry);
+}
+
+bool ConfigScheduler::run()
+{
+
+	timings.clear();
+	elapsedMs = 0;
+
+	if (lanes.size() == 0)
+		return true;
+
+	int64 start = Time::getHighResolutionTicks();
+
+	std::atomic<int> remaining(lanes.size());
+	WaitableEvent done;
+
+	{
+		ThreadPool pool(jmin(maxWorkers, lanes.size()));
+
+		for (int i = 0; i < lanes.size(); i++)
+		{
+			lanes[i]->remaining = &remaining;
+			lanes[i]->done = &done;
+			lanes[i]->runStart = start;
+			pool.addJob(lanes[i], false);
+		}
+
+		done.wait();
+	}
+
+	elapsedMs = float(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0);
+
+	//Report in submission order regardless of which lane ran first
+	timings.insertMultiple(0, ConfigJobTiming(), numJobs);
+
+	bool success = true;
+
+	for (int i = 0; i < lanes.size(); i++)
+	{
+		for (auto& job : lanes[i]->jobs)
+		{
+			timings.set(job.index, job.timing);
+			success &= job.timing.success;
+		}
+	}
+
+	lanes.clear();
+	numJobs = 0;
+
+	return success;
+
+}
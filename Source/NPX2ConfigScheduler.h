@@ -0,0 +1,99 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NPX2CONFIGSCHEDULER_H__
+#define __NPX2CONFIGSCHEDULER_H__
+
+#include <DataThreadHeaders.h>
+#include <atomic>
+#include <functional>
+
+#include "NPX2Components.h"
+
+#define MAX_CONFIG_WORKERS 		16
+
+typedef enum {
+	LANE_PER_PORT,  //Probes on different ports run concurrently; docks of one port run in order
+	LANE_PER_SLOT,  //One lane per basestation
+	LANE_SERIAL     //Everything in order on a single worker
+} LaneGranularity;
+
+struct ConfigJobTiming
+{
+	int slot;
+	int port;
+	int dock;
+	String name;
+	bool success;
+	float waitMs;     //Time between ConfigScheduler::run and the job starting
+	float durationMs; //Time spent in the job itself
+};
+
+/**
+
+	Runs per-probe configuration jobs on a bounded pool of workers.
+
+	Jobs are grouped into lanes; jobs of one lane run in the order they were added,
+	and different lanes run concurrently. run() is a barrier: it returns once every
+	lane has drained, and the per-job timings are then available.
+
+*/
+class ConfigScheduler
+{
+public:
+	ConfigScheduler(LaneGranularity granularity = LANE_PER_PORT, int maxWorkers = MAX_CONFIG_WORKERS);
+	~ConfigScheduler();
+
+	/** Queues a job for a probe; returns false from the job to report a failure. */
+	void add(int slot, int port, int dock, const String& name, std::function<bool()> job);
+
+	/** Runs every queued job and waits for all of them. Returns true if all jobs succeeded. */
+	bool run();
+
+	/** Timings of the jobs executed by the last run, in the order they were added. */
+	Array<ConfigJobTiming> getTimings() const { return timings; }
+
+	/** Wall-clock duration of the last run. */
+	float getElapsedMs() const { return elapsedMs; }
+
+	int getNumLanes() const { return lanes.size(); }
+
+private:
+
+	class Lane;
+
+	int getLaneKey(int slot, int port) const;
+
+	LaneGranularity granularity;
+	int maxWorkers;
+
+	OwnedArray<Lane> lanes;
+	int numJobs;
+
+	Array<ConfigJobTiming> timings;
+	float elapsedMs;
+
+	JUCE_DECLARE_NON_COPYABLE(ConfigScheduler);
+};
+
+#endif  // __NPX2CONFIGSCHEDULER_H__
@@ -26,6 +26,7 @@
 
 #include "NPX2Thread.h"
 #include "NPX2Editor.h"
+#include "NPX2ElectrodeMap.h"
 
 #define ZOOMED_CHANNEL_XOFFSET      240
 
@@ -107,7 +108,7 @@ void EditorBackground::paint(Graphics& g)
 
 }
 
-FifoMonitor::FifoMonitor(int id_, NPX2Thread* thread_) : id(id_), thread(thread_), fillPercentage(0.0)
+FifoMonitor::FifoMonitor(int id_, NPX2Thread* thread_) : id(id_), thread(thread_), fillPercentage(0.0), errorAlerts(0)
 {
     startTimer(500); // update fill percentage every 0.5 seconds
 }
@@ -119,6 +120,13 @@ void FifoMonitor::timerCallback()
     if (slot != 255)
     {
         setFillPercentage(thread->getFillPercentage(slot));
+
+        uint32 alerts = thread->getErrorAlertCount(slot);
+
+        if (alerts > errorAlerts)
+            CoreServices::sendStatusMessage("Slot " + String(slot) + ": packet error rate above threshold");
+
+        errorAlerts = alerts;
     }
 }
 
@@ -254,7 +262,12 @@ BackgroundLoader::~BackgroundLoader()
 void BackgroundLoader::run()
 {
     /* Open the NPX-PXI probe connections in the background to prevent this plugin from blocking the main GUI*/
-    np->openConnection();
+    np->openConnection([](Probe* probe, bool success, int completed, int total)
+    {
+        CoreServices::sendStatusMessage("Initialized probe " + String(completed) + "/" + String(total)
+            + " (slot " + String(probe->basestation->slot) + ", port " + String(probe->port)
+            + ", dock " + String(probe->dock) + ")" + (success ? "" : " FAILED"));
+    });
 
     /* Apply any saved settings */
     CoreServices::sendStatusMessage("Restoring saved probe settings...");
@@ -479,6 +492,14 @@ void NPX2Editor::saveEditorParameters(XmlElement* xml)
         xmlNode->setAttribute("Slot" + String(slot) + "Directory", directory_name);
     }
 
+    xmlNode->setAttribute("AcquisitionMode", int(thread->getAcquisitionMode()));
+    xmlNode->setAttribute("PacketBatchSize", thread->getPacketBatchSize());
+    xmlNode->setAttribute("AcquisitionThreading", int(thread->getAcquisitionThreading()));
+    xmlNode->setAttribute("CoreBudget", thread->getCoreBudget());
+    xmlNode->setAttribute("RingCapacity", thread->getRingCapacity());
+    xmlNode->setAttribute("OutputMode", int(thread->getOutputMode()));
+    xmlNode->setAttribute("StartTrigger", int(thread->getStartTriggerMode()));
+
 }
 
 void NPX2Editor::loadEditorParameters(XmlElement* xml)
@@ -497,6 +518,18 @@ void NPX2Editor::loadEditorParameters(XmlElement* xml)
                 directoryButtons[slot]->setLabel(directory.getFullPathName().substring(0, 2));
                 savingDirectories.set(slot, directory);
             }
+
+            thread->setAcquisitionMode(static_cast<AcquisitionMode>(
+                xmlNode->getIntAttribute("AcquisitionMode", AcquisitionMode::BATCHED_PACKETS)));
+            thread->setPacketBatchSize(xmlNode->getIntAttribute("PacketBatchSize", SAMPLECOUNT));
+            thread->setAcquisitionThreading(static_cast<AcquisitionThreading>(
+                xmlNode->getIntAttribute("AcquisitionThreading", AcquisitionThreading::THREAD_PER_PROBE)));
+            thread->setCoreBudget(xmlNode->getIntAttribute("CoreBudget", 0));
+            thread->setRingCapacity(xmlNode->getIntAttribute("RingCapacity", DEFAULT_RING_CAPACITY_MS));
+            thread->setOutputMode(static_cast<SampleOutputMode>(
+                xmlNode->getIntAttribute("OutputMode", SampleOutputMode::OUTPUT_LEGACY_SCALED)));
+            thread->setStartTriggerMode(static_cast<StartTriggerMode>(
+                xmlNode->getIntAttribute("StartTrigger", StartTriggerMode::START_SOFTWARE)));
         }
     }
 }
@@ -1069,6 +1102,9 @@ void NPX2Interface::buttonClicked(Button* button)
                     }
                     else
                     {
+                        if (button == enableButton)
+                            disableConflictingElectrodes(i);
+
                         channelStatus.set(i, button == enableButton ? 1 : 0);
                     }
                 }
@@ -1949,25 +1985,27 @@ void NPX2Interface::timerCallback()
 int NPX2Interface::getChannelForElectrode(int ch)
 {
     // returns actual mapped channel for individual electrode
-    if (ch < NUM_CHANNELS)
-        return ch;
-    else if (ch >= NUM_CHANNELS && ch < 2 * NUM_CHANNELS)
-        return ch - NUM_CHANNELS;
-    else
-        return ch - NUM_CHANNELS * 2;
-    
+    return ElectrodeMap::getChannel(ch);
 }
 
 int NPX2Interface::getConnectionForChannel(int ch)
 {
+    // returns the bank an electrode is connected through
+    return ElectrodeMap::getBank(ch);
+}
 
-    if (ch < NUM_CHANNELS)
-        return 0;
-    else if (ch >= NUM_CHANNELS && ch < 2 * NUM_CHANNELS)
-        return 1;
-    else
-        return 2;
-  
+void NPX2Interface::disableConflictingElectrodes(int electrode)
+{
+    // only one electrode per channel can be connected
+    int channel = getChannelForElectrode(electrode);
+
+    for (int bank = 0; bank < NUM_BANKS; bank++)
+    {
+        int other = ElectrodeMap::getElectrode(channel, bank);
+
+        if (other >= 0 && other != electrode && channelStatus[other] == 1)
+            channelStatus.set(other, 0);
+    }
 }
 
 void NPX2Interface::saveParameters(XmlElement* xml)
@@ -2023,6 +2061,9 @@ void NPX2Interface::saveParameters(XmlElement* xml)
 
     xmlNode->setAttribute("visualizationMode", visualizationMode);
 
+    xmlNode->setAttribute("gapPolicy", int(thread->getGapPolicy(slot, port, dock)));
+    xmlNode->setAttribute("disableHighPass", thread->isApHighPassDisabled(slot, port, dock));
+
     // annotations
     for (int i = 0; i < annotations.size(); i++)
     {
@@ -2088,6 +2129,9 @@ void NPX2Interface::loadParameters(XmlElement* xml)
                     referenceComboBox->setSelectedId(referenceChannelIndex, dontSendNotification);
                 }
                 thread->p_settings.refChannelIndex = referenceChannelIndex - 1;
+
+                thread->p_settings.gapPolicy = xmlNode->getIntAttribute("gapPolicy", GapPolicy::GAP_FILL_ZEROS);
+                thread->p_settings.disableHighPass = xmlNode->getBoolAttribute("disableHighPass", false);
                 
                 forEachXmlChildElement(*xmlNode, annotationNode)
                 {
@@ -148,6 +148,7 @@ private:
     float fillPercentage;
     NPX2Thread* thread;
     int id;
+    uint32 errorAlerts;
 };
 
 class NPX2Canvas : public Visualizer, public Button::Listener
@@ -311,6 +312,7 @@ private:
 
     int getChannelForElectrode(int);
     int getConnectionForChannel(int);
+    void disableConflictingElectrodes(int electrode);
 
 };
 
@@ -0,0 +1,131 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NPX2ELECTRODEMAP_H__
+#define __NPX2ELECTRODEMAP_H__
+
+#include <stdint.h>
+
+#include "NPX2Components.h"
+
+/**
+
+	Electrode <-> (channel, bank) mapping of a single shank NPX 2.0 probe, as defined
+	in Neuropixels_2_0_System_User_API_V0_3 p. 13/83.
+
+	Both directions are generated at compile time from the bank formulas, so the
+	probe configuration and the editor read the same tables.
+
+*/
+namespace ElectrodeMap
+{
+
+	/** Channel that an electrode is routed to within its bank. */
+	constexpr int computeChannel(int electrode)
+	{
+		int bank = electrode / NUM_CHANNELS;
+		int block = (electrode % NUM_CHANNELS) / ELECTRODES_PER_BLOCK;
+		int row = ((electrode % NUM_CHANNELS) / ELECTRODES_PER_ROW) % ROWS_PER_BLOCK;
+		int column = electrode % ELECTRODES_PER_ROW;
+
+		//Banks B-D permute the rows of each block
+		int rowMultiplier[NUM_BANKS] = { 1, 7, 5, 3 };
+		int rowOffset = column * 4 * bank;
+
+		return (row * rowMultiplier[bank] + rowOffset) % ROWS_PER_BLOCK * ELECTRODES_PER_ROW
+			+ block * ELECTRODES_PER_BLOCK + column;
+	}
+
+	struct Table
+	{
+		int16_t channel[NUM_ELECTRODES];           //electrode -> channel
+		int8_t bank[NUM_ELECTRODES];               //electrode -> bank
+		int16_t electrode[NUM_BANKS][NUM_CHANNELS]; //(bank, channel) -> electrode, -1 if none
+	};
+
+	constexpr Table buildTable()
+	{
+		Table table = {};
+
+		for (int bank = 0; bank < NUM_BANKS; bank++)
+			for (int ch = 0; ch < NUM_CHANNELS; ch++)
+				table.electrode[bank][ch] = -1;
+
+		for (int e = 0; e < NUM_ELECTRODES; e++)
+		{
+			int channel = computeChannel(e);
+			table.channel[e] = int16_t(channel);
+			table.bank[e] = int8_t(e / NUM_CHANNELS);
+			table.electrode[e / NUM_CHANNELS][channel] = int16_t(e);
+		}
+
+		return table;
+	}
+
+	/** True if every electrode maps to a distinct (bank, channel) that maps back to it. */
+	constexpr bool isConsistent(const Table& table)
+	{
+		for (int e = 0; e < NUM_ELECTRODES; e++)
+		{
+			int channel = table.channel[e];
+			int bank = table.bank[e];
+
+			if (channel < 0 || channel >= NUM_CHANNELS || bank != e / NUM_CHANNELS
+				|| table.electrode[bank][channel] != e)
+				return false;
+		}
+
+		for (int bank = 0; bank < NUM_BANKS; bank++)
+		{
+			for (int ch = 0; ch < NUM_CHANNELS; ch++)
+			{
+				int e = table.electrode[bank][ch];
+
+				if (e != -1 && (e < 0 || e >= NUM_ELECTRODES || table.channel[e] != ch || table.bank[e] != bank))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	inline const Table& getTable()
+	{
+		static constexpr Table table = buildTable();
+		return table;
+	}
+
+	inline int getChannel(int electrode) { return getTable().channel[electrode]; }
+	inline int getBank(int electrode) { return getTable().bank[electrode]; }
+
+	/** Electrode connected to a channel when the given bank is selected, -1 if the bank is partial. */
+	inline int getElectrode(int channel, int bank) { return getTable().electrode[bank][channel]; }
+
+	static_assert(NUM_BANKS == 4 && NUM_BANKS * NUM_CHANNELS >= NUM_ELECTRODES, "Bank formulas are defined for four banks");
+	static_assert(computeChannel(0) == 0 && computeChannel(NUM_CHANNELS - 1) == NUM_CHANNELS - 1,
+		"Bank A maps electrodes straight onto channels");
+	static_assert(isConsistent(buildTable()), "Forward and inverse tables must agree for every electrode");
+
+}
+
+#endif  // __NPX2ELECTRODEMAP_H__
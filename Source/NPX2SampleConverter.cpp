@@ -0,0 +1,221 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "NPX2SampleConverter.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NPX2_HAS_X86_KERNELS 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define NPX2_TARGET_AVX2
+#else
+#define NPX2_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define NPX2_HAS_NEON_KERNEL 1
+#include <arm_neon.h>
+#endif
+
+static void convertScalar(const int16_t* input, const float* scale, float* output, int numPackets)
+{
+	for (int p = 0; p < numPackets; p++)
+	{
+		for (int ch = 0; ch < NUM_CHANNELS; ch++)
+			output[ch] = float(input[ch]) * scale[ch];
+
+		input += NUM_CHANNELS;
+		output += NUM_CHANNELS;
+	}
+}
+
+#ifdef NPX2_HAS_X86_KERNELS
+
+static void convertSSE2(const int16_t* input, const float* scale, float* output, int numPackets)
+{
+	for (int p = 0; p < numPackets; p++)
+	{
+		for (int ch = 0; ch < NUM_CHANNELS; ch += 8)
+		{
+			__m128i raw = _mm_loadu_si128((const __m128i*) (input + ch));
+
+			// Sign-extend by placing each sample in the upper half of a 32-bit lane
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(raw, raw), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(raw, raw), 16);
+
+			_mm_storeu_ps(output + ch, _mm_mul_ps(_mm_cvtepi32_ps(lo), _mm_loadu_ps(scale + ch)));
+			_mm_storeu_ps(output + ch + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), _mm_loadu_ps(scale + ch + 4)));
+		}
+
+		input += NUM_CHANNELS;
+		output += NUM_CHANNELS;
+	}
+}
+
+NPX2_TARGET_AVX2 static void convertAVX2(const int16_t* input, const float* scale, float* output, int numPackets)
+{
+	for (int p = 0; p < numPackets; p++)
+	{
+		for (int ch = 0; ch < NUM_CHANNELS; ch += 16)
+		{
+			__m128i rawLo = _mm_loadu_si128((const __m128i*) (input + ch));
+			__m128i rawHi = _mm_loadu_si128((const __m128i*) (input + ch + 8));
+
+			__m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(rawLo));
+			__m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(rawHi));
+
+			_mm256_storeu_ps(output + ch, _mm256_mul_ps(lo, _mm256_loadu_ps(scale + ch)));
+			_mm256_storeu_ps(output + ch + 8, _mm256_mul_ps(hi, _mm256_loadu_ps(scale + ch + 8)));
+		}
+
+		input += NUM_CHANNELS;
+		output += NUM_CHANNELS;
+	}
+}
+
+#endif
+
+#ifdef NPX2_HAS_NEON_KERNEL
+
+static void convertNEON(const int16_t* input, const float* scale, float* output, int numPackets)
+{
+	for (int p = 0; p < numPackets; p++)
+	{
+		for (int ch = 0; ch < NUM_CHANNELS; ch += 8)
+		{
+			int16x8_t raw = vld1q_s16(input + ch);
+
+			float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(raw)));
+			float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(raw)));
+
+			vst1q_f32(output + ch, vmulq_f32(lo, vld1q_f32(scale + ch)));
+			vst1q_f32(output + ch + 4, vmulq_f32(hi, vld1q_f32(scale + ch + 4)));
+		}
+
+		input += NUM_CHANNELS;
+		output += NUM_CHANNELS;
+	}
+}
+
+#endif
+
+SampleConverter::SampleConverter()
+{
+	setScale(1.0f);
+	setIsa(getBestIsa());
+}
+
+void SampleConverter::setScale(float value)
+{
+	for (int ch = 0; ch < NUM_CHANNELS; ch++)
+		scale[ch] = value;
+}
+
+void SampleConverter::setScale(const float* channelScales)
+{
+	for (int ch = 0; ch < NUM_CHANNELS; ch++)
+		scale[ch] = channelScales[ch];
+}
+
+void SampleConverter::convert(const int16_t* input, float* output, int numPackets) const
+{
+	kernel(input, scale, output, numPackets);
+}
+
+bool SampleConverter::setIsa(Isa newIsa)
+{
+	if (!isSupported(newIsa))
+		return false;
+
+	isa = newIsa;
+	kernel = getKernel(newIsa);
+
+	return true;
+}
+
+SampleConverter::Kernel SampleConverter::getKernel(Isa isa)
+{
+	switch (isa)
+	{
+#ifdef NPX2_HAS_X86_KERNELS
+	case SSE2:
+		return &convertSSE2;
+	case AVX2:
+		return &convertAVX2;
+#endif
+#ifdef NPX2_HAS_NEON_KERNEL
+	case NEON:
+		return &convertNEON;
+#endif
+	default:
+		return &convertScalar;
+	}
+}
+
+bool SampleConverter::isSupported(Isa isa)
+{
+	switch (isa)
+	{
+	case SCALAR:
+		return true;
+#ifdef NPX2_HAS_X86_KERNELS
+	case SSE2:
+		return SystemStats::hasSSE2();
+	case AVX2:
+		return SystemStats::hasAVX2();
+#endif
+#ifdef NPX2_HAS_NEON_KERNEL
+	case NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+SampleConverter::Isa SampleConverter::getBestIsa()
+{
+	for (int i = NUM_ISAS - 1; i > SCALAR; i--)
+	{
+		if (isSupported(static_cast<Isa>(i)))
+			return static_cast<Isa>(i);
+	}
+
+	return SCALAR;
+}
+
+String SampleConverter::getIsaName(Isa isa)
+{
+	switch (isa)
+	{
+	case SSE2:
+		return "SSE2";
+	case AVX2:
+		return "AVX2";
+	case NEON:
+		return "NEON";
+	default:
+		return "Scalar";
+	}
+}
@@ -0,0 +1,93 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NPX2SAMPLECONVERTER_H__
+#define __NPX2SAMPLECONVERTER_H__
+
+#include <DataThreadHeaders.h>
+#include <stdint.h>
+
+#include "NPX2Components.h"
+
+/**
+
+	Converts blocks of int16 probe packets into the float layout expected by
+	DataBuffer::addToBuffer, multiplying each channel by its own scale factor.
+
+	Packets are NUM_CHANNELS samples long and stored back to back. SSE2, AVX2
+	and NEON kernels are selected at runtime; every kernel performs a single
+	int->float conversion followed by one float multiply per sample, so all
+	of them produce bit-identical results to the scalar kernel.
+
+	Converters are heap allocated and new only guarantees over-aligned storage
+	from C++17 on, so the kernels load the scale table without assuming alignment.
+
+*/
+class SampleConverter
+{
+public:
+
+	enum Isa {
+		SCALAR = 0,
+		SSE2,
+		AVX2,
+		NEON,
+		NUM_ISAS
+	};
+
+	SampleConverter();
+
+	/** Uses the same scale factor for every channel. */
+	void setScale(float scale);
+
+	/** Sets a separate scale factor for each of the NUM_CHANNELS channels. */
+	void setScale(const float* channelScales);
+
+	const float* getScale() const { return scale; }
+
+	/** Converts numPackets consecutive packets from input into output. */
+	void convert(const int16_t* input, float* output, int numPackets) const;
+
+	/** Forces a particular kernel; returns false if it is not available on this machine. */
+	bool setIsa(Isa isa);
+	Isa getIsa() const { return isa; }
+
+	/** Returns the fastest kernel available on this machine. */
+	static Isa getBestIsa();
+	static bool isSupported(Isa isa);
+	static String getIsaName(Isa isa);
+
+private:
+
+	typedef void(*Kernel)(const int16_t* input, const float* scale, float* output, int numPackets);
+
+	static Kernel getKernel(Isa isa);
+
+	Isa isa;
+	Kernel kernel;
+
+	float scale[NUM_CHANNELS];
+
+};
+
+#endif  // __NPX2SAMPLECONVERTER_H__
@@ -0,0 +1,192 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "NPX2SampleRing.h"
+#include "NPX2SampleConverter.h"
+
+static char* alignToCacheLine(char* ptr)
+{
+	return (char*)((uintptr_t(ptr) + NPX2_CACHE_LINE - 1) & ~uintptr_t(NPX2_CACHE_LINE - 1));
+}
+
+SampleRing::SampleRing(int numChannels_, int capacity_) : numChannels(numChannels_), capacity(0)
+{
+	setCapacity(capacity_);
+}
+
+void SampleRing::setCapacity(int samples)
+{
+	int size = 1;
+	while (size < samples)
+		size <<= 1;
+
+	if (size != capacity)
+	{
+		capacity = size;
+		mask = size - 1;
+
+		size_t dataBytes = size_t(capacity) * numChannels * sizeof(int16_t);
+		size_t timestampBytes = size_t(capacity) * sizeof(int64);
+		size_t eventBytes = size_t(capacity) * sizeof(uint64);
+
+		//Each array starts on its own cache line
+		storage.malloc(dataBytes + timestampBytes + eventBytes + 3 * NPX2_CACHE_LINE);
+
+		data = (int16_t*)alignToCacheLine(storage.getData());
+		timestamps = (int64*)alignToCacheLine((char*)data + dataBytes);
+		eventCodes = (uint64*)alignToCacheLine((char*)timestamps + timestampBytes);
+	}
+
+	reset();
+}
+
+void SampleRing::reset()
+{
+	writeIndex = 0;
+	cachedReadIndex = 0;
+	markNextWrite = false;
+	samplesWritten = 0;
+	samplesDropped = 0;
+	overflows = 0;
+	highWater = 0;
+
+	readIndex = 0;
+	samplesRead = 0;
+	consumerStalls = 0;
+}
+
+int SampleRing::write(const int16_t* input, const int64* inputTimestamps, const uint64* inputEventCodes, int count)
+{
+
+	int64 head = writeIndex.load(std::memory_order_relaxed);
+
+	//Only touch the consumer's line when the cached index says the ring might be full
+	if (head + count - cachedReadIndex > capacity)
+		cachedReadIndex = readIndex.load(std::memory_order_acquire);
+
+	int space = capacity - int(head - cachedReadIndex);
+	int n = jmin(count, space);
+
+	if (n > 0)
+	{
+		int start = int(head & mask);
+		int first = jmin(n, capacity - start);
+
+		memcpy(&data[size_t(start) * numChannels], input, sizeof(int16_t) * first * numChannels);
+		memcpy(&timestamps[start], inputTimestamps, sizeof(int64) * first);
+		memcpy(&eventCodes[start], inputEventCodes, sizeof(uint64) * first);
+
+		if (n > first)
+		{
+			memcpy(data, &input[size_t(first) * numChannels], sizeof(int16_t) * (n - first) * numChannels);
+			memcpy(timestamps, &inputTimestamps[first], sizeof(int64) * (n - first));
+			memcpy(eventCodes, &inputEventCodes[first], sizeof(uint64) * (n - first));
+		}
+
+		//Samples were dropped before this one
+		if (markNextWrite)
+		{
+			eventCodes[start] |= GAP_EVENT_BIT;
+			markNextWrite = false;
+		}
+
+		writeIndex.store(head + n, std::memory_order_release);
+		samplesWritten.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	if (n < count)
+	{
+		highWater.store(capacity, std::memory_order_relaxed);
+
+		if (!markNextWrite)
+			overflows.fetch_add(1, std::memory_order_relaxed);
+
+		samplesDropped.fetch_add(count - n, std::memory_order_relaxed);
+		markNextWrite = true;
+	}
+
+	return n;
+
+}
+
+int SampleRing::read(DataBuffer* buffer, const SampleConverter* converter, float* scratch, int maxSamples)
+{
+
+	int64 tail = readIndex.load(std::memory_order_relaxed);
+	int64 head = writeIndex.load(std::memory_order_acquire);
+
+	int ready = int(head - tail);
+
+	//Measured here rather than in write, where only a stale read index is at hand
+	if (ready > highWater.load(std::memory_order_relaxed))
+		highWater.store(ready, std::memory_order_relaxed);
+
+	int n = jmin(ready, maxSamples);
+
+	if (n <= 0)
+		return 0;
+
+	int start = int(tail & mask);
+	int first = jmin(n, capacity - start);
+
+	//The only int16 -> float conversion on the way to the DataBuffer
+	converter->convert(&data[size_t(start) * numChannels], scratch, first);
+	int moved = buffer->addToBuffer(scratch, &timestamps[start], &eventCodes[start], first);
+
+	if (moved == first && n > first)
+	{
+		converter->convert(data, scratch, n - first);
+		moved += buffer->addToBuffer(scratch, timestamps, eventCodes, n - first);
+	}
+
+	//The DataBuffer is full: leave the rest in the ring
+	if (moved < n)
+		consumerStalls.fetch_add(1, std::memory_order_relaxed);
+
+	readIndex.store(tail + moved, std::memory_order_release);
+	samplesRead.fetch_add(moved, std::memory_order_relaxed);
+
+	return moved;
+
+}
+
+int SampleRing::getNumReady() const
+{
+	return int(writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire));
+}
+
+RingStatistics SampleRing::getStatistics() const
+{
+	RingStatistics stats;
+
+	stats.capacity = capacity;
+	stats.occupancy = getNumReady();
+	stats.highWater = highWater.load(std::memory_order_relaxed);
+	stats.samplesWritten = samplesWritten.load(std::memory_order_relaxed);
+	stats.samplesRead = samplesRead.load(std::memory_order_relaxed);
+	stats.samplesDropped = samplesDropped.load(std::memory_order_relaxed);
+	stats.overflows = overflows.load(std::memory_order_relaxed);
+	stats.consumerStalls = consumerStalls.load(std::memory_order_relaxed);
+
+	return stats;
+}
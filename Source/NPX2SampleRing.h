@@ -0,0 +1,110 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NPX2SAMPLERING_H__
+#define __NPX2SAMPLERING_H__
+
+#include <DataThreadHeaders.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "NPX2Components.h"
+
+class SampleConverter;
+
+#define NPX2_CACHE_LINE 64
+
+/**
+
+	Lock-free single-producer/single-consumer ring of raw int16 samples sitting
+	between a probe stream's hardware drain and its DataBuffer.
+
+	The producer (probe thread or packet callback) never blocks: samples that do
+	not fit are dropped, counted, and the next stored sample carries GAP_EVENT_BIT.
+	The consumer (NPX2Thread::updateBuffer) converts contiguous regions of the
+	ring to float with the stream's SampleConverter, hands them to
+	DataBuffer::addToBuffer and only advances past what was accepted, so
+	downstream backpressure shows up as ring occupancy.
+
+	Capacity is rounded up to a power of two. Sample storage is aligned to
+	NPX2_CACHE_LINE and the producer and consumer indices live on separate lines.
+
+*/
+class SampleRing
+{
+public:
+	SampleRing(int numChannels, int capacity);
+
+	/** Reallocates the storage and clears the ring; neither side may be running. */
+	void setCapacity(int samples);
+	int getCapacity() const { return capacity; }
+
+	/** Clears the ring and its statistics; neither side may be running. */
+	void reset();
+
+	/** Producer side: copies up to count samples, returns the number stored. */
+	int write(const int16_t* data, const int64* timestamps, const uint64* eventCodes, int count);
+
+	/** Consumer side: converts up to maxSamples into buffer, returns the number moved.
+		scratch must hold maxSamples * numChannels floats. */
+	int read(DataBuffer* buffer, const SampleConverter* converter, float* scratch, int maxSamples);
+
+	/** Number of samples waiting for the consumer. */
+	int getNumReady() const;
+
+	RingStatistics getStatistics() const;
+
+private:
+
+	int numChannels;
+	int capacity;
+	int64 mask;
+
+	HeapBlock<char> storage;
+	int16_t* data;
+	int64* timestamps;
+	uint64* eventCodes;
+
+	char padding0[NPX2_CACHE_LINE];
+
+	//Producer line
+	std::atomic<int64> writeIndex;
+	int64 cachedReadIndex;
+	bool markNextWrite;
+	std::atomic<uint64> samplesWritten;
+	std::atomic<uint64> samplesDropped;
+	std::atomic<uint64> overflows;
+	std::atomic<int> highWater;
+
+	char padding1[NPX2_CACHE_LINE];
+
+	//Consumer line
+	std::atomic<int64> readIndex;
+	std::atomic<uint64> samplesRead;
+	std::atomic<uint64> consumerStalls;
+
+	char padding2[NPX2_CACHE_LINE];
+
+};
+
+#endif  // __NPX2SAMPLERING_H__
@@ -23,6 +23,7 @@
 
 #include "NPX2Thread.h"
 #include "NPX2Editor.h"
+#include "NPX2BackendTrace.h"
 
 class NPX2Thread;
 
@@ -38,7 +39,13 @@ GenericEditor* NPX2Thread::createEditor(SourceNode* sn)
 
 NPX2Thread::NPX2Thread(SourceNode* sn) : DataThread(sn), recordingTimer(this)
 {
-    
+
+#ifdef NPX2_SIMULATED_BACKEND
+    std::cout << "Using simulated Neuropixels hardware" << std::endl;
+#endif
+
+    selectBackend();
+
     api.getInfo();
 
     basestationAvailable = false;
@@ -46,25 +53,135 @@ NPX2Thread::NPX2Thread(SourceNode* sn) : DataThread(sn), recordingTimer(this)
     isRecording = false;
     recordingNumber = 0;
 
-    np::NP_ErrorCode ec; 
+    acquisitionMode = AcquisitionMode::BATCHED_PACKETS;
+    acquisitionThreading = AcquisitionThreading::THREAD_PER_PROBE;
+    coreBudget = 0;
+    ringCapacity = DEFAULT_RING_CAPACITY_MS;
+    laneGranularity = LaneGranularity::LANE_PER_PORT;
+    outputMode = SampleOutputMode::OUTPUT_LEGACY_SCALED;
+    packetBatchSize = SAMPLECOUNT;
+    startRequestTicks = 0;
+    startLatency = -1.0f;
+    startTriggerMode = StartTriggerMode::START_SOFTWARE;
+    activeStartTriggerMode = StartTriggerMode::START_SOFTWARE;
+    syncMasterSlot = -1;
+    startTriggerSlot = -1;
+    triggered = false;
+    triggerTicks = 0;
+    startSkew = -1.0f;
+
+    drainScratch.malloc(RING_DRAIN_SIZE * NUM_CHANNELS);
+
+    totalProbes = 0;
+
+    discoverHardware();
+
+}
+
+void NPX2Thread::selectBackend()
+{
+    String replayPath = SystemStats::getEnvironmentVariable("NPX2_TRACE_REPLAY", String());
+    String recordPath = SystemStats::getEnvironmentVariable("NPX2_TRACE_RECORD", String());
+
+    if (replayPath.isNotEmpty())
+    {
+        bool realTime = SystemStats::getEnvironmentVariable("NPX2_TRACE_SPEED", "realtime") != "full";
+
+        ScopedPointer<ReplayBackend> replay = new ReplayBackend(File(replayPath), realTime);
+
+        if (replay->isValid())
+            NPX2Backend::install(replay.release());
+    }
+    else if (recordPath.isNotEmpty())
+    {
+        NPX2Backend::install(new RecordingBackend(new NativeBackend(), File(recordPath)));
+    }
+
+    std::cout << "Neuropixels backend: " << NPX2Backend::get().getName() << std::endl;
+}
+
+void NPX2Thread::discoverHardware()
+{
+
+    StartupProfiler::clear();
+
+    int64 start = Time::getHighResolutionTicks();
 
     uint32_t availableSlotMask;
 
-    np::getAvailableSlots(&availableSlotMask);
+    {
+        StartupProfiler::ScopedStage stage(-1, 0, 0, "getAvailableSlots");
+        NPX2Backend::get().getAvailableSlots(&availableSlotMask);
+    }
+
+    Basestation* found[MAX_NUM_SLOTS] = {};
+
+    //Open every basestation at once...
+    ConfigScheduler discovery(laneGranularity);
 
-    totalProbes = 0;
     for (int slot = 0; slot < MAX_NUM_SLOTS; slot++)
     {
         if ((availableSlotMask >> slot) & 1)
         {
-            basestations.add(new Basestation(slot));
+            discovery.add(slot, 0, 0, "openBS", [slot, &found]()
+            {
+                found[slot] = new Basestation(slot);
+                return found[slot]->isOpen();
+            });
         }
     }
 
+    discovery.run();
+
+    //...then scan all of their ports at once
+    for (int slot = 0; slot < MAX_NUM_SLOTS; slot++)
+    {
+        if (found[slot] != nullptr && found[slot]->isOpen())
+        {
+            for (int port = 1; port <= NUM_PORTS; port++)
+            {
+                Basestation* basestation = found[slot];
+
+                discovery.add(slot, port, 0, "Discover port", [basestation, port]()
+                {
+                    basestation->discoverPort(port);
+                    return true;
+                });
+            }
+        }
+    }
+
+    discovery.run();
+
+    for (int slot = 0; slot < MAX_NUM_SLOTS; slot++)
+    {
+        if (found[slot] != nullptr)
+        {
+            found[slot]->collectDiscoveredProbes();
+            basestations.add(found[slot]);
+        }
+    }
+
+    float elapsed = float(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0);
+
+    std::cout << "Hardware discovery took " << elapsed << " ms:" << std::endl;
+
+    for (auto timing : StartupProfiler::getTimings())
+    {
+        std::cout << "  " << timing.stage << " (slot " << timing.slot << ", port " << timing.port
+            << ", dock " << timing.dock << "): " << timing.milliseconds << " ms" << std::endl;
+    }
+
+}
+
+Array<StartupTiming> NPX2Thread::getStartupTimings()
+{
+    return StartupProfiler::getTimings();
 }
 
 NPX2Thread::~NPX2Thread()
 {
+    executor = nullptr;
     closeConnection();
 }
 
@@ -81,6 +198,7 @@ int NPX2Thread::getSlotNumberFor(int slotIndex)
 void NPX2Thread::setMasterSync(int slotIndex)
 {
     basestations[slotIndex]->setSyncAsInput();
+    syncMasterSlot = basestations[slotIndex]->slot;
 }
 
 void NPX2Thread::setSyncOutput(int slotIndex)
@@ -99,16 +217,16 @@ void NPX2Thread::setSyncFrequency(int slotIndex, int freqIndex)
     basestations[slotIndex]->setSyncAsOutput(freqIndex);
 }
 
-void NPX2Thread::openConnection()
+void NPX2Thread::openConnection(InitProgressCallback progress)
 {
 
+    initializeProbes(progress);
+
     bool foundSync = false;
 
     for (int i = 0; i < basestations.size(); i++)
     {
 
-        basestations[i]->init();
-
         if (basestations[i]->getProbeCount() > 0)
         {
             totalProbes += basestations[i]->getProbeCount();
@@ -118,6 +236,7 @@ void NPX2Thread::openConnection()
             if (!foundSync)
             {
                 basestations[i]->setSyncAsInput();
+                syncMasterSlot = basestations[i]->slot;
                 selectedSlot = basestations[i]->slot;
                 selectedPort = basestations[i]->probes[0]->port;
                 selectedDock = basestations[i]->probes[0]->dock;
@@ -126,18 +245,27 @@ void NPX2Thread::openConnection()
 
             for (int probe_num = 0; probe_num < basestations[i]->getProbeCount(); probe_num++)
             {
+                Probe* probe = basestations[i]->probes[probe_num];
+
                 std::cout << "Creating buffer for slot: " << int(basestations[i]->slot) 
-                << ", port: " << int(basestations[i]->probes[probe_num]->port) 
-                << ", dock: " << int(basestations[i]->probes[probe_num]->dock) << std::endl;
-                sourceBuffers.add(new DataBuffer(384, 10000));  // full-band buffer
-                basestations[i]->probes[probe_num]->stream = sourceBuffers.getLast();
-
-                CoreServices::sendStatusMessage("Initializing probe " + String(probe_num + 1) + "/" + String(basestations[i]->getProbeCount()) + 
-                    " on Basestation " + String(i + 1) + "/" + String(basestations.size()));
-                
-                basestations[i]->initializeProbes();
+                << ", port: " << int(probe->port) 
+                << ", dock: " << int(probe->dock) << std::endl;
+
+                sourceBuffers.add(new DataBuffer(384, 10000));  // AP band buffer
+                probe->apStream->buffer = sourceBuffers.getLast();
+                probe->apStream->setOutputMode(outputMode);
+                streams.add(probe->apStream);
+
+                if (probe->lfpStream != nullptr)
+                {
+                    sourceBuffers.add(new DataBuffer(384, 10000));  // LFP band buffer
+                    probe->lfpStream->buffer = sourceBuffers.getLast();
+                    probe->lfpStream->setOutputMode(outputMode);
+                    streams.add(probe->lfpStream);
+                }
             }
-                
+
+            basestations[i]->init();
         }
             
     }
@@ -148,6 +276,44 @@ void NPX2Thread::openConnection()
 
 }
 
+void NPX2Thread::initializeProbes(InitProgressCallback progress)
+{
+
+    ConfigScheduler scheduler(laneGranularity);
+    CriticalSection progressLock;
+    int completed = 0;
+    int total = 0;
+
+    for (auto basestation : basestations)
+        total += basestation->getProbeCount();
+
+    for (auto basestation : basestations)
+    {
+        for (auto probe : basestation->probes)
+        {
+            scheduler.add(basestation->slot, probe->port, probe->dock, "Initialize probe", [probe, progress, total, &completed, &progressLock]()
+            {
+                bool success = probe->init();
+
+                //Reports arrive from several workers; serialize them so the callback needn't be thread-safe
+                const ScopedLock sl(progressLock);
+                completed++;
+
+                if (progress)
+                    progress(probe, success, completed, total);
+
+                return success;
+            });
+        }
+    }
+
+    scheduler.run();
+
+    std::cout << "Initialized " << total << " probes on " << scheduler.getNumLanes()
+        << " lanes in " << scheduler.getElapsedMs() << " ms" << std::endl;
+
+}
+
 void NPX2Thread::closeConnection()
 {
     //TODO: Properly close all connections...
@@ -160,41 +326,85 @@ void NPX2Thread::updateProbeSettingsQueue()
 
 void NPX2Thread::applyProbeSettingsQueue()
 {
+    ConfigScheduler scheduler(laneGranularity);
+
     for (auto settings : probeSettingsUpdateQueue)
     {
         
-        selectElectrodes(settings.slot, settings.port, settings.dock, settings.channelStatus);
-        setAllReferences(settings.slot, settings.port, settings.dock, settings.refChannelIndex);
+        scheduler.add(settings.slot, settings.port, settings.dock, "Restore settings", [this, settings]()
+        {
+            setGapPolicy(settings.slot, settings.port, settings.dock, static_cast<GapPolicy>(settings.gapPolicy));
+            return applyProbeSettings(settings);
+        });
         /*
         setAllGains(settings.slot, settings.port, settings.apGainIndex, settings.lfpGainIndex);
-        setFilter(settings.slot, settings.port, settings.disableHighPass);
         */
 
     }
+
+    bool success = scheduler.run();
+
+    configTimings = scheduler.getTimings();
+
+    for (auto timing : configTimings)
+    {
+        std::cout << "  Slot " << timing.slot << ", port " << timing.port << ", dock " << timing.dock
+            << ": " << timing.name << (timing.success ? "" : " FAILED") << " in " << timing.durationMs
+            << " ms (started after " << timing.waitMs << " ms)" << std::endl;
+    }
+
+    std::cout << "Configured " << configTimings.size() << " probes on " << scheduler.getNumLanes()
+        << " lanes in " << scheduler.getElapsedMs() << " ms" << std::endl;
+
+    if (!success)
+        CoreServices::sendStatusMessage("Failed to restore the settings of some probes");
 }
 
-void NPX2Thread::setAllReferences(int slot, int port, int dock, int refId)
+static void getReferenceForIndex(int refId, np::channelreference_t& ref, np::electrodebanks_t& bank)
 {
- 
-    np::NP_ErrorCode ec;
-    np::channelreference_t ref;
-    np::electrodebanks_t bank;
-
-    if (refId == 0) // external reference
+    if (refId > 1) // internal reference
     {
-        ref = np::EXT_REF;
-        bank = np::None;
+        ref = np::INT_REF;
+        bank = static_cast<np::electrodebanks_t>(refId - 1);
     }
     else if (refId == 1) // tip reference
     {
         ref = np::TIP_REF;
         bank = np::None;
     }
-    else if (refId > 1) // internal reference
+    else // external reference
     {
-        ref = np::INT_REF;
-        bank = static_cast<np::electrodebanks_t>(refId - 1);
+        ref = np::EXT_REF;
+        bank = np::None;
     }
+}
+
+bool NPX2Thread::applyProbeSettings(const probeSettings& settings)
+{
+    Probe* probe = getProbe(settings.slot, settings.port, settings.dock);
+
+    if (probe == nullptr)
+        return false;
+
+    np::channelreference_t ref;
+    np::electrodebanks_t bank;
+    getReferenceForIndex(settings.refChannelIndex, ref, bank);
+
+    ProbeConfigTransaction transaction(probe);
+    transaction.setElectrodes(settings.channelStatus);
+    transaction.setReference(ref, bank);
+    transaction.setApFilter(settings.disableHighPass);
+
+    return transaction.commit();
+}
+
+void NPX2Thread::setAllReferences(int slot, int port, int dock, int refId)
+{
+ 
+    np::channelreference_t ref;
+    np::electrodebanks_t bank;
+
+    getReferenceForIndex(refId, ref, bank);
 
     for (int i = 0; i < basestations.size(); i++)
     {
@@ -345,16 +555,66 @@ String NPX2Thread::getInfoString()
     return infoString;
 
 }
-void NPX2Thread::selectElectrodes(int slot, int port, int dock, Array<int> channelStatus)
+void NPX2Thread::selectElectrodes(int slot, int port, int dock, Array<int> channelStatus, bool forceFullRewrite)
 {
 
     for (int i = 0; i < basestations.size(); i++)
     {
-        basestations[i]->setChannels(slot, port, dock, channelStatus);
+        basestations[i]->setChannels(slot, port, dock, channelStatus, forceFullRewrite);
     }
 
 }
 
+bool NPX2Thread::getChannelTable(int slot, int port, int dock, ChannelTableSnapshot& table)
+{
+    Probe* probe = getProbe(slot, port, dock);
+
+    if (probe == nullptr)
+        return false;
+
+    probe->channelTable.read(table);
+    return true;
+}
+
+void NPX2Thread::setLaneGranularity(LaneGranularity granularity)
+{
+    laneGranularity = granularity;
+}
+
+Array<ConfigJobTiming> NPX2Thread::getConfigTimings()
+{
+    return configTimings;
+}
+
+ProbeConfigStatistics NPX2Thread::getConfigStatistics(int slot, int port, int dock)
+{
+    Probe* probe = getProbe(slot, port, dock);
+
+    if (probe != nullptr)
+        return probe->getConfigStatistics();
+
+    ProbeConfigStatistics empty = {};
+    return empty;
+}
+
+bool NPX2Thread::isApHighPassDisabled(int slot, int port, int dock)
+{
+    Probe* probe = getProbe(slot, port, dock);
+
+    return probe != nullptr && probe->isApHighPassDisabled();
+}
+
+ElectrodeSelectionStatistics NPX2Thread::getElectrodeSelectionStatistics(int slot, int port, int dock)
+{
+    Probe* probe = getProbe(slot, port, dock);
+
+    if (probe != nullptr)
+        return probe->getElectrodeSelectionStatistics();
+
+    ElectrodeSelectionStatistics empty = {};
+    return empty;
+}
+
 bool NPX2Thread::runBist(int slot, int port, int dock, int bistIndex)
 {
     bool returnValue = false;
@@ -383,6 +643,15 @@ bool NPX2Thread::updateBuffer()
         stopRecording();
     }
 
+    int moved = 0;
+
+    for (int i = 0; i < streams.size(); i++)
+        moved += streams[i]->drain(drainScratch, RING_DRAIN_SIZE);
+
+    //Nothing arrived since the last pass; the rings absorb the wait
+    if (moved == 0)
+        wait(1);
+
     return true;
 }
 
@@ -394,16 +663,67 @@ bool NPX2Thread::startAcquisition()
 
     last_npx_timestamp = 0;
 
-    startTimer(500 * totalProbes); // wait for signal chain to be built //?
+    startRequestTicks = Time::getHighResolutionTicks();
+    startLatency = -1.0f;
+    triggered = false;
+    startSkew = -1.0f;
+    slotStartTimes.clear();
+
+    configureStartTrigger();
+
+    for (int i = 0; i < streams.size(); i++)
+        streams[i]->setRingCapacity(ringCapacity);
+
+    for (int i = 0; i < basestations.size(); i++)
+    {
+        for (auto probe : basestations[i]->probes)
+        {
+            probe->acquisitionMode = acquisitionMode;
+            probe->acquisitionThreading = acquisitionThreading;
+            probe->setPacketBatchSize(packetBatchSize);
+        }
+        basestations[i]->armProbes();
+    }
+
+    if (acquisitionThreading == AcquisitionThreading::SHARED_POOL
+        && acquisitionMode != AcquisitionMode::PACKET_CALLBACK)
+    {
+        Array<Probe*> probes;
+
+        for (int i = 0; i < basestations.size(); i++)
+            for (auto probe : basestations[i]->probes)
+                probes.add(probe);
+
+        executor = new AcquisitionExecutor(coreBudget);
+        executor->start(probes);
+    }
+
+    startThread();
+
+    // Trigger as soon as the signal chain is running and every probe is armed
+    startTimer(READINESS_POLL_INTERVAL_MS);
     return true;
 }
 
 bool NPX2Thread::stopAcquisition()
 {
 
+    stopTimer();
+
+    // Wait for the consumer to leave updateBuffer, so that a quick restart
+    // can resize the rings without it still draining them
     if (isThreadRunning())
     {
-        signalThreadShouldExit();
+        stopThread(1000);
+    }
+
+    if (executor != nullptr)
+    {
+        ExecutorStatistics stats = executor->getStatistics();
+        std::cout << "Acquisition pool: " << stats.workers << " workers, " << stats.tasksRun << " reads, "
+            << stats.steals << " steals, " << stats.idleWaits << " idle waits" << std::endl;
+
+        executor = nullptr;
     }
 
     for (int i = 0; i < basestations.size(); i++)
@@ -417,17 +737,203 @@ bool NPX2Thread::stopAcquisition()
 void NPX2Thread::timerCallback()
 {
 
+    if (triggered)
+    {
+        // Keep polling until every slot has delivered its first packet
+        if (measureStartSkew())
+        {
+            stopTimer();
+        }
+        else if (Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - triggerTicks) * 1000.0 > START_SKEW_TIMEOUT_MS)
+        {
+            std::cout << "Could not measure the start skew: some slots sent no data" << std::endl;
+            stopTimer();
+        }
+    }
+    else if (signalChainReady() && probesArmed())
+    {
+        triggerAcquisition(false);
+    }
+    else if (Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startRequestTicks) * 1000.0 > READINESS_TIMEOUT_MS)
+    {
+        triggerAcquisition(true);
+    }
+
+}
+
+bool NPX2Thread::signalChainReady()
+{
+    // Turns true once the processor graph is enabled and audio callbacks are running
+    return CoreServices::getAcquisitionStatus();
+}
+
+bool NPX2Thread::probesArmed()
+{
     for (int i = 0; i < basestations.size(); i++)
     {
-        basestations[i]->startAcquisition();
+        if (!basestations[i]->isArmed())
+            return false;
     }
 
-    startThread();
-    stopTimer();
+    return true;
+}
+
+void NPX2Thread::triggerAcquisition(bool timedOut)
+{
+
+    if (timedOut)
+        std::cout << "Signal chain or probes not ready after " << READINESS_TIMEOUT_MS << " ms, starting anyway" << std::endl;
+
+    if (activeStartTriggerMode == StartTriggerMode::START_HARDWARE_SYNCHRONIZED)
+    {
+        // The master's software trigger drives the shared line, which starts every slot
+        for (int i = 0; i < basestations.size(); i++)
+        {
+            if (basestations[i]->slot == startTriggerSlot)
+                basestations[i]->trigger();
+        }
+    }
+    else
+    {
+        for (int i = 0; i < basestations.size(); i++)
+            basestations[i]->trigger();
+    }
+
+    triggered = true;
+    triggerTicks = Time::getHighResolutionTicks();
+
+    startLatency = float(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startRequestTicks) * 1000.0);
 
+    std::cout << "Acquisition started " << startLatency << " ms after the start request" << std::endl;
 
 }
 
+float NPX2Thread::getStartLatency()
+{
+    return startLatency;
+}
+
+int NPX2Thread::getStartTriggerSlot()
+{
+
+    int firstSlot = -1;
+
+    // The sync master drives the start line, or the first slot with probes if it has none
+    for (int i = 0; i < basestations.size(); i++)
+    {
+        if (basestations[i]->getProbeCount() == 0)
+            continue;
+
+        if (basestations[i]->slot == syncMasterSlot)
+            return syncMasterSlot;
+
+        if (firstSlot < 0)
+            firstSlot = basestations[i]->slot;
+    }
+
+    return firstSlot;
+
+}
+
+void NPX2Thread::configureStartTrigger()
+{
+
+    // A failed binding only affects this run; startTriggerMode is the saved setting
+    activeStartTriggerMode = startTriggerMode;
+    startTriggerSlot = getStartTriggerSlot();
+
+    if (!bindStartTriggers(activeStartTriggerMode)
+        && activeStartTriggerMode == StartTriggerMode::START_HARDWARE_SYNCHRONIZED)
+    {
+        std::cout << "Falling back to software start triggers for this run" << std::endl;
+        activeStartTriggerMode = StartTriggerMode::START_SOFTWARE;
+        bindStartTriggers(activeStartTriggerMode);
+    }
+
+}
+
+bool NPX2Thread::bindStartTriggers(StartTriggerMode mode)
+{
+
+    bool success = true;
+
+    for (int i = 0; i < basestations.size(); i++)
+    {
+        if (basestations[i]->getProbeCount() == 0)
+            continue;
+
+        if (!basestations[i]->setStartTrigger(mode, basestations[i]->slot == startTriggerSlot))
+            success = false;
+    }
+
+    return success;
+
+}
+
+bool NPX2Thread::measureStartSkew()
+{
+
+    Array<SlotStartTime> starts;
+
+    for (int i = 0; i < basestations.size(); i++)
+    {
+        if (basestations[i]->getProbeCount() == 0)
+            continue;
+
+        SlotStartTime start;
+
+        if (!basestations[i]->getStartTime(start))
+            return false;
+
+        starts.add(start);
+    }
+
+    if (starts.size() == 0)
+        return false;
+
+    double earliest = starts[0].triggerTimeMs;
+    double latest = starts[0].triggerTimeMs;
+
+    for (auto start : starts)
+    {
+        earliest = jmin(earliest, start.triggerTimeMs);
+        latest = jmax(latest, start.triggerTimeMs);
+    }
+
+    for (auto start : starts)
+    {
+        std::cout << "  Slot " << start.slot << " first timestamp " << start.firstTimestamp
+            << ", started " << (start.triggerTimeMs - earliest) << " ms after the first slot" << std::endl;
+    }
+
+    slotStartTimes = starts;
+    startSkew = float(latest - earliest);
+
+    std::cout << "Start skew across " << starts.size() << " slots: " << startSkew << " ms" << std::endl;
+
+    return true;
+}
+
+void NPX2Thread::setStartTriggerMode(StartTriggerMode mode)
+{
+    startTriggerMode = mode;
+}
+
+StartTriggerMode NPX2Thread::getStartTriggerMode()
+{
+    return startTriggerMode;
+}
+
+float NPX2Thread::getStartSkew()
+{
+    return startSkew;
+}
+
+Array<SlotStartTime> NPX2Thread::getSlotStartTimes()
+{
+    return slotStartTimes;
+}
+
 float NPX2Thread::getFillPercentage(int slot)
 {
 
@@ -467,8 +973,8 @@ void NPX2Thread::startRecording()
 
                 File npxFileName = fullPath.getChildFile("recording_slot" + String(basestations[i]->slot) + "_" + String(recordingNumber) + ".npx2");
 
-                np::setFileStream(basestations[i]->slot, npxFileName.getFullPathName().getCharPointer());
-                np::enableFileStream(basestations[i]->slot, true);
+                NPX2Backend::get().setFileStream(basestations[i]->slot, npxFileName.getFullPathName().getCharPointer());
+                NPX2Backend::get().enableFileStream(basestations[i]->slot, true);
 
                 std::cout << "Basestation " << i << " started recording." << std::endl;
             }
@@ -482,7 +988,7 @@ void NPX2Thread::stopRecording()
 {
     for (int i = 0; i < basestations.size(); i++)
     {
-        np::enableFileStream(basestations[i]->slot, false);
+        NPX2Backend::get().enableFileStream(basestations[i]->slot, false);
     }
 
     std::cout << "NeuropixThread stopped recording." << std::endl;
@@ -492,13 +998,13 @@ void NPX2Thread::setDefaultChannelNames()
 {
     int chan = 0;
 
-    for (int probe_num = 0; probe_num < totalProbes; probe_num++)
+    for (auto stream : streams)
     {
         for (int i = 0; i < NUM_CHANNELS; i++)
         {
             ChannelCustomInfo info;
-            info.name = "CH" + String(i + 1);
-            info.gain = NPX2_BITVOLTS;
+            info.name = (stream->source == np::SourceLFP ? "LFP" : "CH") + String(i + 1);
+            info.gain = stream->getBitVolts();
             channelInfo.set(chan, info);
             chan++;
         }
@@ -514,7 +1020,7 @@ bool NPX2Thread::usesCustomNames() const
 /** Returns the number of virtual subprocessors this source can generate */
 unsigned int NPX2Thread::getNumSubProcessors() const
 {
-	return totalProbes > 0 ? totalProbes : 1;
+	return streams.size() > 0 ? streams.size() : 1;
 }
 
 /** Returns the number of continuous headstage channels the data source can provide.*/
@@ -530,18 +1036,26 @@ int NPX2Thread::getNumDataOutputs(DataChannel::DataChannelTypes type, int subPro
 /** Returns the number of TTL channels that each subprocessor generates*/
 int NPX2Thread::getNumTTLOutputs(int subProcessorIdx) const 
 {
-	return 1;
+	return NUM_TTL_LINES; // sync input, gap marker
 }
 
 /** Returns the sample rate of the data source.*/
 float NPX2Thread::getSampleRate(int subProcessorIdx) const
 {
+    if (subProcessorIdx < streams.size())
+        return streams[subProcessorIdx]->sampleRate;
+
 	return SAMPLERATE;
 }
 
 /** Returns the volts per bit of the data source.*/
 float NPX2Thread::getBitVolts(const DataChannel* chan) const
 {
+    int subProcessorIdx = chan->getSubProcessorIdx();
+
+    if (subProcessorIdx < streams.size())
+        return streams[subProcessorIdx]->getBitVolts();
+
 	return NPX2_BITVOLTS;
 }
 
@@ -562,6 +1076,243 @@ void NPX2Thread::setAutoRestart(bool autoRestart)
     this->autoRestart = autoRestart;
 }
 
+void NPX2Thread::setAcquisitionMode(AcquisitionMode mode)
+{
+    acquisitionMode = mode;
+}
+
+AcquisitionMode NPX2Thread::getAcquisitionMode()
+{
+    return acquisitionMode;
+}
+
+void NPX2Thread::setAcquisitionThreading(AcquisitionThreading threading)
+{
+    acquisitionThreading = threading;
+}
+
+AcquisitionThreading NPX2Thread::getAcquisitionThreading()
+{
+    return acquisitionThreading;
+}
+
+void NPX2Thread::setCoreBudget(int cores)
+{
+    coreBudget = jlimit(0, MAX_ACQUISITION_WORKERS, cores);
+}
+
+int NPX2Thread::getCoreBudget()
+{
+    return coreBudget;
+}
+
+void NPX2Thread::setPacketBatchSize(int packetsPerRead)
+{
+    packetBatchSize = jlimit(1, SAMPLECOUNT, packetsPerRead);
+}
+
+int NPX2Thread::getPacketBatchSize()
+{
+    return packetBatchSize;
+}
+
+BatchStatistics NPX2Thread::getBatchStatistics(int slot, int port, int dock, np::streamsource_t source)
+{
+    ProbeStream* stream = getStream(slot, port, dock, source);
+
+    if (stream != nullptr)
+        return stream->getBatchStatistics();
+
+    BatchStatistics empty = {};
+    return empty;
+}
+
+TimestampStatistics NPX2Thread::getTimestampStatistics(int slot, int port, int dock, np::streamsource_t source)
+{
+    ProbeStream* stream = getStream(slot, port, dock, source);
+
+    if (stream != nullptr)
+        return stream->unwrapper->getStatistics();
+
+    TimestampStatistics empty = {};
+    return empty;
+}
+
+void NPX2Thread::setGapPolicy(int slot, int port, int dock, GapPolicy policy)
+{
+    Probe* probe = getProbe(slot, port, dock);
+
+    if (probe != nullptr)
+        probe->gapPolicy.store(policy);
+}
+
+GapPolicy NPX2Thread::getGapPolicy(int slot, int port, int dock)
+{
+    Probe* probe = getProbe(slot, port, dock);
+
+    if (probe != nullptr)
+        return probe->gapPolicy.load();
+
+    return GapPolicy::GAP_FILL_ZEROS;
+}
+
+GapStatistics NPX2Thread::getGapStatistics(int slot, int port, int dock, np::streamsource_t source)
+{
+    ProbeStream* stream = getStream(slot, port, dock, source);
+
+    if (stream != nullptr)
+        return stream->getGapStatistics();
+
+    GapStatistics empty = {};
+    return empty;
+}
+
+Array<GapEvent> NPX2Thread::getRecentGaps(int slot, int port, int dock, np::streamsource_t source)
+{
+    ProbeStream* stream = getStream(slot, port, dock, source);
+
+    if (stream != nullptr)
+        return stream->getRecentGaps();
+
+    return Array<GapEvent>();
+}
+
+PacketErrorCounters NPX2Thread::getPacketErrorCounters(int slot, int port, int dock)
+{
+    Probe* probe = getProbe(slot, port, dock);
+
+    if (probe != nullptr)
+        return probe->statusMonitor->getCounters();
+
+    PacketErrorCounters empty = {};
+    return empty;
+}
+
+uint32 NPX2Thread::getErrorAlertCount(int slot)
+{
+    uint32 alerts = 0;
+
+    for (int i = 0; i < basestations.size(); i++)
+    {
+        if (basestations[i]->slot == slot)
+        {
+            for (int j = 0; j < basestations[i]->probes.size(); j++)
+                alerts += basestations[i]->probes[j]->statusMonitor->getCounters().alerts;
+        }
+    }
+
+    return alerts;
+}
+
+void NPX2Thread::setErrorAlertThreshold(float fraction)
+{
+    for (int i = 0; i < basestations.size(); i++)
+    {
+        for (int j = 0; j < basestations[i]->probes.size(); j++)
+            basestations[i]->probes[j]->statusMonitor->setAlertThreshold(fraction);
+    }
+}
+
+FifoStatistics NPX2Thread::getFifoStatistics(int slot, int port, int dock, np::streamsource_t source)
+{
+    ProbeStream* stream = getStream(slot, port, dock, source);
+
+    if (stream != nullptr)
+        return stream->getFifoStatistics(false);
+
+    FifoStatistics empty = {};
+    return empty;
+}
+
+void NPX2Thread::setFifoPollInterval(int packets)
+{
+    for (int i = 0; i < streams.size(); i++)
+        streams[i]->setFifoPollInterval(packets);
+}
+
+void NPX2Thread::setRingCapacity(int milliseconds)
+{
+    ringCapacity = jmax(1, milliseconds);
+}
+
+int NPX2Thread::getRingCapacity()
+{
+    return ringCapacity;
+}
+
+void NPX2Thread::setOutputMode(SampleOutputMode mode)
+{
+    outputMode = mode;
+
+    for (int i = 0; i < streams.size(); i++)
+        streams[i]->setOutputMode(mode);
+}
+
+SampleOutputMode NPX2Thread::getOutputMode()
+{
+    return outputMode;
+}
+
+RingStatistics NPX2Thread::getRingStatistics(int slot, int port, int dock, np::streamsource_t source)
+{
+    ProbeStream* stream = getStream(slot, port, dock, source);
+
+    if (stream != nullptr)
+        return stream->getRingStatistics();
+
+    RingStatistics empty = {};
+    return empty;
+}
+
+DiagnosticsSample NPX2Thread::getDiagnostics(int slot)
+{
+    for (int i = 0; i < basestations.size(); i++)
+    {
+        if (basestations[i]->slot == slot && basestations[i]->diagnostics != nullptr)
+            return basestations[i]->diagnostics->getLatest();
+    }
+
+    DiagnosticsSample empty = {};
+    return empty;
+}
+
+Array<DiagnosticsSample> NPX2Thread::getDiagnosticsHistory(int slot)
+{
+    for (int i = 0; i < basestations.size(); i++)
+    {
+        if (basestations[i]->slot == slot && basestations[i]->diagnostics != nullptr)
+            return basestations[i]->diagnostics->getHistory();
+    }
+
+    return Array<DiagnosticsSample>();
+}
+
+ProbeStream* NPX2Thread::getStream(int slot, int port, int dock, np::streamsource_t source)
+{
+    Probe* probe = getProbe(slot, port, dock);
+
+    if (probe == nullptr)
+        return nullptr;
+
+    return source == np::SourceLFP ? probe->lfpStream.get() : probe->apStream.get();
+}
+
+Probe* NPX2Thread::getProbe(int slot, int port, int dock)
+{
+    for (int i = 0; i < basestations.size(); i++)
+    {
+        if (basestations[i]->slot == slot)
+        {
+            for (auto probe : basestations[i]->probes)
+            {
+                if (probe->port == port && probe->dock == dock)
+                    return probe;
+            }
+        }
+    }
+    return nullptr;
+}
+
 
 ProbeStatus NPX2Thread::getProbeStatus(int slot, int port, int dock)
 {
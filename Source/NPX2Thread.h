@@ -29,6 +29,12 @@
 #include <string.h>
 
 #include "NPX2Components.h"
+#include "NPX2ConfigScheduler.h"
+#include "NPX2AcquisitionExecutor.h"
+
+#define READINESS_POLL_INTERVAL_MS 	5
+#define READINESS_TIMEOUT_MS 		5000
+#define START_SKEW_TIMEOUT_MS 		2000
 
 class SourceNode;
 class NPX2Thread;
@@ -56,7 +62,11 @@ public:
 
         XmlElement getInfoXml();
 
-        void openConnection();
+        /** Reports that one probe finished initializing: (probe, success, completed, total). */
+        typedef std::function<void(Probe*, bool, int, int)> InitProgressCallback;
+
+        /** Initializes every probe concurrently, then arms each basestation once. */
+        void openConnection(InitProgressCallback progress = nullptr);
         void closeConnection();
 
         int getNumBasestations();
@@ -83,8 +93,29 @@ public:
         void setSelectedProbe(int slot, int port, int dock);
         bool isSelectedProbe(int slot, int port, int dock);
 
-        /** Selects which electrode is connected to each channel. */
-        void selectElectrodes(int slot, int port, int dock, Array<int> channelStatus);
+        /** Selects which electrode is connected to each channel. Only channels that changed are
+            sent unless forceFullRewrite is set, e.g. to recover from a failed configuration. */
+        void selectElectrodes(int slot, int port, int dock, Array<int> channelStatus, bool forceFullRewrite = false);
+
+        /** Copies the channel -> electrode table of a probe; safe while acquiring. */
+        bool getChannelTable(int slot, int port, int dock, ChannelTableSnapshot& table);
+
+        /** Duration of each hardware discovery and initialization stage since the plugin loaded. */
+        Array<StartupTiming> getStartupTimings();
+
+        /** Selects which probes may be configured concurrently. */
+        void setLaneGranularity(LaneGranularity granularity);
+
+        /** Per-probe timings of the last batch of configuration jobs. */
+        Array<ConfigJobTiming> getConfigTimings();
+
+        /** Returns the configuration commit counts and latency of a probe. */
+        ProbeConfigStatistics getConfigStatistics(int slot, int port, int dock);
+
+        bool isApHighPassDisabled(int slot, int port, int dock);
+
+        /** Returns how many electrode selection API calls were made and saved on a probe. */
+        ElectrodeSelectionStatistics getElectrodeSelectionStatistics(int slot, int port, int dock);
 
         /** Selects which reference is used for each channel. */
         void setAllReferences(int slot, int port, int dock, int refId);
@@ -98,6 +129,20 @@ public:
         /** Stops data transfer.*/
         bool stopAcquisition() override;
 
+        /** Milliseconds from startAcquisition until the basestations were triggered, or -1 if
+            acquisition has not started yet. */
+        float getStartLatency();
+
+        /** Selects whether the slots are started one by one in software or together by a
+            hardware trigger line; only call while stopped. */
+        void setStartTriggerMode(StartTriggerMode mode);
+        StartTriggerMode getStartTriggerMode();
+
+        /** Spread between the earliest and latest slot start, estimated from the first hardware
+            timestamps of the last run, in ms; -1 if not measured yet. */
+        float getStartSkew();
+        Array<SlotStartTime> getSlotStartTimes();
+
         // DataThread Methods
 
         /** Returns the number of virtual subprocessors this source can generate */
@@ -127,6 +172,69 @@ public:
         /** Toggles between auto-restart setting. */
         void setAutoRestart(bool restart);
 
+        /** Selects how the probe threads drain their packet FIFOs. */
+        void setAcquisitionMode(AcquisitionMode mode);
+        AcquisitionMode getAcquisitionMode();
+
+        /** Selects whether each probe gets its own reader thread or all probes share a worker pool. */
+        void setAcquisitionThreading(AcquisitionThreading threading);
+        AcquisitionThreading getAcquisitionThreading();
+
+        /** Sets the number of shared pool workers; 0 uses all but one of the CPUs. */
+        void setCoreBudget(int cores);
+        int getCoreBudget();
+
+        /** Sets the maximum number of packets drained per read in batched mode. */
+        void setPacketBatchSize(int packetsPerRead);
+        int getPacketBatchSize();
+
+        /** Returns the batch sizes achieved by a probe stream since acquisition started. */
+        BatchStatistics getBatchStatistics(int slot, int port, int dock, np::streamsource_t source = np::SourceAP);
+
+        /** Returns the hardware timestamp discontinuities seen on a probe stream. */
+        TimestampStatistics getTimestampStatistics(int slot, int port, int dock, np::streamsource_t source = np::SourceAP);
+
+        /** Selects how a probe repairs missing sample ranges. */
+        void setGapPolicy(int slot, int port, int dock, GapPolicy policy);
+        GapPolicy getGapPolicy(int slot, int port, int dock);
+
+        /** Returns the gap totals of a probe stream since acquisition started. */
+        GapStatistics getGapStatistics(int slot, int port, int dock, np::streamsource_t source = np::SourceAP);
+        Array<GapEvent> getRecentGaps(int slot, int port, int dock, np::streamsource_t source = np::SourceAP);
+
+        /** Returns the packet status error counts of a probe since acquisition started. */
+        PacketErrorCounters getPacketErrorCounters(int slot, int port, int dock);
+
+        /** Returns the number of error rate alerts raised by all probes on a basestation. */
+        uint32 getErrorAlertCount(int slot);
+
+        /** Sets the fraction of erroneous packets per second that raises an alert. */
+        void setErrorAlertThreshold(float fraction);
+
+        /** Returns the FIFO occupancy of a probe stream without resetting the peak seen by the editor. */
+        FifoStatistics getFifoStatistics(int slot, int port, int dock, np::streamsource_t source = np::SourceAP);
+
+        /** Sets how many packets are read between two FIFO status polls on every stream. */
+        void setFifoPollInterval(int packets);
+
+        /** Sets the duration of data each stream's sample ring can hold. */
+        void setRingCapacity(int milliseconds);
+        int getRingCapacity();
+
+        /** Selects how raw int16 samples are scaled when they reach the DataBuffer. Changes
+            the reported bit-volts, so the signal chain must be updated afterwards. */
+        void setOutputMode(SampleOutputMode mode);
+        SampleOutputMode getOutputMode();
+
+        /** Returns the sample ring occupancy and overflow counters of a probe stream. */
+        RingStatistics getRingStatistics(int slot, int port, int dock, np::streamsource_t source = np::SourceAP);
+
+        /** Returns the latest basestation link diagnostics for a slot. */
+        DiagnosticsSample getDiagnostics(int slot);
+
+        /** Returns the rolling diagnostics history for a slot, oldest first. */
+        Array<DiagnosticsSample> getDiagnosticsHistory(int slot);
+
         CriticalSection* getMutex()
         {
             return &displayMutex;
@@ -143,12 +251,17 @@ public:
             int dock;
             Array<int> channelStatus;
             int refChannelIndex;
+            int gapPolicy;
+            bool disableHighPass;
         } p_settings;
         Array<probeSettings> probeSettingsUpdateQueue;
 
         void updateProbeSettingsQueue();
         void applyProbeSettingsQueue();
 
+        /** Applies electrodes, reference and AP filter of a probe in one configuration transaction. */
+        bool applyProbeSettings(const probeSettings& settings);
+
         void setDirectoryForSlot(int slotIndex, File directory);
         File getDirectoryForSlot(int slotIndex);
 
@@ -157,8 +270,23 @@ private:
 
         Neuropix2API api;
 
+        /** Installs a trace recording or replay backend if NPX2_TRACE_RECORD or NPX2_TRACE_REPLAY is set. */
+        void selectBackend();
+
+        /** Opens every basestation and scans its ports concurrently, keeping slot/port/dock order. */
+        void discoverHardware();
+
+        /** Runs Probe::init for all probes on the lanes selected by setLaneGranularity. */
+        void initializeProbes(InitProgressCallback progress);
+
         OwnedArray<Basestation> basestations;
 
+        /** One entry per subprocessor, in the same order as sourceBuffers (AP, then LFP if available, per probe) */
+        Array<ProbeStream*> streams;
+
+        Probe* getProbe(int slot, int port, int dock);
+        ProbeStream* getStream(int slot, int port, int dock, np::streamsource_t source);
+
         //Initialization
         bool basestationAvailable;
         int totalProbes;
@@ -169,6 +297,33 @@ private:
         int selectedDock;
 
         //Acquisition-related
+        AcquisitionMode acquisitionMode;
+        AcquisitionThreading acquisitionThreading;
+        int coreBudget;
+        ScopedPointer<AcquisitionExecutor> executor;
+        int ringCapacity;
+        LaneGranularity laneGranularity;
+        Array<ConfigJobTiming> configTimings;
+        SampleOutputMode outputMode;
+        HeapBlock<float> drainScratch;
+        int packetBatchSize;
+        int64 startRequestTicks;
+        float startLatency;
+        StartTriggerMode startTriggerMode; //As set by the user and saved with the settings
+        StartTriggerMode activeStartTriggerMode; //What the current run actually uses
+        int syncMasterSlot;
+        int startTriggerSlot; //Slot whose software trigger drives START_TRIGGER_LINE
+        int getStartTriggerSlot();
+        bool triggered;
+        int64 triggerTicks;
+        float startSkew;
+        Array<SlotStartTime> slotStartTimes;
+        void configureStartTrigger();
+        bool bindStartTriggers(StartTriggerMode mode);
+        bool measureStartSkew();
+        bool signalChainReady();
+        bool probesArmed();
+        void triggerAcquisition(bool timedOut);
         bool autoRestart;
         bool internalTrigger;
         int counter; //?
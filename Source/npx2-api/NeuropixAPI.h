@@ -13,10 +13,18 @@ extern "C" {
 
 #include <stdint.h>
 #include <stdbool.h>
+#ifdef _WIN32
 #include <Windows.h>
 
 #define NP_EXPORT __declspec(dllexport)
 #define NP_APIC __stdcall
+#else
+//Only the simulated backend exists outside Windows
+typedef unsigned char byte;
+
+#define NP_EXPORT __attribute__((visibility("default")))
+#define NP_APIC
+#endif
 
 namespace np {
 
@@ -0,0 +1,564 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <DataThreadHeaders.h>
+#include <iostream>
+#include <sstream>
+
+#include "NPX2BenchRig.h"
+#include "../NPX2SampleConverter.h"
+#include "NeuropixSimulator.h"
+
+/**
+
+	npx2_bench: end-to-end acquisition throughput against the simulated hardware.
+
+	Each run brings up a BenchRig on the requested number of probes and
+	drains their rings from the calling thread like NPX2Thread::updateBuffer.
+	After a warm-up it measures for a fixed time and reports, per run:
+
+		packetsPerSecond      AP packets read per second, over all probes
+		expectedPerSecond     What the hardware produced (probes * 30 kHz)
+		cpuPercentPerProbe    Process CPU time / wall time / probes, including
+		                      the simulator that stands in for the hardware
+		fifoHighWater         Highest hardware FIFO fill fraction seen
+		ringHighWater         Highest ring occupancy, as a fraction of capacity
+		droppedSamples        Samples lost to full rings
+		missingSamples        Samples lost to hardware FIFO overflows
+		workers, steals       Size of the shared pool and the tasks it moved
+		                      between workers, 0 with per-probe threads
+
+	Before the acquisition runs, each SampleConverter kernel this machine
+	supports converts the same block of packets for --kernel-seconds, and
+	the report lists its samplesPerSecond under "kernels".
+
+	Usage:
+		npx2_bench [--probes 1,2,4,...] [--batch 1,16,64] [--modes single,batched,callback]
+		           [--threading per-probe,pool] [--cores 0]
+		           [--seconds 3] [--warmup 1] [--kernel-seconds 0.5]
+		           [--output results.json] [--verbose]
+
+	The JSON goes to stdout unless --output is given. --batch only applies to
+	the batched mode, --threading to the single and batched modes. --cores is
+	the shared pool size, 0 for all but one CPU. Log output from the components
+	is suppressed unless --verbose is given.
+
+*/
+
+#define BENCH_FIRST_SLOT 		2
+
+struct BenchSettings
+{
+	Array<int> probeCounts;
+	Array<int> batchSizes;
+	Array<int> modes; //AcquisitionMode values
+	Array<int> threadings; //AcquisitionThreading values
+	int coreBudget;
+	double seconds;
+	double warmup;
+	double kernelSeconds;
+	String outputPath;
+	bool verbose;
+};
+
+struct BenchResult
+{
+	int probes;
+	AcquisitionMode mode;
+	AcquisitionThreading threading;
+	int batchSize;
+	int workers;
+	int64 steals;
+	double seconds;
+	uint64 packets;
+	double packetsPerSecond;
+	double expectedPerSecond;
+	double meanBatchSize;
+	double cpuPercentPerProbe;
+	float fifoHighWater;
+	float ringHighWater;
+	uint64 droppedSamples;
+	uint64 missingSamples;
+};
+
+struct KernelResult
+{
+	SampleConverter::Isa isa;
+	double seconds;
+	uint64 samples;
+	double samplesPerSecond;
+};
+
+static const char* getModeName(AcquisitionMode mode)
+{
+	switch (mode)
+	{
+	case SINGLE_PACKET: return "single";
+	case BATCHED_PACKETS: return "batched";
+	case PACKET_CALLBACK: return "callback";
+	}
+
+	return "unknown";
+}
+
+static const char* getThreadingName(AcquisitionThreading threading)
+{
+	return threading == SHARED_POOL ? "pool" : "per-probe";
+}
+
+/** Simulated hardware with at least numProbes probes, filling whole headstages first. */
+static npsim::SimulatorConfig getLayout(int numProbes)
+{
+	npsim::SimulatorConfig config = npsim::getDefaultConfig();
+
+	int probesPerSlot = NUM_PORTS * NUM_DOCKS;
+	int numSlots = (numProbes + probesPerSlot - 1) / probesPerSlot;
+
+	if (numProbes >= probesPerSlot)
+	{
+		config.portsPerSlot = NUM_PORTS;
+		config.docksPerPort = NUM_DOCKS;
+	}
+	else
+	{
+		config.docksPerPort = numProbes > NUM_PORTS ? NUM_DOCKS : 1;
+		config.portsPerSlot = (numProbes + config.docksPerPort - 1) / config.docksPerPort;
+	}
+
+	config.slotMask = 0;
+
+	for (int i = 0; i < numSlots; i++)
+		config.slotMask |= 1u << (BENCH_FIRST_SLOT + i);
+
+	config.openLatencyMs = 0;
+	config.initLatencyMs = 0;
+	config.configLatencyMs = 0;
+
+	return config;
+}
+
+static bool runBenchmark(const BenchSettings& settings, int numProbes, AcquisitionMode mode, AcquisitionThreading threading,
+	int batchSize, BenchResult& result)
+{
+
+	npsim::configure(getLayout(numProbes));
+
+	BenchRig rig(numProbes);
+	rig.setThreading(threading, settings.coreBudget);
+
+	if (!rig.isReady() || !rig.start(mode, batchSize))
+		return false;
+
+	rig.run(settings.warmup);
+
+	// Start of the measurement window
+	uint64 dropped = 0;
+	uint64 missing = 0;
+
+	for (auto stream : rig.streams)
+	{
+		stream->resetBatchStatistics();
+		stream->getFifoStatistics(true);
+		dropped += stream->getRingStatistics().samplesDropped;
+		missing += stream->getGapStatistics().missingSamples;
+	}
+
+	int64 steals = rig.getExecutorStatistics().steals;
+	double cpuStart = ProcessStats::getCpuSeconds();
+	int64 start = Time::getHighResolutionTicks();
+
+	rig.run(settings.seconds);
+
+	double elapsed = getSecondsSince(start);
+	double cpu = ProcessStats::getCpuSeconds() - cpuStart;
+	ExecutorStatistics pool = rig.getExecutorStatistics();
+
+	result.probes = numProbes;
+	result.mode = mode;
+	result.threading = threading;
+	result.batchSize = batchSize;
+	result.workers = pool.workers;
+	result.steals = pool.steals - steals;
+	result.seconds = elapsed;
+	result.packets = 0;
+	result.fifoHighWater = 0;
+	result.ringHighWater = 0;
+	result.droppedSamples = 0;
+	result.missingSamples = 0;
+
+	uint64 reads = 0;
+
+	for (auto stream : rig.apStreams)
+	{
+		BatchStatistics batches = stream->getBatchStatistics();
+		result.packets += batches.packets;
+		reads += batches.reads;
+	}
+
+	for (auto stream : rig.streams)
+	{
+		RingStatistics ring = stream->getRingStatistics();
+
+		result.fifoHighWater = jmax(result.fifoHighWater, stream->getFifoStatistics(true).peak);
+		result.ringHighWater = jmax(result.ringHighWater, ring.capacity > 0 ? float(ring.highWater) / float(ring.capacity) : 0.0f);
+		result.droppedSamples += ring.samplesDropped;
+		result.missingSamples += stream->getGapStatistics().missingSamples;
+	}
+
+	result.droppedSamples -= dropped;
+	result.missingSamples -= missing;
+
+	result.packetsPerSecond = double(result.packets) / elapsed;
+	result.expectedPerSecond = double(numProbes) * SAMPLERATE;
+	result.meanBatchSize = reads > 0 ? double(result.packets) / double(reads) : 0.0;
+	result.cpuPercentPerProbe = 100.0 * cpu / elapsed / numProbes;
+
+	return true;
+}
+
+/** Converts one ring drain worth of random packets over and over with a single kernel. */
+static void runKernelBenchmark(SampleConverter::Isa isa, double seconds, KernelResult& result)
+{
+
+	HeapBlock<int16_t> input(RING_DRAIN_SIZE * NUM_CHANNELS);
+	HeapBlock<float> output(RING_DRAIN_SIZE * NUM_CHANNELS);
+	Random random(1);
+
+	for (int i = 0; i < RING_DRAIN_SIZE * NUM_CHANNELS; i++)
+		input[i] = int16_t(random.nextInt(65536) - 32768);
+
+	ScopedPointer<SampleConverter> converter = new SampleConverter();
+	converter->setScale(NPX2_BITVOLTS);
+	converter->setIsa(isa);
+
+	// Warm the caches and let the clock settle before timing
+	converter->convert(input, output, RING_DRAIN_SIZE);
+
+	uint64 blocks = 0;
+	int64 start = Time::getHighResolutionTicks();
+
+	do
+	{
+		for (int i = 0; i < 64; i++)
+			converter->convert(input, output, RING_DRAIN_SIZE);
+
+		blocks += 64;
+	} while (getSecondsSince(start) < seconds);
+
+	result.isa = isa;
+	result.seconds = getSecondsSince(start);
+	result.samples = blocks * RING_DRAIN_SIZE * NUM_CHANNELS;
+	result.samplesPerSecond = double(result.samples) / result.seconds;
+}
+
+static var toJson(const KernelResult& result)
+{
+	DynamicObject::Ptr kernel = new DynamicObject();
+
+	kernel->setProperty("isa", SampleConverter::getIsaName(result.isa));
+	kernel->setProperty("seconds", result.seconds);
+	kernel->setProperty("samples", int64(result.samples));
+	kernel->setProperty("samplesPerSecond", result.samplesPerSecond);
+
+	return var(kernel.get());
+}
+
+static var toJson(const BenchResult& result)
+{
+	DynamicObject::Ptr run = new DynamicObject();
+
+	run->setProperty("probes", result.probes);
+	run->setProperty("mode", getModeName(result.mode));
+	run->setProperty("threading", getThreadingName(result.threading));
+	run->setProperty("batchSize", result.batchSize);
+	run->setProperty("workers", result.workers);
+	run->setProperty("steals", result.steals);
+	run->setProperty("seconds", result.seconds);
+	run->setProperty("packets", int64(result.packets));
+	run->setProperty("packetsPerSecond", result.packetsPerSecond);
+	run->setProperty("expectedPerSecond", result.expectedPerSecond);
+	run->setProperty("meanBatchSize", result.meanBatchSize);
+	run->setProperty("cpuPercentPerProbe", result.cpuPercentPerProbe);
+	run->setProperty("fifoHighWater", result.fifoHighWater);
+	run->setProperty("ringHighWater", result.ringHighWater);
+	run->setProperty("droppedSamples", int64(result.droppedSamples));
+	run->setProperty("missingSamples", int64(result.missingSamples));
+
+	return var(run.get());
+}
+
+static Array<int> parseList(const String& text)
+{
+	Array<int> values;
+	StringArray tokens = StringArray::fromTokens(text, ",", "");
+
+	for (int i = 0; i < tokens.size(); i++)
+	{
+		if (tokens[i].trim().isNotEmpty())
+			values.add(tokens[i].trim().getIntValue());
+	}
+
+	return values;
+}
+
+static bool parseArguments(int argc, char* argv[], BenchSettings& settings)
+{
+	settings.probeCounts = parseList("1,2,4,8,16,32,64");
+	settings.batchSizes = parseList("1,16,64");
+	settings.modes.add(SINGLE_PACKET);
+	settings.modes.add(BATCHED_PACKETS);
+	settings.modes.add(PACKET_CALLBACK);
+	settings.threadings.add(THREAD_PER_PROBE);
+	settings.coreBudget = 0;
+	settings.seconds = 3.0;
+	settings.warmup = 1.0;
+	settings.kernelSeconds = 0.5;
+	settings.verbose = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		String argument(argv[i]);
+		String value = i + 1 < argc ? String(argv[i + 1]) : String();
+
+		if (argument == "--verbose")
+		{
+			settings.verbose = true;
+			continue;
+		}
+
+		if (value.isEmpty())
+		{
+			std::cerr << "Missing value for " << argument << std::endl;
+			return false;
+		}
+
+		i++;
+
+		if (argument == "--probes")
+			settings.probeCounts = parseList(value);
+		else if (argument == "--batch")
+			settings.batchSizes = parseList(value);
+		else if (argument == "--seconds")
+			settings.seconds = value.getDoubleValue();
+		else if (argument == "--warmup")
+			settings.warmup = value.getDoubleValue();
+		else if (argument == "--kernel-seconds")
+			settings.kernelSeconds = value.getDoubleValue();
+		else if (argument == "--output")
+			settings.outputPath = value;
+		else if (argument == "--cores")
+			settings.coreBudget = value.getIntValue();
+		else if (argument == "--threading")
+		{
+			settings.threadings.clear();
+
+			StringArray names = StringArray::fromTokens(value, ",", "");
+
+			for (int n = 0; n < names.size(); n++)
+			{
+				if (names[n] == "per-probe")
+					settings.threadings.add(THREAD_PER_PROBE);
+				else if (names[n] == "pool")
+					settings.threadings.add(SHARED_POOL);
+				else
+				{
+					std::cerr << "Unknown threading " << names[n] << std::endl;
+					return false;
+				}
+			}
+		}
+		else if (argument == "--modes")
+		{
+			settings.modes.clear();
+
+			StringArray names = StringArray::fromTokens(value, ",", "");
+
+			for (int n = 0; n < names.size(); n++)
+			{
+				if (names[n] == "single")
+					settings.modes.add(SINGLE_PACKET);
+				else if (names[n] == "batched")
+					settings.modes.add(BATCHED_PACKETS);
+				else if (names[n] == "callback")
+					settings.modes.add(PACKET_CALLBACK);
+				else
+				{
+					std::cerr << "Unknown mode " << names[n] << std::endl;
+					return false;
+				}
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown argument " << argument << std::endl;
+			return false;
+		}
+	}
+
+	for (int i = 0; i < settings.probeCounts.size(); i++)
+	{
+		int count = settings.probeCounts[i];
+
+		if (count < 1 || count > (MAX_NUM_SLOTS - BENCH_FIRST_SLOT) * NUM_PORTS * NUM_DOCKS)
+		{
+			std::cerr << "Probe count out of range: " << count << std::endl;
+			return false;
+		}
+	}
+
+	for (int i = 0; i < settings.batchSizes.size(); i++)
+	{
+		if (settings.batchSizes[i] < 1 || settings.batchSizes[i] > SAMPLECOUNT)
+		{
+			std::cerr << "Batch size must be between 1 and " << SAMPLECOUNT << std::endl;
+			return false;
+		}
+	}
+
+	if (settings.coreBudget < 0 || settings.coreBudget > MAX_ACQUISITION_WORKERS)
+	{
+		std::cerr << "Core budget must be between 0 and " << MAX_ACQUISITION_WORKERS << std::endl;
+		return false;
+	}
+
+	return settings.seconds > 0 && settings.warmup >= 0 && settings.kernelSeconds > 0;
+}
+
+int main(int argc, char* argv[])
+{
+
+	BenchSettings settings;
+
+	if (!parseArguments(argc, argv, settings))
+		return 1;
+
+	// The components log every start and stop to stdout, which would corrupt the JSON
+	std::stringstream discarded;
+	std::streambuf* console = std::cout.rdbuf();
+
+	if (!settings.verbose)
+		std::cout.rdbuf(discarded.rdbuf());
+
+	Array<var> kernels;
+
+	for (int i = 0; i < SampleConverter::NUM_ISAS; i++)
+	{
+		SampleConverter::Isa isa = SampleConverter::Isa(i);
+
+		if (!SampleConverter::isSupported(isa))
+			continue;
+
+		KernelResult result;
+		runKernelBenchmark(isa, settings.kernelSeconds, result);
+
+		std::cerr << SampleConverter::getIsaName(isa) << " kernel: "
+			<< int64(result.samplesPerSecond) << " samples/s" << std::endl;
+
+		kernels.add(toJson(result));
+	}
+
+	Array<var> runs;
+	bool ok = true;
+
+	for (int p = 0; p < settings.probeCounts.size(); p++)
+	{
+		for (int m = 0; m < settings.modes.size(); m++)
+		{
+			AcquisitionMode mode = AcquisitionMode(settings.modes[m]);
+
+			// The batch size only changes anything when reading batches
+			Array<int> batchSizes = settings.batchSizes;
+
+			if (mode != BATCHED_PACKETS)
+			{
+				batchSizes.clear();
+				batchSizes.add(mode == SINGLE_PACKET ? 1 : SAMPLECOUNT);
+			}
+
+			// Callbacks run on the API's threads, so there is nothing to schedule
+			Array<int> threadings = settings.threadings;
+
+			if (mode == PACKET_CALLBACK)
+			{
+				threadings.clear();
+				threadings.add(THREAD_PER_PROBE);
+			}
+
+			for (int t = 0; t < threadings.size(); t++)
+			{
+				AcquisitionThreading threading = AcquisitionThreading(threadings[t]);
+
+				for (int b = 0; b < batchSizes.size(); b++)
+				{
+					BenchResult result;
+
+					std::cerr << settings.probeCounts[p] << " probes, " << getModeName(mode)
+						<< ", " << getThreadingName(threading) << ", batch " << batchSizes[b] << ": ";
+
+					if (!runBenchmark(settings, settings.probeCounts[p], mode, threading, batchSizes[b], result))
+					{
+						std::cerr << "could not set up the simulated hardware" << std::endl;
+						ok = false;
+						continue;
+					}
+
+					std::cerr << int64(result.packetsPerSecond) << " packets/s of "
+						<< int64(result.expectedPerSecond) << ", "
+						<< result.cpuPercentPerProbe << "% CPU per probe, "
+						<< result.droppedSamples + result.missingSamples << " samples lost" << std::endl;
+
+					runs.add(toJson(result));
+
+					discarded.str(std::string());
+				}
+			}
+		}
+	}
+
+	std::cout.rdbuf(console);
+
+	DynamicObject::Ptr report = new DynamicObject();
+
+	report->setProperty("benchmark", "npx2_bench");
+	report->setProperty("warmupSeconds", settings.warmup);
+	report->setProperty("measureSeconds", settings.seconds);
+	report->setProperty("kernels", kernels);
+	report->setProperty("runs", runs);
+
+	String json = JSON::toString(var(report.get()));
+
+	if (settings.outputPath.isNotEmpty())
+	{
+		if (!File(settings.outputPath).replaceWithText(json))
+		{
+			std::cerr << "Could not write " << settings.outputPath << std::endl;
+			return 1;
+		}
+	}
+	else
+	{
+		std::cout << json << std::endl;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,297 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "NPX2BenchRig.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#elif defined(__APPLE__)
+#include <sys/resource.h>
+#include <mach/mach.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fstream>
+#endif
+
+#define BENCH_ARM_TIMEOUT_MS 	5000
+#define BENCH_BUFFER_SIZE 		10000
+
+// The components report BIST results to the GUI's message center
+namespace CoreServices
+{
+	void sendStatusMessage(const String& text) { std::cerr << text << std::endl; }
+	void sendStatusMessage(const char* text) { std::cerr << text << std::endl; }
+}
+
+double ProcessStats::getCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+
+	return double(k.QuadPart + u.QuadPart) * 1e-7;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+		+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+int64 ProcessStats::getResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return int64(counters.WorkingSetSize);
+
+	return -1;
+#elif defined(__APPLE__)
+	mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+		return int64(info.resident_size);
+
+	return -1;
+#else
+	std::ifstream statm("/proc/self/statm");
+	int64 pages, resident;
+
+	if (statm >> pages >> resident)
+		return resident * int64(sysconf(_SC_PAGESIZE));
+
+	return -1;
+#endif
+}
+
+int ProcessStats::getThreadCount()
+{
+#ifdef _WIN32
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+
+	if (snapshot == INVALID_HANDLE_VALUE)
+		return -1;
+
+	THREADENTRY32 entry;
+	entry.dwSize = sizeof(entry);
+
+	DWORD process = GetCurrentProcessId();
+	int count = 0;
+
+	for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry))
+	{
+		if (entry.th32OwnerProcessID == process)
+			count++;
+	}
+
+	CloseHandle(snapshot);
+	return count;
+#elif defined(__APPLE__)
+	thread_act_array_t threads;
+	mach_msg_type_number_t count;
+
+	if (task_threads(mach_task_self(), &threads, &count) != KERN_SUCCESS)
+		return -1;
+
+	for (mach_msg_type_number_t i = 0; i < count; i++)
+		mach_port_deallocate(mach_task_self(), threads[i]);
+
+	vm_deallocate(mach_task_self(), (vm_address_t)threads, count * sizeof(thread_act_t));
+	return int(count);
+#else
+	std::ifstream status("/proc/self/status");
+	std::string line;
+
+	while (std::getline(status, line))
+	{
+		if (line.compare(0, 8, "Threads:") == 0)
+			return atoi(line.c_str() + 8);
+	}
+
+	return -1;
+#endif
+}
+
+double getSecondsSince(int64 ticks)
+{
+	return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - ticks);
+}
+
+BenchRig::BenchRig(int maxProbes)
+	: ready(false), requestedProbes(maxProbes), threading(THREAD_PER_PROBE), coreBudget(0)
+{
+
+	uint32 slotMask;
+	NPX2Backend::get().getAvailableSlots(&slotMask);
+
+	for (int slot = 0; slot < MAX_NUM_SLOTS; slot++)
+	{
+		if ((slotMask & (1u << slot)) == 0)
+			continue;
+
+		Basestation* bs = basestations.add(new Basestation(slot));
+
+		if (!bs->isOpen())
+			return;
+
+		bs->discoverProbes();
+
+		for (int i = 0; i < bs->getProbeCount(); i++)
+		{
+			if (bs->probes[i]->init() && (maxProbes < 0 || probes.size() < maxProbes))
+				probes.add(bs->probes[i]);
+		}
+
+		bs->init();
+	}
+
+	for (auto probe : probes)
+	{
+		apStreams.add(probe->apStream);
+		streams.add(probe->apStream);
+
+		if (probe->lfpStream != nullptr)
+			streams.add(probe->lfpStream);
+	}
+
+	for (auto stream : streams)
+	{
+		stream->buffer = buffers.add(new DataBuffer(NUM_CHANNELS, BENCH_BUFFER_SIZE));
+		stream->setRingCapacity(DEFAULT_RING_CAPACITY_MS);
+	}
+
+	scratch.malloc(RING_DRAIN_SIZE * NUM_CHANNELS);
+
+	ready = probes.size() > 0 && (maxProbes < 0 || probes.size() == maxProbes);
+}
+
+BenchRig::~BenchRig()
+{
+	stop();
+
+	for (auto stream : streams)
+		stream->buffer = nullptr;
+}
+
+bool BenchRig::start(AcquisitionMode mode, int batchSize, StartTriggerMode triggerMode)
+{
+
+	for (int i = 0; i < basestations.size(); i++)
+		basestations[i]->setStartTrigger(triggerMode, i == 0);
+
+	for (auto probe : probes)
+	{
+		probe->acquisitionMode = mode;
+		probe->acquisitionThreading = threading;
+		probe->setPacketBatchSize(batchSize);
+		probe->startAcquisition();
+	}
+
+	if (threading == SHARED_POOL && mode != PACKET_CALLBACK)
+	{
+		executor = new AcquisitionExecutor(coreBudget);
+		executor->start(probes);
+	}
+
+	int64 armStart = Time::getHighResolutionTicks();
+	bool armed = false;
+
+	while (!armed && getSecondsSince(armStart) * 1000.0 < BENCH_ARM_TIMEOUT_MS)
+	{
+		armed = true;
+
+		for (auto probe : probes)
+			armed = armed && probe->isArmed();
+
+		if (!armed)
+			Thread::sleep(1);
+	}
+
+	// With a hardware-synchronized start the master's trigger reaches every slot
+	for (int i = 0; i < basestations.size(); i++)
+	{
+		if (triggerMode == START_SOFTWARE || i == 0)
+			basestations[i]->trigger();
+	}
+
+	return armed;
+}
+
+void BenchRig::stop()
+{
+	executor = nullptr;
+
+	for (auto bs : basestations)
+		bs->stopAcquisition();
+}
+
+void BenchRig::setThreading(AcquisitionThreading threading_, int coreBudget_)
+{
+	threading = threading_;
+	coreBudget = coreBudget_;
+}
+
+ExecutorStatistics BenchRig::getExecutorStatistics() const
+{
+	if (executor != nullptr)
+		return executor->getStatistics();
+
+	ExecutorStatistics empty = {};
+	return empty;
+}
+
+int BenchRig::drain()
+{
+	int moved = 0;
+
+	for (int i = 0; i < streams.size(); i++)
+	{
+		moved += streams[i]->drain(scratch, RING_DRAIN_SIZE);
+		streams[i]->buffer->clear();
+	}
+
+	return moved;
+}
+
+void BenchRig::run(double seconds)
+{
+	int64 start = Time::getHighResolutionTicks();
+
+	while (getSecondsSince(start) < seconds)
+	{
+		if (drain() == 0)
+			Thread::sleep(1);
+	}
+}
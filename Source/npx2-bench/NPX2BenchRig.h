@@ -0,0 +1,101 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NPX2BENCHRIG_H__
+#define __NPX2BENCHRIG_H__
+
+#include <DataThreadHeaders.h>
+
+#include "../NPX2Components.h"
+#include "../NPX2AcquisitionExecutor.h"
+
+/** Resource usage of the current process. */
+namespace ProcessStats
+{
+	/** User plus system CPU time. */
+	double getCpuSeconds();
+
+	/** Resident set size, or -1 if the platform does not report it. */
+	int64 getResidentBytes();
+
+	/** Number of threads, or -1 if the platform does not report it. */
+	int getThreadCount();
+}
+
+double getSecondsSince(int64 ticks);
+
+/**
+
+	The basestations and probes of the simulator's current configuration,
+	set up and driven the way NPX2Thread does it, without the GUI.
+
+	Used by npx2_bench and npx2_soak. The DataBuffers are emptied after
+	every drain, in place of the signal chain.
+
+*/
+class BenchRig
+{
+public:
+	/** Opens every basestation and initializes its probes; only the first
+		maxProbes (all if -1) take part in acquisition. */
+	BenchRig(int maxProbes = -1);
+	~BenchRig();
+
+	/** False if a basestation failed to open or too few probes came up. */
+	bool isReady() const { return ready; }
+
+	/** Arms the probes, waits until they are reading and triggers them. The
+		first basestation is the master in START_HARDWARE_SYNCHRONIZED mode. */
+	bool start(AcquisitionMode mode, int batchSize, StartTriggerMode triggerMode = START_SOFTWARE);
+	void stop();
+
+	/** Applies to the next start; coreBudget is the shared pool size, 0 for all but one CPU. */
+	void setThreading(AcquisitionThreading threading, int coreBudget = 0);
+
+	/** Statistics of the shared pool, all zero with THREAD_PER_PROBE or before start. */
+	ExecutorStatistics getExecutorStatistics() const;
+
+	/** One pass of NPX2Thread::updateBuffer; returns the number of samples moved. */
+	int drain();
+
+	/** Drains for the given time, sleeping 1 ms whenever a pass moved nothing. */
+	void run(double seconds);
+
+	OwnedArray<Basestation> basestations;
+	Array<Probe*> probes;
+	Array<ProbeStream*> apStreams;
+	Array<ProbeStream*> streams; //AP and LFP
+
+private:
+	bool ready;
+	int requestedProbes;
+
+	AcquisitionThreading threading;
+	int coreBudget;
+	ScopedPointer<AcquisitionExecutor> executor;
+
+	OwnedArray<DataBuffer> buffers;
+	HeapBlock<float> scratch;
+};
+
+#endif  // __NPX2BENCHRIG_H__
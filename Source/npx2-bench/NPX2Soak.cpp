@@ -0,0 +1,553 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <DataThreadHeaders.h>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+
+#include "NPX2BenchRig.h"
+#include "NeuropixSimulator.h"
+
+/**
+
+	npx2_soak: long-running scalability test on the simulated hardware.
+
+	Brings up the full topology by default (MAX_NUM_SLOTS basestations, each
+	with NUM_PORTS * NUM_DOCKS probes), starts it with a hardware-synchronized
+	trigger and streams for hours. The main thread drains the rings like
+	NPX2Thread::updateBuffer, while a stand-in for the GUI message thread
+	polls probe status, FIFO fill and error alerts at the editor's timer
+	rates and records how long each tick was held up.
+
+	Every report interval one JSON line is written with:
+
+		elapsedSeconds        Since the trigger
+		rssBytes, threads     Process resident memory and thread count
+		packetsPerSecond      AP packets read per second over the interval
+		droppedSamples        Samples lost to full rings, over the interval
+		missingSamples        Samples lost to hardware FIFO overflows, over the interval
+		discontinuities       Timestamp jumps over the interval
+		driftMinMs/driftMaxMs Time of the newest sample minus wall time since the
+		                      first one, over all AP streams; a trend over the run
+		                      means lost samples or a consumer falling behind
+		guiStallMaxMs/P99Ms   How late GUI ticks finished relative to their schedule
+
+	A final summary line adds the start skew across slots, the RSS growth since
+	the first report, whether the thread count stayed constant and, with
+	--threading pool, the size of the shared pool and its steal count. The exit
+	code is 1 if the RSS grew by more than --max-rss-growth MB or the thread
+	count changed.
+
+	Usage:
+		npx2_soak [--slots 32] [--ports 4] [--docks 2] [--hours 4 | --seconds N]
+		          [--interval 60] [--mode batched|single|callback] [--batch 64]
+		          [--threading per-probe|pool] [--cores 0]
+		          [--max-rss-growth 64] [--output soak.jsonl] [--verbose]
+
+*/
+
+#define SOAK_STATUS_INTERVAL_MS 	10  //ProbeButton timer
+#define SOAK_FIFO_INTERVAL_MS 		500 //FifoMonitor timer
+#define SOAK_START_SKEW_TIMEOUT_MS 	2000
+
+struct SoakSettings
+{
+	int slots;
+	int ports;
+	int docks;
+	double seconds;
+	double interval;
+	AcquisitionMode mode;
+	int batchSize;
+	AcquisitionThreading threading;
+	int coreBudget;
+	double maxRssGrowthMb;
+	String outputPath;
+	bool verbose;
+};
+
+/**
+
+	Does the plugin's share of the work on the GUI message thread: the probe
+	buttons read the probe status every 10 ms and the FIFO monitors read the
+	fill level and error alerts of each slot every 500 ms. A tick's stall is
+	how much later than scheduled it finished.
+
+*/
+class GuiThreadStandIn : public Thread
+{
+public:
+	GuiThreadStandIn(BenchRig& rig_) : Thread("GUI stand-in"), rig(rig_) {}
+
+	~GuiThreadStandIn()
+	{
+		stopThread(1000);
+	}
+
+	void run() override
+	{
+		int64 ticksPerMs = Time::getHighResolutionTicksPerSecond() / 1000;
+		int64 next = Time::getHighResolutionTicks();
+		int64 nextFifoPoll = next;
+
+		while (!threadShouldExit())
+		{
+			int64 now = Time::getHighResolutionTicks();
+
+			if (now < next)
+			{
+				wait(int(jmax(int64(1), (next - now) / ticksPerMs)));
+				continue;
+			}
+
+			for (auto probe : rig.probes)
+				lastStatus = probe->status;
+
+			if (now >= nextFifoPoll)
+			{
+				for (auto bs : rig.basestations)
+				{
+					fill = bs->getFillPercentage();
+
+					for (auto probe : bs->probes)
+						alerts = probe->statusMonitor->getCounters().alerts;
+				}
+
+				nextFifoPoll += SOAK_FIFO_INTERVAL_MS * ticksPerMs;
+			}
+
+			float stall = float(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - next) * 1000.0);
+
+			{
+				const ScopedLock lock(stallLock);
+				stalls.push_back(stall);
+			}
+
+			next += SOAK_STATUS_INTERVAL_MS * ticksPerMs;
+
+			// Like a timer, skip the ticks that were missed rather than bunching them up
+			while (next < Time::getHighResolutionTicks())
+				next += SOAK_STATUS_INTERVAL_MS * ticksPerMs;
+		}
+	}
+
+	/** Returns the stalls recorded since the last call, sorted. */
+	std::vector<float> takeStalls()
+	{
+		std::vector<float> taken;
+
+		{
+			const ScopedLock lock(stallLock);
+			taken.swap(stalls);
+		}
+
+		std::sort(taken.begin(), taken.end());
+		return taken;
+	}
+
+private:
+	BenchRig& rig;
+
+	ProbeStatus lastStatus;
+	float fill;
+	uint32 alerts;
+
+	CriticalSection stallLock;
+	std::vector<float> stalls;
+};
+
+/** Counters summed over all streams, so intervals can be differenced. */
+struct SoakCounters
+{
+	uint64 packets;
+	uint64 droppedSamples;
+	uint64 missingSamples;
+	uint64 discontinuities;
+
+	static SoakCounters read(BenchRig& rig)
+	{
+		SoakCounters counters = {};
+
+		for (auto stream : rig.apStreams)
+		{
+			counters.packets += stream->getRingStatistics().samplesWritten;
+			counters.discontinuities += stream->unwrapper->getStatistics().discontinuities;
+		}
+
+		for (auto stream : rig.streams)
+		{
+			counters.droppedSamples += stream->getRingStatistics().samplesDropped;
+			counters.missingSamples += stream->getGapStatistics().missingSamples;
+		}
+
+		return counters;
+	}
+};
+
+static bool parseArguments(int argc, char* argv[], SoakSettings& settings)
+{
+	settings.slots = MAX_NUM_SLOTS;
+	settings.ports = NUM_PORTS;
+	settings.docks = NUM_DOCKS;
+	settings.seconds = 4 * 3600.0;
+	settings.interval = 60.0;
+	settings.mode = BATCHED_PACKETS;
+	settings.batchSize = SAMPLECOUNT;
+	settings.threading = THREAD_PER_PROBE;
+	settings.coreBudget = 0;
+	settings.maxRssGrowthMb = 64.0;
+	settings.verbose = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		String argument(argv[i]);
+		String value = i + 1 < argc ? String(argv[i + 1]) : String();
+
+		if (argument == "--verbose")
+		{
+			settings.verbose = true;
+			continue;
+		}
+
+		if (value.isEmpty())
+		{
+			std::cerr << "Missing value for " << argument << std::endl;
+			return false;
+		}
+
+		i++;
+
+		if (argument == "--slots")
+			settings.slots = value.getIntValue();
+		else if (argument == "--ports")
+			settings.ports = value.getIntValue();
+		else if (argument == "--docks")
+			settings.docks = value.getIntValue();
+		else if (argument == "--hours")
+			settings.seconds = value.getDoubleValue() * 3600.0;
+		else if (argument == "--seconds")
+			settings.seconds = value.getDoubleValue();
+		else if (argument == "--interval")
+			settings.interval = value.getDoubleValue();
+		else if (argument == "--batch")
+			settings.batchSize = value.getIntValue();
+		else if (argument == "--max-rss-growth")
+			settings.maxRssGrowthMb = value.getDoubleValue();
+		else if (argument == "--output")
+			settings.outputPath = value;
+		else if (argument == "--cores")
+			settings.coreBudget = value.getIntValue();
+		else if (argument == "--threading")
+		{
+			if (value == "per-probe")
+				settings.threading = THREAD_PER_PROBE;
+			else if (value == "pool")
+				settings.threading = SHARED_POOL;
+			else
+			{
+				std::cerr << "Unknown threading " << value << std::endl;
+				return false;
+			}
+		}
+		else if (argument == "--mode")
+		{
+			if (value == "single")
+				settings.mode = SINGLE_PACKET;
+			else if (value == "batched")
+				settings.mode = BATCHED_PACKETS;
+			else if (value == "callback")
+				settings.mode = PACKET_CALLBACK;
+			else
+			{
+				std::cerr << "Unknown mode " << value << std::endl;
+				return false;
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown argument " << argument << std::endl;
+			return false;
+		}
+	}
+
+	if (settings.slots < 1 || settings.slots > MAX_NUM_SLOTS
+		|| settings.ports < 1 || settings.ports > NUM_PORTS
+		|| settings.docks < 1 || settings.docks > NUM_DOCKS)
+	{
+		std::cerr << "Topology out of range: at most " << MAX_NUM_SLOTS << " slots, "
+			<< NUM_PORTS << " ports and " << NUM_DOCKS << " docks" << std::endl;
+		return false;
+	}
+
+	if (settings.batchSize < 1 || settings.batchSize > SAMPLECOUNT)
+	{
+		std::cerr << "Batch size must be between 1 and " << SAMPLECOUNT << std::endl;
+		return false;
+	}
+
+	if (settings.coreBudget < 0 || settings.coreBudget > MAX_ACQUISITION_WORKERS)
+	{
+		std::cerr << "Core budget must be between 0 and " << MAX_ACQUISITION_WORKERS << std::endl;
+		return false;
+	}
+
+	return settings.seconds > 0 && settings.interval > 0;
+}
+
+/** Spread of the first-packet arrival times across slots, or -1 if some slot sent nothing. */
+static float measureStartSkew(BenchRig& rig)
+{
+	int64 start = Time::getHighResolutionTicks();
+
+	while (getSecondsSince(start) * 1000.0 < SOAK_START_SKEW_TIMEOUT_MS)
+	{
+		double earliest = 0;
+		double latest = 0;
+		bool complete = true;
+
+		for (int i = 0; i < rig.basestations.size() && complete; i++)
+		{
+			SlotStartTime slotStart;
+
+			complete = rig.basestations[i]->getStartTime(slotStart);
+
+			if (i == 0 || slotStart.triggerTimeMs < earliest)
+				earliest = slotStart.triggerTimeMs;
+			if (i == 0 || slotStart.triggerTimeMs > latest)
+				latest = slotStart.triggerTimeMs;
+		}
+
+		if (complete)
+			return float(latest - earliest);
+
+		rig.drain();
+	}
+
+	return -1.0f;
+}
+
+/** Writes JSON lines to a file, or to the console when no path is given. */
+class SoakReport
+{
+public:
+	SoakReport(const String& path, std::streambuf* console_) : console(console_)
+	{
+		if (path.isNotEmpty())
+		{
+			File file(path);
+			file.deleteFile();
+
+			stream = new FileOutputStream(file);
+		}
+	}
+
+	void write(DynamicObject::Ptr line)
+	{
+		String text = JSON::toString(var(line.get()), true) + "\n";
+
+		if (stream != nullptr)
+		{
+			stream->write(text.toRawUTF8(), text.getNumBytesAsUTF8());
+			stream->flush();
+		}
+		else
+		{
+			console << text << std::flush;
+		}
+	}
+
+private:
+	ScopedPointer<FileOutputStream> stream;
+	std::ostream console;
+};
+
+int main(int argc, char* argv[])
+{
+
+	SoakSettings settings;
+
+	if (!parseArguments(argc, argv, settings))
+		return 1;
+
+	// The components log to stdout; keep that apart from the JSON lines
+	std::stringstream discarded;
+	std::streambuf* console = std::cout.rdbuf();
+
+	if (!settings.verbose)
+		std::cout.rdbuf(discarded.rdbuf());
+
+	npsim::SimulatorConfig config = npsim::getDefaultConfig();
+
+	config.slotMask = 0;
+
+	for (int slot = 0; slot < settings.slots; slot++)
+		config.slotMask |= 1u << slot;
+
+	config.portsPerSlot = settings.ports;
+	config.docksPerPort = settings.docks;
+
+	npsim::configure(config);
+
+	std::cerr << "Bringing up " << settings.slots << " slots with " << settings.ports * settings.docks
+		<< " probes each" << std::endl;
+
+	int64 setupStart = Time::getHighResolutionTicks();
+
+	BenchRig rig;
+
+	if (!rig.isReady())
+	{
+		std::cerr << "Could not set up the simulated hardware" << std::endl;
+		return 1;
+	}
+
+	double setupSeconds = getSecondsSince(setupStart);
+
+	int idleThreads = ProcessStats::getThreadCount();
+
+	rig.setThreading(settings.threading, settings.coreBudget);
+
+	if (!rig.start(settings.mode, settings.batchSize, START_HARDWARE_SYNCHRONIZED))
+		std::cerr << "Not every probe armed in time" << std::endl;
+
+	int64 triggerTicks = Time::getHighResolutionTicks();
+	float startSkew = measureStartSkew(rig);
+
+	GuiThreadStandIn gui(rig);
+	gui.startThread();
+
+	// Let the readers settle before taking the reference thread count and RSS
+	rig.run(jmin(settings.interval, 5.0));
+
+	int threads = ProcessStats::getThreadCount();
+	int64 firstRss = -1;
+	int64 rss = ProcessStats::getResidentBytes();
+	bool threadsChanged = false;
+	float worstStall = 0;
+
+	SoakReport report(settings.outputPath, console);
+
+	SoakCounters previous = SoakCounters::read(rig);
+	SoakCounters first = previous;
+	int64 previousTicks = Time::getHighResolutionTicks();
+
+	std::cerr << "Streaming " << rig.probes.size() << " probes for " << settings.seconds << " s" << std::endl;
+
+	while (getSecondsSince(triggerTicks) < settings.seconds)
+	{
+		rig.run(jmin(settings.interval, settings.seconds - getSecondsSince(triggerTicks)));
+
+		SoakCounters counters = SoakCounters::read(rig);
+		double elapsed = getSecondsSince(previousTicks);
+
+		previousTicks = Time::getHighResolutionTicks();
+
+		rss = ProcessStats::getResidentBytes();
+
+		if (firstRss < 0)
+			firstRss = rss;
+
+		int currentThreads = ProcessStats::getThreadCount();
+		threadsChanged = threadsChanged || currentThreads != threads;
+
+		double driftMin = 0;
+		double driftMax = 0;
+		bool anyDrift = false;
+		double now = Time::getMillisecondCounterHiRes();
+
+		for (int i = 0; i < rig.apStreams.size(); i++)
+		{
+			uint32 firstTimestamp;
+			double firstPacketTime;
+
+			if (!rig.apStreams[i]->getFirstPacket(firstTimestamp, firstPacketTime))
+				continue;
+
+			int64 samples = rig.apStreams[i]->unwrapper->getStatistics().lastSampleNumber - int64(firstTimestamp);
+			double drift = samples * 1000.0 / SAMPLERATE - (now - firstPacketTime);
+
+			driftMin = anyDrift ? jmin(driftMin, drift) : drift;
+			driftMax = anyDrift ? jmax(driftMax, drift) : drift;
+			anyDrift = true;
+		}
+
+		std::vector<float> stalls = gui.takeStalls();
+		float stallMax = stalls.empty() ? 0.0f : stalls.back();
+		float stallP99 = stalls.empty() ? 0.0f : stalls[size_t(stalls.size() * 0.99)];
+
+		worstStall = jmax(worstStall, stallMax);
+
+		DynamicObject::Ptr line = new DynamicObject();
+
+		line->setProperty("elapsedSeconds", getSecondsSince(triggerTicks));
+		line->setProperty("rssBytes", rss);
+		line->setProperty("threads", currentThreads);
+		line->setProperty("packetsPerSecond", double(counters.packets - previous.packets) / elapsed);
+		line->setProperty("droppedSamples", int64(counters.droppedSamples - previous.droppedSamples));
+		line->setProperty("missingSamples", int64(counters.missingSamples - previous.missingSamples));
+		line->setProperty("discontinuities", int64(counters.discontinuities - previous.discontinuities));
+		line->setProperty("driftMinMs", driftMin);
+		line->setProperty("driftMaxMs", driftMax);
+		line->setProperty("guiStallMaxMs", stallMax);
+		line->setProperty("guiStallP99Ms", stallP99);
+
+		report.write(line);
+		discarded.str(std::string());
+
+		previous = counters;
+	}
+
+	gui.stopThread(1000);
+	ExecutorStatistics pool = rig.getExecutorStatistics();
+
+	rig.stop();
+
+	double rssGrowthMb = firstRss >= 0 ? double(rss - firstRss) / (1024.0 * 1024.0) : 0.0;
+	bool passed = rssGrowthMb <= settings.maxRssGrowthMb && !threadsChanged;
+
+	DynamicObject::Ptr summary = new DynamicObject();
+
+	summary->setProperty("summary", true);
+	summary->setProperty("slots", rig.basestations.size());
+	summary->setProperty("probes", rig.probes.size());
+	summary->setProperty("setupSeconds", setupSeconds);
+	summary->setProperty("startSkewMs", startSkew);
+	summary->setProperty("idleThreads", idleThreads);
+	summary->setProperty("streamingThreads", threads);
+	summary->setProperty("threadsChanged", threadsChanged);
+	summary->setProperty("poolWorkers", pool.workers);
+	summary->setProperty("poolSteals", pool.steals);
+	summary->setProperty("rssGrowthMb", rssGrowthMb);
+	summary->setProperty("totalDroppedSamples", int64(previous.droppedSamples - first.droppedSamples));
+	summary->setProperty("totalMissingSamples", int64(previous.missingSamples - first.missingSamples));
+	summary->setProperty("worstGuiStallMs", worstStall);
+	summary->setProperty("passed", passed);
+
+	report.write(summary);
+
+	std::cout.rdbuf(console);
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,1163 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "NeuropixSimulator.h"
+#include "SimulatedSignal.h"
+
+#include "NeuropixAPI.h"
+namespace np {
+#include "NeuropixAPI_debug.h"
+}
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define SIM_MAX_SLOTS 		32
+#define SIM_PORTS 			4
+#define SIM_DOCKS 			2
+#define SIM_FIRST_SLOT 		2    //PXI chassis number their peripheral slots from 2
+#define SIM_PUMP_PERIOD_MS 	1
+#define SIM_PUMP_BATCH 		64
+
+using namespace np;
+
+namespace
+{
+
+struct SimProbe;
+
+struct SimStream
+{
+	SimProbe* probe;
+	streamsource_t source;
+
+	uint64_t consumed;        //Sample number of the next packet to hand out
+	uint32_t packets;
+	uint32_t samples;
+	uint32_t overflows;
+	uint32_t lastTimestamp;
+
+	np_packetcallbackfn_t callback;
+	const void* userdata;
+};
+
+struct SimProbe
+{
+	SimProbe(const npsim::SimulatorConfig& config, uint32_t seed) : signal(config, seed), open(false), initialized(false)
+	{
+		for (int ch = 0; ch < SIM_CHANNELS; ch++)
+		{
+			pendingBank[ch] = 0;
+			bank[ch] = 0;
+		}
+
+		for (int s = 0; s < 2; s++)
+		{
+			memset(&streams[s], 0, sizeof(SimStream));
+			streams[s].probe = this;
+			streams[s].source = streamsource_t(s);
+		}
+	}
+
+	//Recursive: a packet callback may query the FIFO of its own probe
+	std::recursive_mutex lock;
+
+	SimulatedSignal signal;
+	bool open;
+	bool initialized;
+
+	int pendingBank[SIM_CHANNELS];   //Staged by selectElectrode, applied by writeProbeConfiguration
+	int bank[SIM_CHANNELS];
+
+	SimStream streams[2];
+};
+
+struct SimSlot
+{
+	SimSlot() : present(false), open(false), armed(false), triggered(false), triggerTime(0),
+		triggerInput(SIGNALLINE_SW), drivenLines(0), risingEdge(true), triggers(0), pumpRunning(false) {}
+
+	bool present;
+	bool open;
+	bool armed;
+
+	std::atomic<bool> triggered;
+	std::atomic<int64_t> triggerTime;   //Steady clock, microseconds
+
+	uint32_t triggerInput;   //Line that starts this slot
+	uint32_t drivenLines;    //Lines this slot drives from its software trigger
+	bool risingEdge;
+	uint32_t triggers;
+
+	std::unique_ptr<SimProbe> probes[SIM_PORTS][SIM_DOCKS];
+
+	std::thread pump;
+	std::atomic<bool> pumpRunning;
+};
+
+struct Simulator
+{
+	Simulator() : config(npsim::getDefaultConfig()), syncPeriodMs(1000) { build(); }
+	~Simulator() { shutdown(); }
+
+	void build();
+	void shutdown();
+
+	std::mutex lock;
+	npsim::SimulatorConfig config;
+	int syncPeriodMs;
+
+	SimSlot slots[SIM_MAX_SLOTS];
+};
+
+Simulator& sim()
+{
+	static Simulator simulator;
+	return simulator;
+}
+
+int64_t nowMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void sleepMs(float milliseconds)
+{
+	if (milliseconds > 0.0f)
+		std::this_thread::sleep_for(std::chrono::microseconds(int64_t(milliseconds * 1000.0f)));
+}
+
+int envInt(const char* name, int fallback)
+{
+	const char* value = getenv(name);
+	return value != nullptr ? atoi(value) : fallback;
+}
+
+void Simulator::build()
+{
+
+	for (int s = 0; s < SIM_MAX_SLOTS; s++)
+	{
+		SimSlot& slot = slots[s];
+
+		slot.present = (config.slotMask >> s) & 1;
+		slot.open = false;
+		slot.armed = false;
+		slot.triggered = false;
+		slot.triggerInput = SIGNALLINE_SW;
+		slot.drivenLines = 0;
+		slot.risingEdge = true;
+		slot.triggers = 0;
+
+		for (int port = 0; port < SIM_PORTS; port++)
+		{
+			for (int dock = 0; dock < SIM_DOCKS; dock++)
+			{
+				bool present = slot.present && port < config.portsPerSlot && dock < config.docksPerPort;
+				uint32_t seed = config.seed + uint32_t(((s * SIM_PORTS) + port) * SIM_DOCKS + dock) * 2654435761u;
+
+				slot.probes[port][dock].reset(present ? new SimProbe(config, seed) : nullptr);
+			}
+		}
+	}
+
+}
+
+void Simulator::shutdown()
+{
+	for (int s = 0; s < SIM_MAX_SLOTS; s++)
+	{
+		slots[s].pumpRunning = false;
+
+		if (slots[s].pump.joinable())
+			slots[s].pump.join();
+	}
+}
+
+SimSlot* getSlot(int slotID, NP_ErrorCode& ec, bool mustBeOpen = true)
+{
+	if (slotID < 0 || slotID >= SIM_MAX_SLOTS)
+	{
+		ec = WRONG_SLOT;
+		return nullptr;
+	}
+
+	SimSlot& slot = sim().slots[slotID];
+
+	if (!slot.present)
+		ec = NO_SLOT;
+	else if (mustBeOpen && !slot.open)
+		ec = NOT_OPEN;
+	else
+		ec = SUCCESS;
+
+	return ec == SUCCESS ? &slot : nullptr;
+}
+
+SimProbe* getProbe(int slotID, int portID, int dockID, NP_ErrorCode& ec, bool mustBeOpen = true)
+{
+	SimSlot* slot = getSlot(slotID, ec);
+
+	if (slot == nullptr)
+		return nullptr;
+
+	if (portID < 1 || portID > SIM_PORTS)
+	{
+		ec = WRONG_PORT;
+		return nullptr;
+	}
+
+	if (dockID < 1 || dockID > SIM_DOCKS)
+	{
+		ec = WRONG_DOCK_ID;
+		return nullptr;
+	}
+
+	SimProbe* probe = slot->probes[portID - 1][dockID - 1].get();
+
+	if (probe == nullptr)
+		ec = NO_PROBE;
+	else if (mustBeOpen && !probe->open)
+		ec = NOT_OPEN;
+
+	return ec == SUCCESS ? probe : nullptr;
+}
+
+SimStream* getStream(int slotID, int portID, int dockID, streamsource_t source, NP_ErrorCode& ec)
+{
+	SimProbe* probe = getProbe(slotID, portID, dockID, ec);
+
+	if (probe == nullptr)
+		return nullptr;
+
+	if (source != SourceAP && !(source == SourceLFP && sim().config.lfpStream))
+	{
+		ec = UNKNOWN_STREAMSOURCE;
+		return nullptr;
+	}
+
+	return &probe->streams[source];
+}
+
+/** Samples the hardware has produced on a stream since the trigger. */
+uint64_t producedSamples(const SimSlot& slot, streamsource_t source)
+{
+	if (!slot.triggered.load(std::memory_order_acquire))
+		return 0;
+
+	int64_t elapsed = nowMicros() - slot.triggerTime.load(std::memory_order_relaxed);
+
+	if (elapsed <= 0)
+		return 0;
+
+	uint64_t ap = uint64_t(elapsed) * SIM_SAMPLERATE / 1000000;
+
+	return source == SourceLFP ? ap / SIM_LFP_DECIMATION : ap;
+}
+
+/** Drops the oldest packets of a full FIFO, the way the basestation does. */
+uint64_t updateFifo(SimStream& stream, const SimSlot& slot)
+{
+	uint64_t produced = producedSamples(slot, stream.source);
+	uint64_t available = produced > stream.consumed ? produced - stream.consumed : 0;
+	uint64_t depth = sim().config.fifoPackets;
+
+	if (available > depth)
+	{
+		stream.consumed += available - depth;
+		stream.overflows++;
+		available = depth;
+	}
+
+	return available;
+}
+
+uint16_t packetStatus(SimStream& stream, uint64_t ticks, uint32_t random)
+{
+
+	const npsim::SimulatorConfig& config = sim().config;
+
+	uint16_t status = stream.source == SourceLFP ? ELECTRODEPACKET_STATUS_LFP : 0;
+
+	//Square sync wave with a 50% duty cycle
+	uint64_t period = uint64_t(sim().syncPeriodMs) * SIM_SAMPLERATE / 1000;
+
+	if (period > 0 && (ticks % period) < period / 2)
+		status |= ELECTRODEPACKET_STATUS_SYNC;
+
+	if (config.errorRate > 0.0f && float(random & 0xFFFFFF) / float(0x1000000) < config.errorRate)
+	{
+		static const uint16_t errors[] = {
+			ELECTRODEPACKET_STATUS_ERR_COUNT,
+			ELECTRODEPACKET_STATUS_ERR_SERDES,
+			ELECTRODEPACKET_STATUS_ERR_LOCK,
+			ELECTRODEPACKET_STATUS_ERR_POP,
+			ELECTRODEPACKET_STATUS_ERR_SYNC };
+
+		status |= errors[(random >> 24) % 5];
+	}
+
+	return status;
+}
+
+/** Hands out up to maxPackets packets; the probe lock must be held. */
+size_t readStream(SimStream& stream, const SimSlot& slot, PacketInfo* pckinfo, int16_t* data,
+	size_t channelCount, size_t maxPackets)
+{
+
+	size_t count = size_t(std::min<uint64_t>(updateFifo(stream, slot), maxPackets));
+
+	uint64_t ticksPerSample = stream.source == SourceLFP ? SIM_LFP_DECIMATION : 1;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t sample = stream.consumed + i;
+		uint64_t ticks = sample * ticksPerSample;
+
+		if (stream.source == SourceLFP)
+			stream.probe->signal.generateLfp(sample, &data[i * channelCount], channelCount);
+		else
+			stream.probe->signal.generateAp(sample, &data[i * channelCount], channelCount);
+
+		pckinfo[i].Timestamp = uint32_t(ticks) + sim().config.timestampOffset;
+		pckinfo[i].Status = packetStatus(stream, ticks, uint32_t(sample * 2654435761u) ^ uint32_t(ticks >> 7));
+		pckinfo[i].payloadlength = uint16_t(channelCount);
+	}
+
+	stream.consumed += count;
+	stream.packets += uint32_t(count);
+	stream.samples += uint32_t(count * channelCount);
+
+	if (count > 0)
+		stream.lastTimestamp = pckinfo[count - 1].Timestamp;
+
+	return count;
+}
+
+/** Delivers packets to the registered callbacks of one slot until the slot closes. */
+void runPump(SimSlot* slot)
+{
+
+	PacketInfo pckinfo[SIM_PUMP_BATCH];
+	std::vector<int16_t> data(SIM_PUMP_BATCH * SIM_CHANNELS);
+	np_packet_t packet;
+
+	while (slot->pumpRunning.load())
+	{
+		for (int port = 0; port < SIM_PORTS; port++)
+		{
+			for (int dock = 0; dock < SIM_DOCKS; dock++)
+			{
+				SimProbe* probe = slot->probes[port][dock].get();
+
+				if (probe == nullptr)
+					continue;
+
+				std::lock_guard<std::recursive_mutex> lock(probe->lock);
+
+				for (int s = 0; s < 2; s++)
+				{
+					SimStream& stream = probe->streams[s];
+
+					if (stream.callback == nullptr)
+						continue;
+
+					size_t count = readStream(stream, *slot, pckinfo, &data[0], SIM_CHANNELS, SIM_PUMP_BATCH);
+
+					for (size_t i = 0; i < count; i++)
+					{
+						memset(&packet.hdr, 0, sizeof(packet.hdr));
+						packet.hdr.samplecount = SIM_CHANNELS;
+						packet.hdr.timestamp = pckinfo[i].Timestamp;
+						packet.hdr.status = uint8_t(pckinfo[i].Status);
+						packet.hdr.sourceid = uint8_t(((port * SIM_DOCKS) + dock) * 2 + s);
+						memcpy(packet.payload, &data[i * SIM_CHANNELS], SIM_CHANNELS * sizeof(int16_t));
+
+						//Held under the probe lock, so destroyPacketCallback waits for it to return
+						stream.callback(packet, stream.userdata);
+					}
+				}
+			}
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(SIM_PUMP_PERIOD_MS));
+	}
+
+}
+
+/** Starts every armed slot listening to one of the lines. */
+void raiseLines(uint32_t lines, int64_t time)
+{
+	for (int s = 0; s < SIM_MAX_SLOTS; s++)
+	{
+		SimSlot& slot = sim().slots[s];
+
+		if (slot.open && slot.armed && !slot.triggered && (slot.triggerInput & lines) != 0)
+		{
+			slot.triggerTime.store(time, std::memory_order_relaxed);
+			slot.triggered.store(true, std::memory_order_release);
+			slot.triggers++;
+		}
+	}
+}
+
+void copyString(const char* source, char* destination, size_t maxlen)
+{
+	if (destination == nullptr || maxlen == 0)
+		return;
+
+	strncpy(destination, source, maxlen - 1);
+	destination[maxlen - 1] = 0;
+}
+
+}
+
+namespace npsim
+{
+
+SimulatorConfig getDefaultConfig()
+{
+
+	SimulatorConfig config;
+
+	int slots = std::max(0, std::min(SIM_MAX_SLOTS - SIM_FIRST_SLOT, envInt("NPX2_SIM_SLOTS", 1)));
+
+	config.slotMask = 0;
+	for (int i = 0; i < slots; i++)
+		config.slotMask |= 1u << (SIM_FIRST_SLOT + i);
+
+	config.portsPerSlot = std::max(0, std::min(SIM_PORTS, envInt("NPX2_SIM_PORTS", 2)));
+	config.docksPerPort = std::max(0, std::min(SIM_DOCKS, envInt("NPX2_SIM_DOCKS", 1)));
+	config.lfpStream = true;
+
+	config.microvoltsPerCount = 0.195f;
+	config.noiseMicrovolts = 8.0f;
+	config.lfpMicrovolts = 150.0f;
+	config.unitsPerProbe = 40;
+	config.firingRateHz = 5.0f;
+	config.spikeMicrovolts = 120.0f;
+
+	config.errorRate = 0.0f;
+	config.timestampOffset = 0;
+	config.fifoPackets = 30000;  //One second of AP data
+
+	config.openLatencyMs = 50.0f;
+	config.initLatencyMs = 40.0f;
+	config.configLatencyMs = 10.0f;
+
+	config.seed = 20210504;
+
+	return config;
+}
+
+void configure(const SimulatorConfig& config)
+{
+	Simulator& s = sim();
+
+	s.shutdown();
+
+	std::lock_guard<std::mutex> lock(s.lock);
+	s.config = config;
+	s.build();
+}
+
+SimulatorConfig getConfig()
+{
+	return sim().config;
+}
+
+int getNumProbes()
+{
+	const SimulatorConfig& config = sim().config;
+
+	int slots = 0;
+	for (int s = 0; s < SIM_MAX_SLOTS; s++)
+		slots += (config.slotMask >> s) & 1;
+
+	return slots * config.portsPerSlot * config.docksPerPort;
+}
+
+}
+
+namespace np
+{
+
+/* System **************************************************************************/
+
+void NP_APIC getAPIVersion(uint8_t* version_major, uint8_t* version_minor)
+{
+	*version_major = 2;
+	*version_minor = 8;
+}
+
+NP_ErrorCode NP_APIC getAvailableSlots(uint32_t* slotmask)
+{
+	*slotmask = sim().config.slotMask;
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC setParameter(np_parameter_t paramid, int value)
+{
+
+	std::lock_guard<std::mutex> lock(sim().lock);
+
+	switch (paramid)
+	{
+	case NP_PARAM_SYNCPERIOD_MS:
+		sim().syncPeriodMs = value;
+		break;
+	case NP_PARAM_SYNCFREQUENCY_HZ:
+		sim().syncPeriodMs = value > 0 ? 1000 / value : 0;
+		break;
+	default:
+		break;
+	}
+
+	return SUCCESS;
+}
+
+/* Basestation *********************************************************************/
+
+NP_ErrorCode NP_APIC openBS(int slotID)
+{
+
+	NP_ErrorCode ec;
+	SimSlot* slot = getSlot(slotID, ec, false);
+
+	if (slot == nullptr)
+		return ec;
+
+	sleepMs(sim().config.openLatencyMs);
+
+	std::lock_guard<std::mutex> lock(sim().lock);
+	slot->open = true;
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC closeBS(int slotID)
+{
+
+	NP_ErrorCode ec;
+	SimSlot* slot = getSlot(slotID, ec, false);
+
+	if (slot == nullptr)
+		return ec;
+
+	slot->pumpRunning = false;
+	if (slot->pump.joinable())
+		slot->pump.join();
+
+	std::lock_guard<std::mutex> lock(sim().lock);
+	slot->open = false;
+	slot->armed = false;
+	slot->triggered = false;
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC arm(int slotID)
+{
+
+	NP_ErrorCode ec;
+	SimSlot* slot = getSlot(slotID, ec);
+
+	if (slot == nullptr)
+		return ec;
+
+	std::lock_guard<std::mutex> lock(sim().lock);
+
+	slot->triggered = false;
+	slot->armed = true;
+
+	for (int port = 0; port < SIM_PORTS; port++)
+	{
+		for (int dock = 0; dock < SIM_DOCKS; dock++)
+		{
+			SimProbe* probe = slot->probes[port][dock].get();
+
+			if (probe == nullptr)
+				continue;
+
+			std::lock_guard<std::recursive_mutex> probeLock(probe->lock);
+
+			//The timestamp counter restarts on the next trigger
+			probe->streams[SourceAP].consumed = 0;
+			probe->streams[SourceLFP].consumed = 0;
+			probe->signal.reset();
+		}
+	}
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC setSWTrigger(int slotID)
+{
+
+	NP_ErrorCode ec;
+	SimSlot* slot = getSlot(slotID, ec);
+
+	if (slot == nullptr)
+		return ec;
+
+	std::lock_guard<std::mutex> lock(sim().lock);
+
+	//Only this slot listens to its own software line...
+	if (slot->armed && !slot->triggered && (slot->triggerInput & SIGNALLINE_SW))
+	{
+		slot->triggerTime.store(nowMicros(), std::memory_order_relaxed);
+		slot->triggered.store(true, std::memory_order_release);
+		slot->triggers++;
+	}
+
+	//...but the lines it drives reach every slot in the chassis on the same edge
+	if (slot->drivenLines != 0)
+		raiseLines(slot->drivenLines, nowMicros());
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC setTriggerEdge(int slotID, bool rising)
+{
+
+	NP_ErrorCode ec;
+	SimSlot* slot = getSlot(slotID, ec);
+
+	if (slot == nullptr)
+		return ec;
+
+	std::lock_guard<std::mutex> lock(sim().lock);
+	slot->risingEdge = rising;
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC setTriggerBinding(int slotID, signalline_t outputlines, signalline_t inputlines)
+{
+
+	NP_ErrorCode ec;
+	SimSlot* slot = getSlot(slotID, ec);
+
+	if (slot == nullptr)
+		return ec;
+
+	std::lock_guard<std::mutex> lock(sim().lock);
+
+	if (outputlines & SIGNALLINE_LOCALTRIGGER)
+		slot->triggerInput = inputlines;
+
+	uint32_t shared = uint32_t(outputlines) & ~uint32_t(SIGNALLINE_LOCALTRIGGER);
+
+	if (inputlines & SIGNALLINE_SW)
+		slot->drivenLines |= shared;
+	else
+		slot->drivenLines &= ~shared;
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC enableFileStream(int slotID, bool enable)
+{
+	NP_ErrorCode ec;
+	getSlot(slotID, ec);
+	return ec;
+}
+
+NP_ErrorCode NP_APIC setFileStream(int slotID, const char* filename)
+{
+	NP_ErrorCode ec;
+	getSlot(slotID, ec);
+	return ec;
+}
+
+NP_ErrorCode NP_APIC getBSBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build)
+{
+	*version_major = 2;
+	*version_minor = 0;
+	if (version_build != nullptr)
+		*version_build = 137;
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC getBSCBootVersion(int slotID, uint8_t* version_major, uint8_t* version_minor, uint16_t* version_build)
+{
+	*version_major = 3;
+	*version_minor = 0;
+	if (version_build != nullptr)
+		*version_build = 176;
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC getBSCVersion(int slotID, uint8_t* version_major, uint8_t* version_minor)
+{
+	*version_major = 2;
+	*version_minor = 0;
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC readBSCSN(int slotID, uint64_t* sn)
+{
+	*sn = 700000 + uint64_t(slotID);
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC readBSCPN(int slotID, char* pn, size_t len)
+{
+	copyString("NP2_QBSC_00", pn, len);
+	return SUCCESS;
+}
+
+/* Headstage and flex ******************************************************************/
+
+NP_ErrorCode NP_APIC closePort(int slotID, int portID)
+{
+	NP_ErrorCode ec;
+	SimSlot* slot = getSlot(slotID, ec);
+
+	if (slot == nullptr)
+		return ec;
+
+	if (portID < 1 || portID > SIM_PORTS)
+		return WRONG_PORT;
+
+	for (int dock = 0; dock < SIM_DOCKS; dock++)
+	{
+		SimProbe* probe = slot->probes[portID - 1][dock].get();
+
+		if (probe != nullptr)
+		{
+			std::lock_guard<std::recursive_mutex> lock(probe->lock);
+			probe->open = false;
+			probe->initialized = false;
+		}
+	}
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC setHSLed(int slotID, int portID, bool enable)
+{
+	NP_ErrorCode ec;
+	getProbe(slotID, portID, 1, ec);
+	return ec;
+}
+
+NP_ErrorCode NP_APIC getHSVersion(int slotID, int portID, uint8_t* version_major, uint8_t* version_minor)
+{
+	*version_major = 1;
+	*version_minor = 0;
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC readHSSN(int slotID, int portID, uint64_t* sn)
+{
+	*sn = 800000 + uint64_t(slotID) * 10 + uint64_t(portID);
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC readHSPN(int slotID, int portID, char* pn, size_t maxlen)
+{
+	copyString("NPM_HS_30", pn, maxlen);
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC getFlexVersion(int slotID, int portID, int dockID, unsigned char* version_major, unsigned char* version_minor)
+{
+	*version_major = 1;
+	*version_minor = 0;
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC readFlexPN(int slotID, int portID, int dockID, char* pn, size_t maxlen)
+{
+	copyString("NPM_FLEX_01", pn, maxlen);
+	return SUCCESS;
+}
+
+/* Probe ****************************************************************************/
+
+NP_ErrorCode NP_APIC openProbe(int slotID, int portID, int dockID)
+{
+
+	NP_ErrorCode ec;
+	SimProbe* probe = getProbe(slotID, portID, dockID, ec, false);
+
+	if (probe == nullptr)
+		return ec;
+
+	sleepMs(sim().config.openLatencyMs);
+
+	std::lock_guard<std::recursive_mutex> lock(probe->lock);
+	probe->open = true;
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC init(int slotID, int portID, int dockID)
+{
+
+	NP_ErrorCode ec;
+	SimProbe* probe = getProbe(slotID, portID, dockID, ec);
+
+	if (probe == nullptr)
+		return ec;
+
+	sleepMs(sim().config.initLatencyMs);
+
+	std::lock_guard<std::recursive_mutex> lock(probe->lock);
+
+	//Power-on state: bank 0 on every channel, filters enabled, nothing in standby
+	int electrodes[SIM_CHANNELS];
+
+	for (int ch = 0; ch < SIM_CHANNELS; ch++)
+	{
+		probe->pendingBank[ch] = 0;
+		probe->bank[ch] = 0;
+		electrodes[ch] = ch;
+		probe->signal.setHighPassDisabled(ch, false);
+		probe->signal.setStandby(ch, false);
+	}
+
+	probe->signal.setElectrodes(electrodes);
+	probe->initialized = true;
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC readProbeSN(int slotID, int portID, int dockID, uint64_t* id)
+{
+	//Above NPX2_MIN_PROBE_SERIAL, which is how the plugin recognises a 2.0 probe
+	*id = 19000000000ull + uint64_t(slotID) * 100 + uint64_t(portID) * 10 + uint64_t(dockID);
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC readProbePN(int slotID, int portID, int dockID, char* pn, size_t maxlen)
+{
+	copyString("NP2000", pn, maxlen);
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC setOPMODE(int slotID, int portID, int dockID, probe_opmode_t mode)
+{
+	NP_ErrorCode ec;
+	getProbe(slotID, portID, dockID, ec);
+	return ec;
+}
+
+NP_ErrorCode NP_APIC selectElectrode(int slotID, int portID, int dockID, int channel, int shank, int bank)
+{
+
+	NP_ErrorCode ec;
+	SimProbe* probe = getProbe(slotID, portID, dockID, ec);
+
+	if (probe == nullptr)
+		return ec;
+
+	if (channel < 0 || channel >= SIM_CHANNELS)
+		return WRONG_CHANNEL;
+
+	if (shank != 0)
+		return WRONG_SHANK;
+
+	std::lock_guard<std::recursive_mutex> lock(probe->lock);
+
+	//0xFF disconnects the channel
+	probe->pendingBank[channel] = bank == 0xFF ? -1 : bank;
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC setReference(int slotID, int portID, int dockID, int channel, int shank, channelreference_t reference, int intRefElectrodeBank)
+{
+	NP_ErrorCode ec;
+	getProbe(slotID, portID, dockID, ec);
+
+	if (ec == SUCCESS && (channel < 0 || channel >= SIM_CHANNELS))
+		return WRONG_CHANNEL;
+
+	return ec;
+}
+
+NP_ErrorCode NP_APIC setAPCornerFrequency(int slotID, int portID, int dockID, int channel, bool disableHighPass)
+{
+
+	NP_ErrorCode ec;
+	SimProbe* probe = getProbe(slotID, portID, dockID, ec);
+
+	if (probe == nullptr)
+		return ec;
+
+	if (channel < 0 || channel >= SIM_CHANNELS)
+		return WRONG_CHANNEL;
+
+	std::lock_guard<std::recursive_mutex> lock(probe->lock);
+	probe->signal.setHighPassDisabled(channel, disableHighPass);
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC setStdb(int slotID, int portID, int dockID, int channel, bool standby)
+{
+
+	NP_ErrorCode ec;
+	SimProbe* probe = getProbe(slotID, portID, dockID, ec);
+
+	if (probe == nullptr)
+		return ec;
+
+	if (channel < 0 || channel >= SIM_CHANNELS)
+		return WRONG_CHANNEL;
+
+	std::lock_guard<std::recursive_mutex> lock(probe->lock);
+	probe->signal.setStandby(channel, standby);
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC writeProbeConfiguration(int slotID, int portID, int dockID, bool readCheck)
+{
+
+	NP_ErrorCode ec;
+	SimProbe* probe = getProbe(slotID, portID, dockID, ec);
+
+	if (probe == nullptr)
+		return ec;
+
+	sleepMs(sim().config.configLatencyMs);
+
+	std::lock_guard<std::recursive_mutex> lock(probe->lock);
+
+	//Electrode = bank * 384 + channel is a simplification of the 2.0 shank layout,
+	//enough to move the units in and out of view when banks change
+	int electrodes[SIM_CHANNELS];
+
+	for (int ch = 0; ch < SIM_CHANNELS; ch++)
+	{
+		probe->bank[ch] = probe->pendingBank[ch];
+
+		int electrode = probe->bank[ch] < 0 ? -1 : probe->bank[ch] * SIM_CHANNELS + ch;
+		electrodes[ch] = electrode < SIM_ELECTRODES ? electrode : -1;
+	}
+
+	probe->signal.setElectrodes(electrodes);
+
+	return SUCCESS;
+}
+
+/* Data ****************************************************************************/
+
+NP_ErrorCode NP_APIC readPacket(int slotID, int portID, int dockID, streamsource_t source, struct PacketInfo* pckinfo, int16_t* data, size_t requestedChannelCount, size_t* actualread)
+{
+
+	NP_ErrorCode ec;
+	SimStream* stream = getStream(slotID, portID, dockID, source, ec);
+
+	if (stream == nullptr)
+		return ec;
+
+	std::lock_guard<std::recursive_mutex> lock(stream->probe->lock);
+
+	size_t count = readStream(*stream, sim().slots[slotID], pckinfo, data, requestedChannelCount, 1);
+
+	if (actualread != nullptr)
+		*actualread = count > 0 ? requestedChannelCount : 0;
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC readPackets(int slotID, int portID, int dockID, streamsource_t source, struct PacketInfo* pckinfo, int16_t* data, size_t channelcount, size_t packetcount, size_t* packetsread)
+{
+
+	NP_ErrorCode ec;
+	SimStream* stream = getStream(slotID, portID, dockID, source, ec);
+
+	if (stream == nullptr)
+		return ec;
+
+	std::lock_guard<std::recursive_mutex> lock(stream->probe->lock);
+
+	*packetsread = readStream(*stream, sim().slots[slotID], pckinfo, data, channelcount, packetcount);
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC getPacketFifoStatus(int slotID, int portID, int dockID, streamsource_t source, size_t* packetsavailable, size_t* headroom)
+{
+
+	NP_ErrorCode ec;
+	SimStream* stream = getStream(slotID, portID, dockID, source, ec);
+
+	if (stream == nullptr)
+		return ec;
+
+	std::lock_guard<std::recursive_mutex> lock(stream->probe->lock);
+
+	uint64_t available = updateFifo(*stream, sim().slots[slotID]);
+
+	*packetsavailable = size_t(available);
+	*headroom = size_t(sim().config.fifoPackets - available);
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC createProbePacketCallback(int slotID, int portID, int dockID, streamsource_t source, npcallbackhandle_t* handle, np_packetcallbackfn_t callback, const void* userdata)
+{
+
+	NP_ErrorCode ec;
+	SimStream* stream = getStream(slotID, portID, dockID, source, ec);
+
+	if (stream == nullptr)
+		return ec;
+
+	{
+		std::lock_guard<std::recursive_mutex> lock(stream->probe->lock);
+		stream->callback = callback;
+		stream->userdata = userdata;
+	}
+
+	*handle = stream;
+
+	std::lock_guard<std::mutex> lock(sim().lock);
+	SimSlot& slot = sim().slots[slotID];
+
+	if (!slot.pumpRunning)
+	{
+		if (slot.pump.joinable())
+			slot.pump.join();
+
+		slot.pumpRunning = true;
+		slot.pump = std::thread(runPump, &slot);
+	}
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC destroyPacketCallback(npcallbackhandle_t* handle)
+{
+
+	if (handle == nullptr || *handle == nullptr)
+		return ILLEGAL_HANDLE;
+
+	SimStream* stream = static_cast<SimStream*>(*handle);
+
+	std::lock_guard<std::recursive_mutex> lock(stream->probe->lock);
+	stream->callback = nullptr;
+	stream->userdata = nullptr;
+
+	*handle = nullptr;
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC unpackData(const np_packet_t* packet, int16_t* output, size_t samplestoread, size_t* actualread)
+{
+
+	size_t count = std::min(samplestoread, size_t(packet->hdr.samplecount));
+	count = std::min(count, size_t(NP_MAXPAYLOADSIZE / sizeof(int16_t)));
+
+	memcpy(output, packet->payload, count * sizeof(int16_t));
+	*actualread = count;
+
+	return SUCCESS;
+}
+
+/* Built-in self tests: the simulated hardware always passes ***********************/
+
+NP_ErrorCode NP_APIC bistBS(int slotID) { NP_ErrorCode ec; getSlot(slotID, ec); return ec; }
+NP_ErrorCode NP_APIC bistHB(int slotID, int portID, int dockID) { NP_ErrorCode ec; getProbe(slotID, portID, dockID, ec); return ec; }
+NP_ErrorCode NP_APIC bistStartPRBS(int slotID, int portID) { NP_ErrorCode ec; getSlot(slotID, ec); return ec; }
+NP_ErrorCode NP_APIC bistStopPRBS(int slotID, int portID, int* prbs_err) { *prbs_err = 0; NP_ErrorCode ec; getSlot(slotID, ec); return ec; }
+NP_ErrorCode NP_APIC bistI2CMM(int slotID, int portID, int dockID) { NP_ErrorCode ec; getProbe(slotID, portID, dockID, ec); return ec; }
+NP_ErrorCode NP_APIC bistEEPROM(int slotID, int portID) { NP_ErrorCode ec; getSlot(slotID, ec); return ec; }
+NP_ErrorCode NP_APIC bistSR(int slotID, int portID, int dockID) { NP_ErrorCode ec; getProbe(slotID, portID, dockID, ec); return ec; }
+NP_ErrorCode NP_APIC bistPSB(int slotID, int portID, int dockID) { NP_ErrorCode ec; getProbe(slotID, portID, dockID, ec); return ec; }
+NP_ErrorCode NP_APIC bistNoise(int slotID, int portID, int dockID) { NP_ErrorCode ec; getProbe(slotID, portID, dockID, ec); return ec; }
+
+/* Debug statistics ****************************************************************/
+
+NP_ErrorCode NP_APIC dbg_diagstats_read(int slotID, struct np_diagstats* stats)
+{
+
+	NP_ErrorCode ec;
+	SimSlot* slot = getSlot(slotID, ec);
+
+	if (slot == nullptr)
+		return ec;
+
+	memset(stats, 0, sizeof(np_diagstats));
+	stats->triggers = slot->triggers;
+
+	for (int port = 0; port < SIM_PORTS; port++)
+	{
+		for (int dock = 0; dock < SIM_DOCKS; dock++)
+		{
+			SimProbe* probe = slot->probes[port][dock].get();
+
+			if (probe == nullptr)
+				continue;
+
+			std::lock_guard<std::recursive_mutex> lock(probe->lock);
+
+			for (int s = 0; s < 2; s++)
+			{
+				stats->packetcount += probe->streams[s].packets;
+				stats->totalbytes += uint64_t(probe->streams[s].samples) * sizeof(int16_t);
+			}
+		}
+	}
+
+	return SUCCESS;
+}
+
+NP_ErrorCode NP_APIC dbg_sourcestats_read(int slotID, uint8_t sourceID, struct np_sourcestats* stats)
+{
+
+	//sourceID = ((port - 1) * docks + (dock - 1)) * 2 + source
+	int source = sourceID % 2;
+	int dock = (sourceID / 2) % SIM_DOCKS + 1;
+	int port = (sourceID / 2) / SIM_DOCKS + 1;
+
+	NP_ErrorCode ec;
+	SimStream* stream = getStream(slotID, port, dock, streamsource_t(source), ec);
+
+	if (stream == nullptr)
+		return ec;
+
+	std::lock_guard<std::recursive_mutex> lock(stream->probe->lock);
+
+	stats->timestamp = stream->lastTimestamp;
+	stats->packetcount = stream->packets;
+	stats->samplecount = stream->samples;
+	stats->fifooverflow = stream->overflows;
+
+	return SUCCESS;
+}
+
+}
@@ -0,0 +1,94 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __NEUROPIXSIMULATOR_H__
+#define __NEUROPIXSIMULATOR_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+
+	Simulated Neuropixels 2.0 hardware.
+
+	When the plugin is built with NPX2_SIMULATED_BACKEND, this library provides
+	the np:: functions declared in NeuropixAPI.h instead of the vendor library.
+	Basestations, headstages and probes exist wherever SimulatorConfig puts
+	them. Each probe produces 384 channels of synthetic data at 30 kHz (and
+	2.5 kHz LFP): Gaussian noise, depth-dependent LFP oscillations and spikes
+	from a set of units placed along the shank. The data carries hardware
+	timestamps that start at zero on the trigger edge, sync pulses on the
+	status word and optionally injected link errors.
+
+	Data is produced on a wall-clock schedule, so a reader that falls behind
+	sees its FIFO fill up and eventually overflow, just like the hardware.
+
+	The library only uses the standard library, so it can also be linked into
+	benchmarks that do not load the Open Ephys GUI.
+
+*/
+
+namespace npsim
+{
+
+struct SimulatorConfig
+{
+	uint32_t slotMask;          //One basestation per set bit
+	int portsPerSlot;           //Ports with a headstage, starting at port 1 (1 to 4)
+	int docksPerPort;           //Probes per headstage, starting at dock 1 (1 or 2)
+	bool lfpStream;             //Whether the probes accept SourceLFP
+
+	float microvoltsPerCount;   //ADC resolution used to convert the signal model to counts
+	float noiseMicrovolts;      //RMS of the broadband noise
+	float lfpMicrovolts;        //Peak amplitude of the LFP oscillations
+	int unitsPerProbe;          //Number of spiking units along each shank
+	float firingRateHz;         //Mean Poisson rate of each unit
+	float spikeMicrovolts;      //Peak amplitude of a spike on its closest electrode
+
+	float errorRate;            //Fraction of packets flagged with a link error
+	uint32_t timestampOffset;   //Added to every hardware timestamp, to exercise the 32-bit rollover
+	size_t fifoPackets;         //Depth of each stream FIFO; older packets are lost when it overflows
+
+	float openLatencyMs;        //Time taken by openBS and openProbe
+	float initLatencyMs;        //Time taken by np::init
+	float configLatencyMs;      //Time taken by writeProbeConfiguration
+
+	uint32_t seed;
+};
+
+/** Defaults, overridden by the NPX2_SIM_SLOTS, NPX2_SIM_PORTS and NPX2_SIM_DOCKS
+	environment variables when they are set. */
+SimulatorConfig getDefaultConfig();
+
+/** Replaces the simulated hardware. Everything that was open is closed, so only
+	call this while nothing is acquiring. */
+void configure(const SimulatorConfig& config);
+
+SimulatorConfig getConfig();
+
+/** Number of probes the current configuration provides. */
+int getNumProbes();
+
+}
+
+#endif  // __NEUROPIXSIMULATOR_H__
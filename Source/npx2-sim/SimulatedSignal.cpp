@@ -0,0 +1,257 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SimulatedSignal.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#define SIM_THETA_HZ 	8.0
+#define SIM_GAMMA_HZ 	40.0
+
+static const double PI = 3.141592653589793;
+static const double TWO_PI = 2.0 * PI;
+
+SimulatedSignal::SimulatedSignal(const npsim::SimulatorConfig& config, uint32_t seed)
+	: generator(seed), state(seed | 1)
+{
+
+	float countsPerMicrovolt = 1.0f / std::max(config.microvoltsPerCount, 1e-6f);
+
+	//Gaussian noise is looked up rather than drawn per sample, which keeps 11.5 M values/s per probe cheap
+	std::normal_distribution<float> gaussian(0.0f, config.noiseMicrovolts * countsPerMicrovolt);
+
+	noise.resize(SIM_NOISE_TABLE_SIZE);
+	for (int i = 0; i < SIM_NOISE_TABLE_SIZE; i++)
+		noise[i] = int16_t(std::max(-32768.0f, std::min(32767.0f, gaussian(generator))));
+
+	//Biphasic extracellular waveform: sharp trough followed by a slower, smaller peak
+	for (int t = 0; t < SIM_SPIKE_SAMPLES; t++)
+	{
+		double trough = (t - 12.0) / 3.0;
+		double peak = (t - 22.0) / 6.0;
+		waveform[t] = float(-exp(-trough * trough) + 0.35 * exp(-peak * peak));
+	}
+
+	lfpAmplitude = config.lfpMicrovolts * countsPerMicrovolt;
+
+	std::uniform_int_distribution<int> position(0, SIM_ELECTRODES - 1);
+	std::uniform_real_distribution<float> scale(0.5f, 1.0f);
+
+	for (int i = 0; i < config.unitsPerProbe; i++)
+	{
+		Unit unit;
+		unit.electrode = position(generator);
+		unit.amplitude = config.spikeMicrovolts * countsPerMicrovolt * scale(generator);
+		unit.meanInterval = config.firingRateHz > 0 ? SIM_SAMPLERATE / config.firingRateHz : 0.0;
+		unit.nextSpike = 0;
+		units.push_back(unit);
+	}
+
+	for (int ch = 0; ch < SIM_CHANNELS; ch++)
+	{
+		electrodes[ch] = ch;
+		highPassDisabled[ch] = false;
+		standby[ch] = false;
+	}
+
+	updateFootprints();
+	reset();
+
+}
+
+void SimulatedSignal::setElectrodes(const int* electrodes_)
+{
+	memcpy(electrodes, electrodes_, sizeof(electrodes));
+	updateFootprints();
+}
+
+void SimulatedSignal::setHighPassDisabled(int channel, bool disabled)
+{
+	if (channel >= 0 && channel < SIM_CHANNELS)
+		highPassDisabled[channel] = disabled;
+}
+
+void SimulatedSignal::setStandby(int channel, bool standby_)
+{
+	if (channel >= 0 && channel < SIM_CHANNELS)
+		standby[channel] = standby_;
+}
+
+void SimulatedSignal::reset()
+{
+	active.clear();
+
+	for (auto& unit : units)
+		unit.nextSpike = drawInterval(unit);
+}
+
+uint64_t SimulatedSignal::drawInterval(const Unit& unit)
+{
+	if (unit.meanInterval <= 0.0)
+		return UINT64_MAX;
+
+	std::exponential_distribution<double> interval(1.0 / unit.meanInterval);
+
+	//Refractory period of ~1.5 ms
+	return uint64_t(interval(generator)) + 45;
+}
+
+void SimulatedSignal::updateFootprints()
+{
+
+	for (int ch = 0; ch < SIM_CHANNELS; ch++)
+	{
+		//Shallow channels see the oscillation in phase, deep ones inverted
+		lfpGain[ch] = electrodes[ch] < 0 ? 0.0f : float(cos(PI * electrodes[ch] / double(SIM_ELECTRODES)));
+	}
+
+	for (auto& unit : units)
+	{
+		unit.channels.clear();
+		unit.gains.clear();
+
+		for (int ch = 0; ch < SIM_CHANNELS; ch++)
+		{
+			if (electrodes[ch] < 0)
+				continue;
+
+			//Two electrodes per row, so the distance in rows is half the index difference
+			double rows = std::abs(electrodes[ch] - unit.electrode) / 2.0;
+
+			if (rows <= 4.0)
+			{
+				unit.channels.push_back(ch);
+				unit.gains.push_back(float(exp(-rows / 1.5)));
+			}
+		}
+	}
+
+}
+
+uint32_t SimulatedSignal::nextRandom()
+{
+	//xorshift32
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+float SimulatedSignal::lfpAt(double seconds, int channel) const
+{
+	double theta = sin(TWO_PI * SIM_THETA_HZ * seconds);
+	double gamma = sin(TWO_PI * SIM_GAMMA_HZ * seconds + channel * 0.01);
+	return float(lfpGain[channel] * lfpAmplitude * (theta + 0.3 * gamma));
+}
+
+void SimulatedSignal::generateAp(uint64_t sample, int16_t* output, size_t channelCount)
+{
+
+	size_t count = std::min(channelCount, size_t(SIM_CHANNELS));
+
+	//Start the spikes whose onset has been reached; ones that would already be over are skipped
+	for (int u = 0; u < int(units.size()); u++)
+	{
+		Unit& unit = units[u];
+
+		while (unit.nextSpike <= sample)
+		{
+			if (sample - unit.nextSpike < SIM_SPIKE_SAMPLES)
+				active.push_back({ unit.nextSpike, u });
+
+			unit.nextSpike += drawInterval(unit);
+		}
+	}
+
+	uint32_t base = nextRandom();
+
+	for (size_t ch = 0; ch < count; ch++)
+		accumulator[ch] = noise[(base + uint32_t(ch) * 7919u) & (SIM_NOISE_TABLE_SIZE - 1)];
+
+	for (size_t i = 0; i < active.size();)
+	{
+		uint64_t t = sample - active[i].start;
+
+		if (t >= SIM_SPIKE_SAMPLES)
+		{
+			active[i] = active.back();
+			active.pop_back();
+			continue;
+		}
+
+		const Unit& unit = units[active[i].unit];
+		float value = waveform[t] * unit.amplitude;
+
+		for (size_t c = 0; c < unit.channels.size(); c++)
+		{
+			if (size_t(unit.channels[c]) < count)
+				accumulator[unit.channels[c]] += value * unit.gains[c];
+		}
+
+		i++;
+	}
+
+	double seconds = double(sample) / SIM_SAMPLERATE;
+
+	for (size_t ch = 0; ch < count; ch++)
+	{
+		float value = accumulator[ch];
+
+		if (highPassDisabled[ch])
+			value += lfpAt(seconds, int(ch));
+
+		if (standby[ch] || electrodes[ch] < 0)
+			value = 0.0f;
+
+		output[ch] = int16_t(std::max(-32768.0f, std::min(32767.0f, value)));
+	}
+
+	for (size_t ch = count; ch < channelCount; ch++)
+		output[ch] = 0;
+
+}
+
+void SimulatedSignal::generateLfp(uint64_t sample, int16_t* output, size_t channelCount)
+{
+
+	size_t count = std::min(channelCount, size_t(SIM_CHANNELS));
+
+	double seconds = double(sample * SIM_LFP_DECIMATION) / SIM_SAMPLERATE;
+	uint32_t base = nextRandom();
+
+	for (size_t ch = 0; ch < count; ch++)
+	{
+		float value = lfpAt(seconds, int(ch)) + noise[(base + uint32_t(ch) * 7919u) & (SIM_NOISE_TABLE_SIZE - 1)] * 0.25f;
+
+		if (standby[ch] || electrodes[ch] < 0)
+			value = 0.0f;
+
+		output[ch] = int16_t(std::max(-32768.0f, std::min(32767.0f, value)));
+	}
+
+	for (size_t ch = count; ch < channelCount; ch++)
+		output[ch] = 0;
+
+}
@@ -0,0 +1,115 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SIMULATEDSIGNAL_H__
+#define __SIMULATEDSIGNAL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <random>
+
+#include "NeuropixSimulator.h"
+
+#define SIM_CHANNELS 			384
+#define SIM_ELECTRODES 			1280
+#define SIM_SAMPLERATE 			30000
+#define SIM_LFP_DECIMATION 		12
+#define SIM_SPIKE_SAMPLES 		48
+#define SIM_NOISE_TABLE_SIZE 	(1 << 16)
+
+/**
+
+	Synthetic signal of one probe.
+
+	Every channel records from the electrode selected for it. The AP band is
+	Gaussian noise plus spikes: each unit sits at an electrode and its
+	waveform reaches the channels within a few rows of it, scaled by distance.
+	The LFP band is a theta and a gamma oscillation whose amplitude and phase
+	vary with depth. Channels with the high-pass filter disabled also carry
+	the LFP in the AP band; channels in standby are flat.
+
+	generateAp must be called with increasing sample numbers, since the spike
+	trains are drawn sequentially; skipping ahead (e.g. after a FIFO overflow)
+	is fine.
+
+*/
+class SimulatedSignal
+{
+public:
+	SimulatedSignal(const npsim::SimulatorConfig& config, uint32_t seed);
+
+	/** Sets the electrode each channel is connected to; -1 disconnects a channel. */
+	void setElectrodes(const int* electrodes);
+	void setHighPassDisabled(int channel, bool disabled);
+	void setStandby(int channel, bool standby);
+
+	/** Restarts the spike trains at sample 0. */
+	void reset();
+
+	void generateAp(uint64_t sample, int16_t* output, size_t channelCount);
+	void generateLfp(uint64_t sample, int16_t* output, size_t channelCount);
+
+private:
+
+	struct Unit
+	{
+		int electrode;
+		float amplitude;          //ADC counts
+		double meanInterval;      //Samples
+		uint64_t nextSpike;
+		std::vector<int> channels;
+		std::vector<float> gains;
+	};
+
+	struct ActiveSpike
+	{
+		uint64_t start;
+		int unit;
+	};
+
+	float lfpAt(double seconds, int channel) const;
+	uint64_t drawInterval(const Unit& unit);
+	void updateFootprints();
+	uint32_t nextRandom();
+
+	std::vector<int16_t> noise;
+	float waveform[SIM_SPIKE_SAMPLES];
+
+	std::vector<Unit> units;
+	std::vector<ActiveSpike> active;
+
+	int electrodes[SIM_CHANNELS];
+	float lfpGain[SIM_CHANNELS];
+	bool highPassDisabled[SIM_CHANNELS];
+	bool standby[SIM_CHANNELS];
+
+	float lfpAmplitude;           //ADC counts
+
+	std::mt19937 generator;
+	uint32_t state;
+
+	float accumulator[SIM_CHANNELS];
+};
+
+#endif  // __SIMULATEDSIGNAL_H__
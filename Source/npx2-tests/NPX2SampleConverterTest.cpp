@@ -0,0 +1,139 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2019 Allen Institute for Brain Science and Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <DataThreadHeaders.h>
+#include <cmath>
+#include <iostream>
+
+#include "../NPX2SampleConverter.h"
+
+/**
+
+	npx2_converter_test: every SampleConverter kernel this machine supports
+	must produce bit-identical output to the scalar kernel.
+
+	Each round draws random int16 packets over the full range and a random
+	scale per channel, spanning the probe bit-volts and several orders of
+	magnitude either side, then compares the kernels' float bit patterns.
+	Rounds alternate between uniform and per-channel scales, and the input
+	and output are offset so no kernel can rely on aligned packets.
+
+*/
+
+#define TEST_ROUNDS 	50
+#define TEST_PACKETS 	37
+
+static bool compareKernel(SampleConverter::Isa isa, Random& random)
+{
+
+	HeapBlock<int16_t> input(TEST_PACKETS * NUM_CHANNELS + 1);
+	HeapBlock<float> expected(TEST_PACKETS * NUM_CHANNELS);
+	HeapBlock<float> output(TEST_PACKETS * NUM_CHANNELS + 1);
+	float scales[NUM_CHANNELS];
+
+	// Converters live on the heap in the plugin too, where the scale table may not be 32-byte aligned
+	ScopedPointer<SampleConverter> scalar = new SampleConverter();
+	ScopedPointer<SampleConverter> kernel = new SampleConverter();
+
+	scalar->setIsa(SampleConverter::SCALAR);
+
+	if (!kernel->setIsa(isa))
+		return false;
+
+	for (int round = 0; round < TEST_ROUNDS; round++)
+	{
+		const int16_t* packets = input + (round & 1);
+		float* converted = output + ((round >> 1) & 1);
+
+		for (int i = 0; i < TEST_PACKETS * NUM_CHANNELS + 1; i++)
+			input[i] = int16_t(random.nextInt(65536) - 32768);
+
+		// The extremes of the ADC range in every round
+		input[1] = -32768;
+		input[2] = 32767;
+		input[3] = 0;
+
+		if (round % 2 == 0)
+		{
+			float value = round == 0 ? NPX2_BITVOLTS : std::ldexp(random.nextFloat() + 0.5f, random.nextInt(41) - 20);
+			scalar->setScale(value);
+			kernel->setScale(value);
+		}
+		else
+		{
+			for (int ch = 0; ch < NUM_CHANNELS; ch++)
+				scales[ch] = std::ldexp(random.nextFloat() + 0.5f, random.nextInt(41) - 20) * (random.nextBool() ? 1.0f : -1.0f);
+
+			scalar->setScale(scales);
+			kernel->setScale(scales);
+		}
+
+		scalar->convert(packets, expected, TEST_PACKETS);
+		kernel->convert(packets, converted, TEST_PACKETS);
+
+		if (memcmp(expected, converted, sizeof(float) * TEST_PACKETS * NUM_CHANNELS) != 0)
+		{
+			for (int i = 0; i < TEST_PACKETS * NUM_CHANNELS; i++)
+			{
+				if (memcmp(&expected[i], &converted[i], sizeof(float)) != 0)
+				{
+					std::cerr << SampleConverter::getIsaName(isa) << ": round " << round
+						<< ", packet " << i / NUM_CHANNELS << ", channel " << i % NUM_CHANNELS
+						<< ": " << converted[i] << " instead of " << expected[i] << std::endl;
+					break;
+				}
+			}
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+
+	Random random(20190507);
+	int failures = 0;
+
+	for (int i = SampleConverter::SCALAR + 1; i < SampleConverter::NUM_ISAS; i++)
+	{
+		SampleConverter::Isa isa = SampleConverter::Isa(i);
+
+		if (!SampleConverter::isSupported(isa))
+		{
+			std::cout << SampleConverter::getIsaName(isa) << ": not supported, skipped" << std::endl;
+			continue;
+		}
+
+		bool passed = compareKernel(isa, random);
+
+		std::cout << SampleConverter::getIsaName(isa) << ": " << (passed ? "bit-exact" : "FAILED") << std::endl;
+
+		if (!passed)
+			failures++;
+	}
+
+	return failures == 0 ? 0 : 1;
+}